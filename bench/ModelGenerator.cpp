@@ -0,0 +1,377 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "ModelGenerator.h"
+
+#include "FileIO.h"
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <utility/Error.h>
+
+namespace dg { namespace gbdxm {
+
+namespace fs = boost::filesystem;
+
+using std::string;
+using std::vector;
+
+namespace {
+
+const char* MODEL_NAME = "gbdxm_bench";
+const uint64_t MAX_CAFFE_SIZE = (2ull << 30) - (1 << 20);
+const size_t WEIGHTS_BUFFER_SIZE = 1 << 20;
+
+// Protobuf wire types
+const int WIRE_VARINT = 0;
+const int WIRE_LENGTH_DELIMITED = 2;
+
+void putVarint(vector<uint8_t>& out, uint64_t value)
+{
+    while(value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void putTag(vector<uint8_t>& out, int field, int wireType)
+{
+    putVarint(out, static_cast<uint64_t>(field << 3 | wireType));
+}
+
+void putVarintField(vector<uint8_t>& out, int field, uint64_t value)
+{
+    putTag(out, field, WIRE_VARINT);
+    putVarint(out, value);
+}
+
+// Writes the tag and the length of a length-delimited field, the caller
+// appends the data
+void putLength(vector<uint8_t>& out, int field, uint64_t size)
+{
+    putTag(out, field, WIRE_LENGTH_DELIMITED);
+    putVarint(out, size);
+}
+
+void putBytesField(vector<uint8_t>& out, int field, const vector<uint8_t>& data)
+{
+    putLength(out, field, data.size());
+    out.insert(out.end(), data.begin(), data.end());
+}
+
+void putStringField(vector<uint8_t>& out, int field, const string& value)
+{
+    putBytesField(out, field, vector<uint8_t>(value.begin(), value.end()));
+}
+
+/**
+ * Builds nested protobuf messages where the last field of each one is the
+ * next message, and the innermost message ends with the weights. Everything
+ * but the weights is known up front, so the weights can be streamed to disk
+ * after the header, whatever their size.
+ */
+class NestedMessage
+{
+public:
+    /**
+     * @param payloadSize Size of the innermost message, including the
+     *                    weights.
+     */
+    explicit NestedMessage(uint64_t payloadSize) :
+        size_(payloadSize)
+    {
+    }
+
+    /**
+     * Wraps everything so far in a field of an outer message.
+     * @param fields Fields of the outer message that come before this one.
+     */
+    void wrap(vector<uint8_t> fields, int field)
+    {
+        putLength(fields, field, size_);
+        size_ += fields.size();
+        header_.insert(header_.begin(), fields.begin(), fields.end());
+    }
+
+    const vector<uint8_t>& header() const { return header_; }
+
+private:
+    vector<uint8_t> header_;
+    uint64_t size_;
+};
+
+void writeWeights(OutputFile& file, uint64_t count)
+{
+    // Uniform random weights in [-0.1, 0.1), which compress about as badly
+    // as trained ones
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    vector<float> buffer(WEIGHTS_BUFFER_SIZE / sizeof(float));
+    while(count > 0) {
+        auto n = static_cast<size_t>(std::min<uint64_t>(count, buffer.size()));
+        for(size_t i = 0; i < n; ++i) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            buffer[i] = static_cast<float>(state >> 40) / (1 << 24) * 0.2f - 0.1f;
+        }
+
+        file.write(buffer.data(), n * sizeof(float));
+        count -= n;
+    }
+}
+
+/**
+ * Writes count random float weights, or extends the file over them with a
+ * hole of zeros if sparse.
+ */
+void writeWeights(OutputFile& file, uint64_t count, bool sparse)
+{
+    if(!sparse) {
+        writeWeights(file, count);
+        return;
+    }
+
+    auto fileName = file.fileName();
+    auto size = file.position() + count * sizeof(float);
+    file.close();
+    fs::resize_file(fileName, size);
+}
+
+void writeText(const string& fileName, const string& text)
+{
+    std::ofstream ofs(fileName);
+    ofs << text;
+    ofs.close();
+    DG_CHECK(ofs.good(), "Error writing %s", fileName.c_str());
+}
+
+void writeLabels(const string& fileName, size_t labels)
+{
+    std::ofstream ofs(fileName);
+    for(size_t i = 0; i < labels; ++i) {
+        ofs << "label_" << i << "\n";
+    }
+
+    ofs.close();
+    DG_CHECK(ofs.good(), "Error writing %s", fileName.c_str());
+}
+
+vector<uint8_t> packedDims(const vector<uint64_t>& dims)
+{
+    vector<uint8_t> data;
+    for(auto dim : dims) {
+        putVarint(data, dim);
+    }
+
+    return data;
+}
+
+uint64_t writeCaffe(const string& dir, size_t labels, uint64_t inputSize, size_t height, size_t width, bool sparse)
+{
+    auto prototxt = "name: \"" + string(MODEL_NAME) + "\"\n"
+        "layer {\n"
+        "  name: \"data\"\n"
+        "  type: \"Input\"\n"
+        "  top: \"data\"\n"
+        "  input_param { shape { dim: 1 dim: 3 dim: " + std::to_string(height) + " dim: " + std::to_string(width) + " } }\n"
+        "}\n"
+        "layer {\n"
+        "  name: \"fc\"\n"
+        "  type: \"InnerProduct\"\n"
+        "  bottom: \"data\"\n"
+        "  top: \"fc\"\n"
+        "  inner_product_param { num_output: " + std::to_string(labels) + " bias_term: false }\n"
+        "}\n"
+        "layer {\n"
+        "  name: \"prob\"\n"
+        "  type: \"Softmax\"\n"
+        "  bottom: \"fc\"\n"
+        "  top: \"prob\"\n"
+        "}\n";
+
+    auto prototxtFile = (fs::path(dir) / "deploy.prototxt").string();
+    writeText(prototxtFile, prototxt);
+
+    // NetParameter { name, layer { name, type, blobs { shape, data } } }
+    auto count = static_cast<uint64_t>(labels) * inputSize;
+    auto dataSize = count * sizeof(float);
+
+    vector<uint8_t> blob;
+    {
+        vector<uint8_t> shape;
+        putBytesField(shape, 1, packedDims({ static_cast<uint64_t>(labels), inputSize }));
+        putBytesField(blob, 7, shape);
+    }
+    putLength(blob, 5, dataSize);
+
+    NestedMessage message(dataSize + blob.size());
+
+    vector<uint8_t> layer;
+    putStringField(layer, 1, "fc");
+    putStringField(layer, 2, "InnerProduct");
+    message.wrap(layer, 7); // LayerParameter.blobs
+
+    vector<uint8_t> net;
+    putStringField(net, 1, MODEL_NAME);
+    message.wrap(net, 100); // NetParameter.layer
+
+    auto trainedFile = (fs::path(dir) / "weights.caffemodel").string();
+    OutputFile file(trainedFile);
+    file.write(message.header().data(), message.header().size());
+    file.write(blob.data(), blob.size());
+    writeWeights(file, count, sparse);
+    file.close();
+
+    return prototxt.size() + fs::file_size(trainedFile);
+}
+
+uint64_t writeTensorFlow(const string& dir, size_t labels, uint64_t inputSize, bool sparse)
+{
+    // GraphDef { node input, node output, node weights }, the weights are a
+    // Const node whose tensor_content comes last
+    vector<uint8_t> graph;
+
+    vector<uint8_t> input;
+    putStringField(input, 1, "input");
+    putStringField(input, 2, "Placeholder");
+    {
+        vector<uint8_t> type;
+        putVarintField(type, 6, 1); // DT_FLOAT
+        vector<uint8_t> attr;
+        putStringField(attr, 1, "dtype");
+        putBytesField(attr, 2, type);
+        putBytesField(input, 5, attr);
+    }
+    putBytesField(graph, 1, input);
+
+    vector<uint8_t> output;
+    putStringField(output, 1, "output");
+    putStringField(output, 2, "MatMul");
+    putStringField(output, 3, "input");
+    putStringField(output, 3, "weights");
+    putBytesField(graph, 1, output);
+
+    auto count = static_cast<uint64_t>(labels) * inputSize;
+    auto contentSize = count * sizeof(float);
+
+    // TensorProto { dtype, tensor_shape, tensor_content }
+    vector<uint8_t> tensor;
+    putVarintField(tensor, 1, 1); // DT_FLOAT
+    {
+        vector<uint8_t> shape;
+        for(auto size : { inputSize, static_cast<uint64_t>(labels) }) {
+            vector<uint8_t> dim;
+            putVarintField(dim, 1, size);
+            putBytesField(shape, 2, dim);
+        }
+        putBytesField(tensor, 2, shape);
+    }
+    putLength(tensor, 4, contentSize);
+
+    NestedMessage message(contentSize + tensor.size());
+    message.wrap(vector<uint8_t>(), 8); // AttrValue.tensor
+
+    vector<uint8_t> attrKey;
+    putStringField(attrKey, 1, "value");
+    message.wrap(attrKey, 2); // AttrMapEntry.value
+
+    vector<uint8_t> node;
+    putStringField(node, 1, "weights");
+    putStringField(node, 2, "Const");
+    message.wrap(node, 5); // NodeDef.attr
+
+    message.wrap(graph, 1); // GraphDef.node
+
+    auto modelFile = (fs::path(dir) / "model.pb").string();
+    OutputFile file(modelFile);
+    file.write(message.header().data(), message.header().size());
+    file.write(tensor.data(), tensor.size());
+    writeWeights(file, count, sparse);
+    file.close();
+
+    return fs::file_size(modelFile);
+}
+
+} // namespace
+
+uint64_t maxModelSize(const string& framework)
+{
+    return framework == "caffe" ? MAX_CAFFE_SIZE : std::numeric_limits<uint64_t>::max();
+}
+
+SyntheticModel generateModel(const string& framework, uint64_t size, size_t labels, const string& dir, bool sparse)
+{
+    DG_CHECK(framework == "caffe" || framework == "tensorflow", "Unsupported framework %s", framework.c_str());
+    DG_CHECK(labels > 0, "A model needs at least one label");
+    DG_CHECK(size <= maxModelSize(framework), "%s models can't be larger than %llu bytes", framework.c_str(),
+             (unsigned long long) maxModelSize(framework));
+
+    fs::create_directories(dir);
+
+    // A 3 band square input, fully connected to the labels, sized so that
+    // the weights come close to the requested model size
+    auto inputSize = std::max<uint64_t>(1, size / sizeof(float) / labels);
+    auto side = std::max<size_t>(1, static_cast<size_t>(std::sqrt(inputSize / 3.0)));
+    inputSize = 3 * static_cast<uint64_t>(side) * side;
+
+    SyntheticModel model;
+    model.framework = framework;
+
+    auto labelsFile = (fs::path(dir) / "labels.txt").string();
+    writeLabels(labelsFile, labels);
+
+    if(framework == "caffe") {
+        model.size = writeCaffe(dir, labels, inputSize, side, side, sparse);
+        model.files = {
+            (fs::path(dir) / "deploy.prototxt").string(),
+            (fs::path(dir) / "weights.caffemodel").string()
+        };
+        model.packArgs = {
+            "-t", "caffe",
+            "--caffe-model", model.files[0],
+            "--caffe-trained", model.files[1]
+        };
+    } else {
+        model.size = writeTensorFlow(dir, labels, inputSize, sparse);
+        model.files = { (fs::path(dir) / "model.pb").string() };
+        model.packArgs = {
+            "-t", "tensorflow",
+            "--tensorflow-model", model.files[0],
+            "--model-size", std::to_string(side), std::to_string(side),
+            "--color-mode", "rgb"
+        };
+    }
+
+    auto common = {
+        "--category", "classifier",
+        "--labels", labelsFile.c_str(),
+        "--name", MODEL_NAME,
+        "--version", "1.0",
+        "--description", "Synthetic benchmark model",
+        "--bounding-box", "-180", "-90", "180", "90"
+    };
+    model.packArgs.insert(model.packArgs.end(), common.begin(), common.end());
+
+    return model;
+}
+
+} } // namespace dg { namespace gbdxm {
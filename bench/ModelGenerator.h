@@ -0,0 +1,72 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef DEEPCORE_GBDXM_MODELGENERATOR_H
+#define DEEPCORE_GBDXM_MODELGENERATOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dg { namespace gbdxm {
+
+/**
+ * A synthetic model written to disk, ready to be packed.
+ */
+struct SyntheticModel
+{
+    std::string framework;
+
+    // gbdxm pack arguments describing the model, without the output file
+    std::vector<std::string> packArgs;
+
+    // The model files, which unpack writes back under the same names
+    std::vector<std::string> files;
+
+    // Total size of the model files
+    uint64_t size = 0;
+};
+
+/**
+ * Returns the largest model the framework can load, Caffe weights are
+ * limited to 2 GB by protobuf.
+ */
+uint64_t maxModelSize(const std::string& framework);
+
+/**
+ * Writes a single layer classifier with the given number of labels and about
+ * size bytes of random float weights to dir.
+ *
+ * Caffe models are a deploy.prototxt with an input, an inner product, and a
+ * softmax layer, and a matching weights.caffemodel. TensorFlow models are a
+ * frozen graph with one constant holding the weights. Weights are streamed
+ * to disk, models of any size can be generated.
+ *
+ * @param framework "caffe" or "tensorflow".
+ * @param size Approximate size of the model files in bytes.
+ * @param labels Number of labels.
+ * @param dir Output directory, created if it doesn't exist.
+ * @param sparse Leave the weights all zero as a hole in a sparse file
+ *               instead, which takes next to no time or disk space, e.g. to
+ *               pack models over 4 GB.
+ */
+SyntheticModel generateModel(const std::string& framework, uint64_t size, size_t labels, const std::string& dir,
+                             bool sparse = false);
+
+} } // namespace dg { namespace gbdxm {
+
+#endif // DEEPCORE_GBDXM_MODELGENERATOR_H
@@ -0,0 +1,536 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "FileIO.h"
+#include "ModelGenerator.h"
+
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <json/json.h>
+#include <numeric>
+#include <random>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <utility/Error.h>
+#include <utility/Logging.h>
+
+namespace dg { namespace gbdxm {
+
+namespace fs = boost::filesystem;
+namespace po = boost::program_options;
+
+using namespace dg::deepcore;
+
+using std::string;
+using std::vector;
+
+struct BenchArgs
+{
+    string gbdxm;
+    string workDir;
+    vector<string> frameworks;
+    vector<uint64_t> sizes;
+    vector<size_t> labels;
+    vector<string> modes;
+    vector<string> ioEngines;
+    vector<string> packArgs;
+    size_t repeat = 3;
+    size_t startupRepeat = 20;
+    string outputFile;
+    bool sparse = false;
+    bool check = false;
+    bool keep = false;
+};
+
+struct Run
+{
+    double seconds = 0;
+    uint64_t peakRss = 0;
+};
+
+uint64_t parseSize(const string& text)
+{
+    size_t end = 0;
+    auto value = std::stod(text, &end);
+    auto suffix = boost::algorithm::to_upper_copy(text.substr(end));
+
+    uint64_t scale = 1;
+    if(suffix == "K" || suffix == "KB") {
+        scale = 1ull << 10;
+    } else if(suffix == "M" || suffix == "MB") {
+        scale = 1ull << 20;
+    } else if(suffix == "G" || suffix == "GB") {
+        scale = 1ull << 30;
+    } else {
+        DG_CHECK(suffix.empty() || suffix == "B", "Invalid size '%s'", text.c_str());
+    }
+
+    return static_cast<uint64_t>(value * scale);
+}
+
+vector<string> splitList(const string& text)
+{
+    vector<string> ret;
+    boost::algorithm::split(ret, text, boost::algorithm::is_any_of(","), boost::algorithm::token_compress_on);
+    ret.erase(std::remove(ret.begin(), ret.end(), string()), ret.end());
+    return ret;
+}
+
+BenchArgs parseArgs(int argc, const char* const* argv)
+{
+    po::options_description desc(
+        "GBDXM Benchmark\n\n"
+        "Packs synthetic Caffe and TensorFlow models of the given sizes and label counts with gbdxm, "
+        "then shows, unpacks, and verifies them, and prints the latency, throughput, and peak memory use "
+        "of each action as JSON.\n\n"
+        "Usage: gbdxm_bench [options]\n\n"
+        "Options");
+
+    desc.add_options()
+        ("help,h", "Show this help message.")
+        ("gbdxm", po::value<string>()->value_name("PATH"),
+            "gbdxm executable to benchmark. Default is the gbdxm next to gbdxm_bench.")
+        ("work-dir", po::value<string>()->value_name("PATH"),
+            "Directory for the generated models and packages. Default is a new temporary directory.")
+        ("frameworks", po::value<string>()->value_name("LIST")->default_value("caffe,tensorflow"),
+            "Frameworks to generate models for: caffe, tensorflow.")
+        ("sizes", po::value<string>()->value_name("LIST")->default_value("10M,100M,1G"),
+            "Model sizes, e.g. 10M,100M,1G,8G. Caffe models are limited to 2G.")
+        ("labels", po::value<string>()->value_name("LIST")->default_value("10,1000,100000"),
+            "Label counts.")
+        ("modes", po::value<string>()->value_name("LIST")->default_value("plaintext,encrypted"),
+            "Package modes: plaintext, encrypted.")
+        ("io-engines", po::value<string>()->value_name("LIST")->default_value("sync"),
+            "gbdxm --io-engine of every action: sync, uring. sync,uring compares the two.")
+        ("pack-args", po::value<string>()->value_name("ARGS"),
+            "Extra pack arguments, e.g. \"--stream --threads 0\".")
+        ("repeat", po::value<size_t>()->value_name("N")->default_value(3), "Number of times to run each action.")
+        ("startup-repeat", po::value<size_t>()->value_name("N")->default_value(20),
+            "Number of times to run each action on a tiny package to measure startup time, 0 to skip.")
+        ("sparse", "Generate models with all zero weights as sparse files, which take next to no time or disk space, "
+            "e.g. --sizes 5G --sparse to benchmark Zip64 packages.")
+        ("check", "Compare the unpacked model files with the generated ones after every unpack, and fail if they "
+            "differ.")
+        ("output,o", po::value<string>()->value_name("PATH"), "Write the JSON report to a file instead of standard output.")
+        ("keep", "Keep the generated models and packages.");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if(vm.count("help")) {
+        std::cout << desc << std::endl;
+        exit(0);
+    }
+
+    BenchArgs args;
+    args.gbdxm = vm.count("gbdxm") ? vm["gbdxm"].as<string>()
+                                   : (fs::absolute(argv[0]).parent_path() / "gbdxm").string();
+    DG_CHECK(fs::exists(args.gbdxm), "gbdxm executable not found at %s, use --gbdxm", args.gbdxm.c_str());
+
+    args.workDir = vm.count("work-dir") ? vm["work-dir"].as<string>()
+                                        : (fs::temp_directory_path() / fs::unique_path("gbdxm_bench-%%%%%%%%")).string();
+
+    args.frameworks = splitList(vm["frameworks"].as<string>());
+    for(const auto& framework : args.frameworks) {
+        DG_CHECK(framework == "caffe" || framework == "tensorflow", "Unsupported framework '%s'", framework.c_str());
+    }
+
+    for(const auto& size : splitList(vm["sizes"].as<string>())) {
+        args.sizes.push_back(parseSize(size));
+    }
+
+    for(const auto& labels : splitList(vm["labels"].as<string>())) {
+        args.labels.push_back(std::stoul(labels));
+    }
+
+    args.modes = splitList(vm["modes"].as<string>());
+    for(const auto& mode : args.modes) {
+        DG_CHECK(mode == "plaintext" || mode == "encrypted", "Unsupported mode '%s'", mode.c_str());
+    }
+
+    args.ioEngines = splitList(vm["io-engines"].as<string>());
+    for(const auto& engine : args.ioEngines) {
+        DG_CHECK(engine == "sync" || engine == "uring", "Unsupported I/O engine '%s'", engine.c_str());
+    }
+
+    if(vm.count("pack-args")) {
+        auto packArgs = boost::algorithm::trim_copy(vm["pack-args"].as<string>());
+        if(!packArgs.empty()) {
+            boost::algorithm::split(args.packArgs, packArgs, boost::algorithm::is_space(),
+                                    boost::algorithm::token_compress_on);
+        }
+    }
+
+    args.repeat = std::max<size_t>(1, vm["repeat"].as<size_t>());
+    args.startupRepeat = vm["startup-repeat"].as<size_t>();
+
+    if(vm.count("output")) {
+        args.outputFile = vm["output"].as<string>();
+    }
+
+    args.sparse = vm.count("sparse") > 0;
+    args.check = vm.count("check") > 0;
+    args.keep = vm.count("keep") > 0;
+
+    return args;
+}
+
+/**
+ * Runs gbdxm in a child process with its standard output discarded.
+ * @return Wall clock time and peak resident set size of the child.
+ */
+Run runGbdxm(const string& gbdxm, const vector<string>& args)
+{
+    vector<const char*> argv;
+    argv.push_back(gbdxm.c_str());
+    for(const auto& arg : args) {
+        argv.push_back(arg.c_str());
+    }
+    argv.push_back(nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+
+    auto pid = fork();
+    DG_CHECK(pid >= 0, "Error starting %s: %s", gbdxm.c_str(), strerror(errno));
+    if(pid == 0) {
+        auto devNull = open("/dev/null", O_WRONLY);
+        if(devNull >= 0) {
+            dup2(devNull, STDOUT_FILENO);
+            close(devNull);
+        }
+
+        execv(gbdxm.c_str(), const_cast<char* const*>(argv.data()));
+        _exit(127);
+    }
+
+    int status = 0;
+    struct rusage usage;
+    DG_CHECK(wait4(pid, &status, 0, &usage) == pid, "Error waiting for %s: %s", gbdxm.c_str(), strerror(errno));
+
+    Run run;
+    run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // ru_maxrss is in kilobytes on Linux
+    run.peakRss = static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+
+    DG_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0, "gbdxm %s failed",
+             boost::algorithm::join(args, " ").c_str());
+
+    return run;
+}
+
+Json::Value summarize(const string& action, vector<Run>& runs, uint64_t bytes)
+{
+    std::sort(runs.begin(), runs.end(), [](const Run& a, const Run& b) {
+        return a.seconds < b.seconds;
+    });
+
+    auto total = std::accumulate(runs.begin(), runs.end(), 0.0, [](double sum, const Run& run) {
+        return sum + run.seconds;
+    });
+
+    auto median = runs.size() % 2 ? runs[runs.size() / 2].seconds
+                                  : (runs[runs.size() / 2 - 1].seconds + runs[runs.size() / 2].seconds) / 2;
+
+    Json::Value result;
+    result["action"] = action;
+    result["runs"] = Json::UInt64(runs.size());
+    result["latency"]["min"] = runs.front().seconds;
+    result["latency"]["median"] = median;
+    result["latency"]["mean"] = total / runs.size();
+    result["latency"]["max"] = runs.back().seconds;
+
+    // Throughput is of the model data, based on the median latency
+    if(bytes > 0 && median > 0) {
+        result["throughput"] = bytes / median;
+    } else {
+        result["throughput"] = Json::Value();
+    }
+
+    uint64_t peakRss = 0;
+    for(const auto& run : runs) {
+        peakRss = std::max(peakRss, run.peakRss);
+    }
+    result["peakRss"] = Json::UInt64(peakRss);
+
+    return result;
+}
+
+/**
+ * Compares each model file with the file of the same name unpacked to
+ * outputDir, and throws at the first difference.
+ */
+void checkUnpacked(const SyntheticModel& model, const string& outputDir)
+{
+    const size_t bufferSize = 8 << 20;
+    vector<uint8_t> expected(bufferSize);
+    vector<uint8_t> actual(bufferSize);
+
+    for(const auto& fileName : model.files) {
+        auto unpackedName = (fs::path(outputDir) / fs::path(fileName).filename()).string();
+        DG_CHECK(fs::exists(unpackedName), "%s was not unpacked", unpackedName.c_str());
+
+        InputFile original(fileName);
+        InputFile unpacked(unpackedName);
+        DG_CHECK(original.size() == unpacked.size(), "%s is %llu bytes, %s is %llu", unpackedName.c_str(),
+                 (unsigned long long) unpacked.size(), fileName.c_str(), (unsigned long long) original.size());
+
+        for(uint64_t offset = 0; offset < original.size(); offset += bufferSize) {
+            auto count = static_cast<size_t>(std::min<uint64_t>(bufferSize, original.size() - offset));
+            original.readAt(offset, expected.data(), count);
+            unpacked.readAt(offset, actual.data(), count);
+            DG_CHECK(memcmp(expected.data(), actual.data(), count) == 0, "%s differs from %s near offset %llu",
+                     unpackedName.c_str(), fileName.c_str(), (unsigned long long) offset);
+        }
+    }
+}
+
+void writeKey(const string& fileName)
+{
+    std::random_device random;
+    std::ofstream ofs(fileName);
+    for(int i = 0; i < 64; ++i) {
+        ofs << "0123456789abcdef"[random() & 0xf];
+    }
+
+    ofs << std::endl;
+    ofs.close();
+    DG_CHECK(ofs.good(), "Error writing %s", fileName.c_str());
+}
+
+Json::Value benchmark(const BenchArgs& args, const SyntheticModel& model, size_t labels, const string& mode,
+                      const string& ioEngine)
+{
+    auto packageFile = (fs::path(args.workDir) / "package.gbdxm").string();
+    auto outputDir = (fs::path(args.workDir) / "unpacked").string();
+
+    vector<string> keyArgs;
+    if(mode == "encrypted") {
+        auto keyFile = (fs::path(args.workDir) / "key.hex").string();
+        writeKey(keyFile);
+        keyArgs = { "--key-file", keyFile };
+    }
+
+    auto packArgs = vector<string> { "pack" };
+    packArgs.insert(packArgs.end(), model.packArgs.begin(), model.packArgs.end());
+    if(mode == "plaintext") {
+        packArgs.push_back("--plaintext");
+    }
+    packArgs.insert(packArgs.end(), keyArgs.begin(), keyArgs.end());
+    packArgs.insert(packArgs.end(), args.packArgs.begin(), args.packArgs.end());
+    packArgs.insert(packArgs.end(), { "--io-engine", ioEngine, "-f", packageFile });
+
+    auto readArgs = [&keyArgs, &packageFile, &ioEngine](vector<string> command) {
+        command.insert(command.end(), keyArgs.begin(), keyArgs.end());
+        command.insert(command.end(), { "--io-engine", ioEngine, "-f", packageFile });
+        return command;
+    };
+
+    struct Action
+    {
+        string name;
+        vector<string> command;
+        uint64_t bytes;
+    };
+
+    vector<Action> actions = {
+        { "pack", packArgs, model.size },
+        { "show", { "show", "--io-engine", ioEngine, "-f", packageFile }, 0 },
+        { "unpack", readArgs({ "unpack", "-o", outputDir }), model.size },
+        { "verify", readArgs({ "verify" }), model.size }
+    };
+
+    Json::Value results(Json::arrayValue);
+    for(const auto& action : actions) {
+        vector<Run> runs;
+        for(size_t i = 0; i < args.repeat; ++i) {
+            // Every run starts from scratch
+            if(action.name == "pack") {
+                fs::remove(packageFile);
+            } else if(action.name == "unpack") {
+                fs::remove_all(outputDir);
+            }
+
+            runs.push_back(runGbdxm(args.gbdxm, action.command));
+
+            if(args.check && action.name == "unpack") {
+                checkUnpacked(model, outputDir);
+            }
+        }
+
+        auto result = summarize(action.name, runs, action.bytes);
+        result["framework"] = model.framework;
+        result["mode"] = mode;
+        result["ioEngine"] = ioEngine;
+        result["modelSize"] = Json::UInt64(model.size);
+        result["labels"] = Json::UInt64(labels);
+        result["packageSize"] = Json::UInt64(fs::file_size(packageFile));
+
+        DG_LOG(gbdxm, info) << model.framework << " " << mode << " " << ioEngine << " " << model.size << " bytes, " << labels
+                            << " labels: " << action.name << " " << result["latency"]["median"].asDouble() << " s";
+        results.append(result);
+    }
+
+    fs::remove(packageFile);
+    fs::remove_all(outputDir);
+
+    return results;
+}
+
+/**
+ * Measures how long gbdxm takes to start and exit by running actions on a
+ * tiny streaming package, where there is next to no work to do. help
+ * initializes every model framework, show and verify don't need them.
+ */
+Json::Value measureStartup(const BenchArgs& args)
+{
+    auto modelDir = (fs::path(args.workDir) / "startup").string();
+    auto packageFile = (fs::path(args.workDir) / "startup.gbdxm").string();
+
+    DG_LOG(gbdxm, info) << "Measuring startup time";
+    auto model = generateModel(args.frameworks.front(), 64 << 10, 10, modelDir);
+
+    auto packArgs = vector<string> { "pack" };
+    packArgs.insert(packArgs.end(), model.packArgs.begin(), model.packArgs.end());
+    packArgs.insert(packArgs.end(), { "--plaintext", "--stream", "-f", packageFile });
+
+    // Pack goes first, the others read its package
+    vector<std::pair<string, vector<string>>> actions = {
+        { "pack", packArgs },
+        { "help", { "help" } },
+        { "show", { "show", "--fields", "name", "-f", packageFile } },
+        { "verify", { "verify", "-f", packageFile } }
+    };
+
+    Json::Value results(Json::arrayValue);
+    for(const auto& action : actions) {
+        vector<Run> runs;
+        for(size_t i = 0; i < args.startupRepeat; ++i) {
+            if(action.first == "pack") {
+                fs::remove(packageFile);
+            }
+
+            runs.push_back(runGbdxm(args.gbdxm, action.second));
+        }
+
+        auto result = summarize(action.first, runs, 0);
+        result.removeMember("throughput");
+
+        DG_LOG(gbdxm, info) << "Startup: " << action.first << " " << result["latency"]["median"].asDouble() << " s";
+        results.append(result);
+    }
+
+    fs::remove(packageFile);
+    fs::remove_all(modelDir);
+
+    return results;
+}
+
+void runBenchmarks(const BenchArgs& args)
+{
+    fs::create_directories(args.workDir);
+    DG_LOG(gbdxm, info) << "Benchmarking " << args.gbdxm << " in " << args.workDir;
+
+    Json::Value report;
+    report["gbdxm"] = args.gbdxm;
+    report["cpus"] = std::thread::hardware_concurrency();
+    report["repeat"] = Json::UInt64(args.repeat);
+    report["sparse"] = args.sparse;
+    report["checked"] = args.check;
+    report["packArgs"] = Json::Value(Json::arrayValue);
+    for(const auto& arg : args.packArgs) {
+        report["packArgs"].append(arg);
+    }
+
+    if(args.startupRepeat > 0) {
+        report["startup"] = measureStartup(args);
+    }
+
+    auto& results = report["results"];
+    results = Json::Value(Json::arrayValue);
+
+    for(const auto& framework : args.frameworks) {
+        for(auto size : args.sizes) {
+            if(size > maxModelSize(framework)) {
+                DG_LOG(gbdxm, warning) << "Skipping " << size << " byte " << framework << " models, "
+                                       << framework << " can't load models that large";
+                continue;
+            }
+
+            for(auto labels : args.labels) {
+                auto modelDir = (fs::path(args.workDir) / "model").string();
+                DG_LOG(gbdxm, info) << "Generating a " << size << " byte " << framework << " model with "
+                                    << labels << " labels";
+                auto model = generateModel(framework, size, labels, modelDir, args.sparse);
+
+                for(const auto& mode : args.modes) {
+                    for(const auto& ioEngine : args.ioEngines) {
+                        for(const auto& result : benchmark(args, model, labels, mode, ioEngine)) {
+                            results.append(result);
+                        }
+                    }
+                }
+
+                fs::remove_all(modelDir);
+            }
+        }
+    }
+
+    auto json = Json::StyledWriter().write(report);
+    if(args.outputFile.empty()) {
+        std::cout << json;
+    } else {
+        std::ofstream ofs(args.outputFile);
+        ofs << json;
+        ofs.close();
+        DG_CHECK(ofs.good(), "Error writing %s", args.outputFile.c_str());
+    }
+
+    if(!args.keep) {
+        fs::remove_all(args.workDir);
+    }
+}
+
+} } // namespace dg { namespace gbdxm {
+
+int main(int argc, const char* const* argv)
+{
+    using namespace dg::gbdxm;
+
+    try {
+        log::init();
+        log::addCerrSink(level_t::info, level_t::fatal, log::dg_log_format::dg_short_log);
+
+        runBenchmarks(parseArgs(argc, argv));
+    } catch(...) {
+        DG_ERROR_LOG(gbdxm, DG_ERROR_FROM_CURRENT(""));
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,174 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "BlobCache.h"
+
+#include "ByteOrder.h"
+#include "Crypto.h"
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <functional>
+#include <thread>
+#include <unistd.h>
+#include <utility/Error.h>
+#include <utility/Logging.h>
+
+namespace dg { namespace gbdxm {
+
+namespace fs = boost::filesystem;
+
+using std::string;
+using std::vector;
+
+namespace {
+
+const uint32_t BLOB_MAGIC = 0x43424447; // "GDBC"
+const uint16_t BLOB_VERSION = 1;
+const size_t BLOB_HEADER_SIZE = 30;
+
+} // namespace
+
+BlobCache::BlobCache(const string& directory) :
+    directory_(directory)
+{
+    if(!fs::is_directory(directory_)) {
+        DG_CHECK(!fs::exists(directory_), "Could not create cache directory at %s, already a file.", directory_.c_str());
+        fs::create_directories(directory_);
+    }
+}
+
+string BlobCache::key(const string& name, const MappedFile& file, const EntryOptions& options) const
+{
+    // Hash the file a chunk at a time, dropping the pages as we go so that
+    // hashing doesn't pull the whole file into memory
+    Sha256 content;
+    file.adviseSequential();
+    for(size_t offset = 0; offset < file.size(); offset += options.chunkSize) {
+        auto count = std::min(options.chunkSize, file.size() - offset);
+        content.update(file.data() + offset, count);
+        file.release(offset, count);
+    }
+
+    vector<uint8_t> params;
+    put32(params, BLOB_MAGIC);
+    params.push_back(BLOB_VERSION);
+    params.push_back(ENTRY_LAYOUT_VERSION);
+    params.push_back(static_cast<uint8_t>(options.codec));
+    put32(params, static_cast<uint32_t>(options.level));
+    put64(params, options.chunkSize);
+    put32(params, static_cast<uint32_t>(name.size()));
+    params.insert(params.end(), name.begin(), name.end());
+
+    // Encrypted and plaintext entries never share a key, and neither do
+    // entries encrypted with different keys
+    params.push_back(options.key ? 1 : 0);
+    if(options.key) {
+        Sha256 keyHash;
+        keyHash.update(options.key->data(), KEY_SIZE);
+        auto digest = keyHash.final();
+        params.insert(params.end(), digest.begin(), digest.end());
+    }
+
+    auto digest = content.final();
+    params.insert(params.end(), digest.begin(), digest.end());
+
+    Sha256 key;
+    key.update(params.data(), params.size());
+    return toHex(key.final());
+}
+
+bool BlobCache::copyTo(const string& key, const string& name, ZipWriter& zip) const
+{
+    auto fileName = blobPath(key);
+    if(!fs::exists(fileName)) {
+        return false;
+    }
+
+    InputFile file(fileName);
+    auto fileSize = file.size();
+
+    uint8_t header[BLOB_HEADER_SIZE];
+    if(fileSize < BLOB_HEADER_SIZE) {
+        DG_LOG(gbdxm, warning) << "Ignoring invalid cache blob " << fileName;
+        return false;
+    }
+
+    file.readAt(0, header, sizeof(header));
+    auto method = get16(header + 6);
+    auto crc = get32(header + 8);
+    auto size = get64(header + 12);
+    auto compressedSize = get64(header + 20);
+    auto extraSize = get16(header + 28);
+    if(get32(header) != BLOB_MAGIC || get16(header + 4) != BLOB_VERSION
+       || fileSize != BLOB_HEADER_SIZE + extraSize + compressedSize) {
+        DG_LOG(gbdxm, warning) << "Ignoring invalid cache blob " << fileName;
+        return false;
+    }
+
+    vector<uint8_t> extra(extraSize);
+    file.readAt(BLOB_HEADER_SIZE, extra.data(), extra.size());
+
+    zip.beginEntry(name, method, extra, compressedSize >= ZIP64_LIMIT || size >= ZIP64_LIMIT);
+    zip.copyFrom(file, BLOB_HEADER_SIZE + extraSize, compressedSize);
+    zip.endEntry(crc, size, extra);
+
+    return true;
+}
+
+void BlobCache::store(const string& key, const ZipWriter& zip) const
+{
+    const auto& entry = zip.lastEntry();
+    auto fileName = blobPath(key);
+    auto tempName = fileName + ".tmp" + std::to_string(getpid()) + "-"
+                    + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+    try {
+        vector<uint8_t> header;
+        put32(header, BLOB_MAGIC);
+        put16(header, BLOB_VERSION);
+        put16(header, entry.method);
+        put32(header, entry.crc);
+        put64(header, entry.size);
+        put64(header, entry.compressedSize);
+        put16(header, static_cast<uint16_t>(entry.extra.size()));
+        header.insert(header.end(), entry.extra.begin(), entry.extra.end());
+
+        OutputFile out(tempName);
+        out.write(header.data(), header.size());
+
+        // The archive is still being written, read the entry data back
+        // through a separate descriptor
+        InputFile archive(zip.fileName());
+        out.copyFrom(archive, zip.dataOffset(), entry.compressedSize);
+
+        out.close();
+        fs::rename(tempName, fileName);
+    } catch(const std::exception& e) {
+        DG_LOG(gbdxm, warning) << "Error caching " << entry.name << " in " << directory_ << ": " << e.what();
+
+        boost::system::error_code ec;
+        fs::remove(tempName, ec);
+    }
+}
+
+string BlobCache::blobPath(const string& key) const
+{
+    return fs::path(directory_).append(key + ".blob").string();
+}
+
+} } // namespace dg { namespace gbdxm {
@@ -0,0 +1,75 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef DEEPCORE_GBDXM_BLOBCACHE_H
+#define DEEPCORE_GBDXM_BLOBCACHE_H
+
+#include "EntryCodec.h"
+#include "FileIO.h"
+#include "ZipArchive.h"
+
+#include <string>
+
+namespace dg { namespace gbdxm {
+
+/**
+ * On-disk cache of finished zip entry data, keyed by the content of the input
+ * file and everything that affects how it is encoded. Packing the same model
+ * file again with the same settings copies the compressed and encrypted data
+ * from the cache instead of encoding it again.
+ *
+ * Each blob is stored in its own file named after its key. Blobs are written
+ * to a temporary file and renamed, so concurrent packs can share a cache.
+ */
+class BlobCache
+{
+public:
+    /**
+     * @param directory Cache directory, created if it doesn't exist.
+     */
+    explicit BlobCache(const std::string& directory);
+
+    const std::string& directory() const { return directory_; }
+
+    /**
+     * Builds the cache key of an entry from its name, the SHA-256 of the file
+     * content, and the encoding options. The encryption key itself is only
+     * included as a hash.
+     */
+    std::string key(const std::string& name, const MappedFile& file, const EntryOptions& options) const;
+
+    /**
+     * Writes the cached blob to the archive as a new entry.
+     * @return false if there is no valid blob with this key.
+     */
+    bool copyTo(const std::string& key, const std::string& name, ZipWriter& zip) const;
+
+    /**
+     * Stores the last entry written to the archive. Errors are logged and
+     * otherwise ignored, a failed store only means a later cache miss.
+     */
+    void store(const std::string& key, const ZipWriter& zip) const;
+
+private:
+    std::string blobPath(const std::string& key) const;
+
+    std::string directory_;
+};
+
+} } // namespace dg { namespace gbdxm {
+
+#endif // DEEPCORE_GBDXM_BLOBCACHE_H
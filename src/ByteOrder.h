@@ -0,0 +1,63 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef DEEPCORE_GBDXM_BYTEORDER_H
+#define DEEPCORE_GBDXM_BYTEORDER_H
+
+#include <cstdint>
+#include <vector>
+
+namespace dg { namespace gbdxm {
+
+// Little endian helpers for the zip and package formats
+
+inline void put16(std::vector<uint8_t>& out, uint16_t value)
+{
+    out.push_back(static_cast<uint8_t>(value));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+inline void put32(std::vector<uint8_t>& out, uint32_t value)
+{
+    put16(out, static_cast<uint16_t>(value));
+    put16(out, static_cast<uint16_t>(value >> 16));
+}
+
+inline void put64(std::vector<uint8_t>& out, uint64_t value)
+{
+    put32(out, static_cast<uint32_t>(value));
+    put32(out, static_cast<uint32_t>(value >> 32));
+}
+
+inline uint16_t get16(const uint8_t* data)
+{
+    return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+inline uint32_t get32(const uint8_t* data)
+{
+    return get16(data) | (static_cast<uint32_t>(get16(data + 2)) << 16);
+}
+
+inline uint64_t get64(const uint8_t* data)
+{
+    return get32(data) | (static_cast<uint64_t>(get32(data + 4)) << 32);
+}
+
+} } // namespace dg { namespace gbdxm {
+
+#endif // DEEPCORE_GBDXM_BYTEORDER_H
@@ -0,0 +1,1223 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "CommandLine.h"
+
+#include "StreamingModelReader.h"
+
+#include <gbdxmVersion.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/make_unique.hpp>
+#include <boost/program_options.hpp>
+#include <boost/range/adaptor/map.hpp>
+#include <cctype>
+#include <cstdlib>
+#include <geometry/cv_program_options.hpp>
+#include <json/json.h>
+#include <limits>
+#include <DeepCoreVersion.h>
+#include <classification/Classification.h>
+#include <classification/GbdxmCommon.h>
+#include <classification/ModelMetadataJson.h>
+#include <sstream>
+#include <utility/File.h>
+#include <utility/Error.h>
+#include <utility/Logging.h>
+
+namespace po = boost::program_options;
+
+using namespace dg::deepcore;
+
+using boost::adaptors::keys;
+using boost::algorithm::join;
+using boost::algorithm::to_lower;
+using boost::algorithm::to_lower_copy;
+using boost::filesystem::exists;
+using boost::filesystem::file_size;
+using boost::filesystem::is_directory;
+using boost::make_unique;
+using boost::posix_time::from_iso_string;
+using boost::posix_time::to_time_t;
+using std::cout;
+using std::endl;
+using std::find;
+using std::find_if;
+using std::ifstream;
+using std::map;
+using std::move;
+using std::remove_if;
+using std::string;
+using std::stringstream;
+using std::unique_ptr;
+using std::vector;
+
+namespace dg { namespace gbdxm {
+
+// Forward declarations
+
+bool needsFrameworks(const string& action);
+po::detail::cmdline::style_parser buildExtraStyleParser(bool frameworks);
+po::options_description buildHelpOptions();
+po::options_description buildParseOptions(bool frameworks);
+void addShowOptions(po::options_description& desc);
+void addPackOptions(po::options_description& desc, bool helpOptions);
+boost::shared_ptr<po::option_description> createFrameworkOption(classification::ItemDescription item, const char* type, const char* name, const char* ending);
+void addPackFrameworkOptions(po::options_description& desc, bool includeCategory);
+void addUpdateOptions(po::options_description& desc);
+void addUnpackOptions(po::options_description& desc);
+
+void readCommonArgs(const po::variables_map& vm, const string& action, GbdxmArgs& args);
+void readStatsArgs(const po::variables_map& vm, const string& action, GbdxmArgs& args);
+unique_ptr<GbdxmArgs> readShowArgs(const po::variables_map& vm);
+unique_ptr<GbdxmPackArgs> readPackArgs(const po::variables_map& vm, map<string, vector<uint8_t>> modelData = {});
+void readMetadataArgs(const po::variables_map& vm, classification::ModelMetadata& metadata, string& labelsFile,
+                      vector<string>& missingFields, vector<string>& errors);
+vector<string> readJsonMetadata(const string& fileName, GbdxmPackArgs& args);
+void readModelMetadata(GbdxmPackArgs& args, vector<string>& missingFields,
+                       std::unique_lock<std::recursive_mutex>& lock);
+unique_ptr<GbdxmArgs> readUnpackArgs(const po::variables_map& vm);
+unique_ptr<GbdxmArgs> readUpdateArgs(const po::variables_map& vm);
+unique_ptr<GbdxmArgs> readBatchArgs(const po::variables_map& vm);
+unique_ptr<GbdxmArgs> readVerifyArgs(const po::variables_map& vm);
+unique_ptr<GbdxmArgs> readDeltaArgs(const po::variables_map& vm);
+unique_ptr<GbdxmArgs> readPatchArgs(const po::variables_map& vm);
+void tryErase(vector<string>& names, const string& name);
+bool parseByteSize(const string& text, uint64_t& size);
+
+bool needsFrameworks(const string& action)
+{
+    // The framework options of pack and update are only known once the
+    // frameworks are initialized. The other actions only read packages.
+    return action != "show" && action != "unpack" && action != "verify" && action != "batch" && action != "delta" &&
+           action != "patch";
+}
+
+void printHelp()
+{
+    initFrameworks();
+    cout << buildHelpOptions() << endl;
+}
+
+po::detail::cmdline::style_parser buildExtraStyleParser(bool frameworks)
+{
+    vector<po::detail::cmdline::style_parser> parsers;
+
+    parsers.emplace_back(&po::ignore_numbers);
+
+    if(frameworks) {
+        for(const auto& type : classification::ModelIdentifier::types()) {
+            parsers.emplace_back(po::prefix_argument(type));
+        }
+    }
+
+    return po::combine_style_parsers(parsers);
+}
+
+po::options_description buildHelpOptions()
+{
+    stringstream ss;
+    ss <<
+        "GDBX Model Packaging Tool\n"
+        "Version: " GBDXM_VERSION_STRING "\n"
+        "Built on DeepCore version: " DEEPCORE_VERSION_STRING "\n"
+        "GBDXM Metadata Version: " << classification::gbdxm::METADATA_VERSION << "\n\n"
+        "Usage: gbdxm <action> [options] [gbdxm file]\n\n"
+        "Actions:\n"
+        "  help  \t\t Show this help message.\n"
+        "  show  \t\t Show package metadata.\n"
+        "  pack  \t\t Pack a model into a GBDX package.\n"
+        "  update\t\t Change the metadata of a GBDX package in place, using the same metadata options as pack.\n"
+        "        \t\t Model files are left as they are.\n"
+        "  verify\t\t Check every item of a GBDX package against the checksums in its metadata, verifying\n"
+        "        \t\t items on all CPU cores unless --threads says otherwise.\n"
+        "  delta \t\t Write the changes between two versions of a streaming package to a patch file, as in\n"
+        "        \t\t \"gbdxm delta OLD NEW -o PATCH\". Items are compared decrypted and decompressed.\n"
+        "  patch \t\t Rebuild the new version of a package from the old one and a patch, as in\n"
+        "        \t\t \"gbdxm patch OLD PATCH -o NEW\". Every item is checked against its SHA-256.\n"
+        "  batch \t\t Run the show, pack, unpack, and verify commands listed in a manifest file, one command per\n"
+        "        \t\t line, e.g. \"pack -t caffe ... model.gbdxm\". Empty lines and lines starting with '#'\n"
+        "        \t\t are skipped. Unpacking and verifying packages not written by a streaming pack goes through\n"
+        "        \t\t DeepCore one job at a time.\n\n"
+        "General Options";
+
+    po::options_description desc(
+        ss.str()
+    );
+
+    desc.add_options()
+        ("verbose,v", "Verbose output.")
+        ("gbdxm-file,f", po::value<string>()->value_name("PATH"),
+            "Input or output GBDXM file, - for standard output with pack and standard input with unpack.")
+        ("key-file", po::value<string>()->value_name("PATH"),
+            "Encryption key for streaming packages: a file with 32 raw bytes or 64 hexadecimal digits. "
+            "Packing with it encrypts model files with AES-256-GCM in gbdxm's own chunked layout instead of "
+            "DeepCore's encryption, which GbdxModelReader and DeepCore loaders can't read. The key is never "
+            "written to the package, the same key file must be given to unpack, verify, delta, and patch it. "
+            "metadata.json is never encrypted.")
+        ("threads", po::value<size_t>()->value_name("N"),
+            "Number of threads to compress, encrypt, and decrypt model files with, or the number of jobs to run "
+            "at once in batch mode. 0 uses all CPU cores, which is the default in batch mode. Implies --stream "
+            "when packing with --plaintext or --key-file, and has no effect on packages encrypted by DeepCore.")
+        ("io-engine", po::value<string>()->value_name("ENGINE"),
+            "How model files are read and packages and unpacked files are written: sync, the default, for one "
+            "blocking read or write at a time, or uring for several in flight with io_uring and output files "
+            "preallocated. Falls back to sync on kernels without io_uring.")
+        ("stats", "Print a JSON report of the time spent and bytes processed in each phase of the action, and the "
+            "peak memory usage, after the action's output.")
+        ("stats-file", po::value<string>()->value_name("PATH"), "Write the --stats report to a file instead.");
+
+    addShowOptions(desc);
+    addPackOptions(desc, true);
+    addUpdateOptions(desc);
+
+    return desc;
+}
+
+po::options_description buildParseOptions(bool frameworks)
+{
+    po::options_description desc;
+    desc.add_options()
+        ("verbose,v", "Verbose output.")
+        ("gbdxm-file,f", po::value<string>(), "Input or output GBDXM file.")
+        ("key-file", po::value<string>(), "Encryption key file.")
+        ("threads", po::value<size_t>(), "Number of threads.")
+        ("io-engine", po::value<string>(), "I/O engine.")
+        ("stats", "Print a statistics report.")
+        ("stats-file", po::value<string>(), "Statistics report file.")
+        ("plaintext", "Don't encrypt the model.")
+        ("image-type,i", po::value<string>(), "Image type. e.g. jpg (deprecated).")
+        ("category,C", po::value<string>(), "Model category")
+        ("input-file", po::value<vector<string>>(), "Second package of delta and patch.");
+
+    addShowOptions(desc);
+    if(frameworks) {
+        addPackOptions(desc, false);
+    }
+    addUpdateOptions(desc);
+    addUnpackOptions(desc); // Hidden activity, options not in help
+
+    return desc;
+}
+
+po::variables_map parseCommandLine(const vector<string>& args, const string& action)
+{
+    bool frameworks = needsFrameworks(action);
+    if(frameworks) {
+        initFrameworks();
+    }
+
+    // Building the options enumerates every model type, do it only once
+    // for all the jobs in a batch. Actions that only read packages get by
+    // without the pack options, and without initializing the frameworks.
+    struct Parser
+    {
+        po::options_description desc;
+        po::detail::cmdline::style_parser styleParser;
+    };
+
+    const Parser* parser;
+    if(frameworks) {
+        static const Parser fullParser { buildParseOptions(true), buildExtraStyleParser(true) };
+        parser = &fullParser;
+    } else {
+        static const Parser coreParser { buildParseOptions(false), buildExtraStyleParser(false) };
+        parser = &coreParser;
+    }
+
+    // Add gbdxm-file as a positional argument for convenience
+    po::positional_options_description p;
+    p.add("gbdxm-file", 1);
+    p.add("input-file", -1);
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(args)
+                  .extra_style_parser(parser->styleParser)
+                  .options(parser->desc)
+                  .positional(p)
+                  .run(), vm);
+    po::notify(vm);
+
+    return vm;
+}
+
+unique_ptr<GbdxmArgs> parseArgs(const vector<string>& command)
+{
+    DG_CHECK(!command.empty(), "Missing action");
+
+    auto action = to_lower_copy(command.front());
+    DG_CHECK(action != "batch", "Batch jobs cannot run other batches");
+
+    // Building the options enumerates the model types
+    po::variables_map vm;
+    {
+        auto lock = lockFrameworks();
+        vm = parseCommandLine(vector<string>(command.begin() + 1, command.end()), action);
+    }
+
+    auto args = readArgs(vm, action);
+    DG_CHECK(args, "Invalid action '%s'. The correct actions are show, pack, unpack, update, verify, delta, and patch",
+             action.c_str());
+
+    return args;
+}
+
+unique_ptr<GbdxmPackArgs> parsePackArgs(const vector<string>& options, map<string, vector<uint8_t>> modelData)
+{
+    po::variables_map vm;
+    {
+        auto lock = lockFrameworks();
+        vm = parseCommandLine(options, "pack");
+    }
+
+    auto args = readPackArgs(vm, move(modelData));
+    readCommonArgs(vm, "pack", *args);
+
+    return args;
+}
+
+void addShowOptions(po::options_description& desc)
+{
+    po::options_description show("Show Options");
+    show.add_options()
+        ("fields", po::value<string>()->value_name("FIELD1,FIELD2,..."),
+            "Only show the given top-level metadata fields, e.g. --fields category,modelSize,colorMode.")
+        ("format", po::value<string>()->value_name("FORMAT")->default_value("json"),
+            "Output format, must be one of the following: json, text. The text format prints one "
+            "FIELD=VALUE line per field.")
+        ("entries", "List the zip entries instead of the metadata, with the offset of their data in the file "
+            "and whether it is page-aligned.");
+
+    desc.add(show);
+}
+
+void addPackOptions(po::options_description& desc, bool helpOptions)
+{
+    po::options_description pack("Pack Options");
+    string supportedTypes = "Type of the input model. Currently supported types:";
+    for(const auto& type : classification::ModelIdentifier::types()) {
+        supportedTypes += "\n \t - " + type;
+    }
+
+    pack.add_options()
+        ("type,t", po::value<string>()->value_name("TYPE"), supportedTypes.c_str())
+        ("json,j", po::value<string>()->value_name("PATH"),
+            "Model metadata in JSON format. Command line parameters will override "
+            "entries in this file if present.")
+        ("name,n", po::value<string>()->value_name("NAME"), "Model name.")
+        ("version,V", po::value<string>()->value_name("VERSION"), "Model version.")
+        ("description,d", po::value<string>()->value_name("DESCRIPTION"), "Model description.")
+        ("labels,l", po::value<string>()->value_name("PATH"), "Labels file name.")
+        ("label-names", po::value<vector<string>>()->multitoken()->value_name("LABEL1 [LABEL2 ...]"),
+            "A list of label names.")
+        ("date-time", po::value<string>()->value_name("DATE_TIME"),
+            "Date/time the model was created (optional). Default is the current date and time. Must be in the following "
+            "ISO format: YYYYMMDDTHHMMSS[.ffffff], where 'T' is the literal date-time separator. e.g. 20020131T100001.123456")
+        ("model-size,w", po::cvSize_value()->value_name("WIDTH [HEIGHT]"), "Classifier model size. Model parameters will "
+            "override this if present.")
+        ("bounding-box,b", po::cvRect2d_value()->value_name("W S E N"),
+            "Training area bounding box (optional). Must specify four "
+            "coordinates: west longitude, south latitude, east longitude, and north latitude. e.g. "
+            "--bounding-box -180 -90 180 90")
+        ("color-mode,c", po::value<string>()->value_name("MODE"),
+            "Color mode. Model parameters will override this if present. Must be one of the following: grayscale, rgb, multiband")
+        ("resolution,r", po::cvSize2d_value()->value_name("WIDTH [HEIGHT]"),
+            "Model pixel resolution (optional).")
+        ("stream", "Read, compress, encrypt, and write model files in fixed-size chunks instead of loading them "
+            "into memory. Encrypted streaming packages require --key-file.")
+        ("cache-dir", po::value<string>()->value_name("PATH"),
+            "Keep compressed and encrypted model files in this directory, and copy them from there when packing "
+            "identical model files with the same settings again. Implies --stream.")
+        ("compression", po::value<string>()->value_name("CODEC"),
+            "Model file compression: deflate, zstd, or store. Default is deflate. Implies --stream. zstd entries "
+            "(zip method 93) can only be read by gbdxm's streaming reader, not by GbdxModelReader or DeepCore "
+            "loaders. metadata.json is always deflated, so show works on any package.")
+        ("level", po::value<int>()->value_name("N"),
+            "Compression level: 0 to 9 for deflate, 1 to 22 for zstd, where higher levels compress better and "
+            "slower. Negative zstd levels trade compression for even more speed. Default is 6 for deflate and 3 "
+            "for zstd. Implies --stream.")
+        ("adaptive", "Estimate how well each model file compresses from a few samples, and store the ones that "
+            "would shrink by less than 10%, such as float weights, uncompressed. Implies --stream.")
+        ("align", po::value<size_t>()->value_name("N"),
+            "Start the data of uncompressed model files at a multiple of N bytes in the package, e.g. 4096 so that "
+            "plaintext model files can be mapped in place. N must be a power of two up to 32768. Implies --stream.")
+        ("skip-detection", "Don't read metadata or the category from the model files. The model files that hold "
+            "metadata, e.g. the TensorFlow frozen graph, are then never loaded into memory, but every metadata "
+            "field and --category must be given with the options or --json, and model parameters no longer "
+            "override --model-size and --color-mode.")
+        ("shard-size", po::value<string>()->value_name("SIZE"),
+            "Split model files larger than SIZE, e.g. 512M, into numbered shard packages of SIZE bytes of the file "
+            "each, written next to the package, which can be transferred and unpacked in parallel. The package "
+            "holds an index of the shards. SIZE must be at least 1M. Implies --stream.")
+        ;
+
+    addPackFrameworkOptions(pack, helpOptions);
+
+    desc.add(pack);
+}
+
+
+
+void addPackFrameworkOptions(po::options_description& desc, bool includeCategory)
+{
+    for(const auto& type : classification::ModelIdentifier::types()) {
+        const auto& identifier = *classification::ModelIdentifier::find(type);
+
+        string title("Pack ");
+        title += identifier.prettyType();
+        title += " Options";
+
+        po::options_description framework(title);
+
+        if(includeCategory) {
+            string categoryDesc = "Model category";
+            if(identifier.canDetectCategory()) {
+                categoryDesc += " (optional). ";
+            } else {
+                categoryDesc += ". ";
+            }
+
+            categoryDesc += "The supported categories are: " + join(identifier.categories(), ", ") + ".";
+
+            framework.add(boost::make_shared<po::option_description>(
+                "category,C", po::value<string>()->value_name("CATEGORY"), categoryDesc.c_str()));
+        }
+
+        auto multiDesc = string("Set multiple ") + identifier.prettyType() + " options.";
+
+        framework.add(boost::make_shared<po::option_description>(
+            type.c_str(),
+            po::value<vector<string>>()
+                ->value_name("NAME VALUE [NAME VALUE ...]")
+                ->multitoken(),
+            multiDesc.c_str()));
+
+        // Add descriptions for model items
+        for(const auto& item : identifier.itemDescriptions()) {
+            framework.add(createFrameworkOption(item, identifier.type(), "PATH", " file name"));
+        }
+
+        // Add descriptions for model options
+        for(const auto& item : identifier.optionDescriptions()) {
+            framework.add(createFrameworkOption(item, identifier.type(), "VALUE", ""));
+        }
+
+        desc.add(framework);
+    }
+}
+
+boost::shared_ptr<po::option_description> createFrameworkOption(classification::ItemDescription item, const char* type, const char* name, const char* ending)
+{
+    string option(type);
+    option += "-";
+    option += item.name;
+
+    auto description = item.description + ending;
+    if(item.optional) {
+        description += " (optional)";
+    }
+
+    description += ".";
+
+    if(!item.allowedValues.empty()) {
+        description += " Allowed values are: " + join(item.allowedValues, ", ") + ".";
+    }
+
+    auto value = po::value<string>()->value_name(name);
+    if(!item.defaultValue.empty()) {
+        value->default_value("\"" + item.defaultValue + "\"");
+    }
+
+    return boost::make_shared<po::option_description>(option.c_str(), value, description.c_str());
+}
+
+void addUpdateOptions(po::options_description& desc)
+{
+    po::options_description update("Update Options");
+    update.add_options()
+        ("in-place", "Rewrite metadata.json and the central directory in the package file itself. By default the "
+            "package is updated in a copy that replaces it when complete, which is instant on file systems that "
+            "share blocks between files, e.g. Btrfs and XFS, but copies the whole package elsewhere, e.g. on ext4. "
+            "An update in place that is interrupted leaves the package unreadable.");
+
+    desc.add(update);
+}
+
+void addUnpackOptions(po::options_description& desc)
+{
+    po::options_description unpack("Unpack Options");
+    unpack.add_options()
+        ("output-dir,o", po::value<string>()->value_name("PATH")->default_value("."),
+            "Directory for the output model files. Default is current directory. The output file of delta and "
+            "patch.")
+        ("item", po::value<vector<string>>()->composing()->value_name("NAME"),
+            "Only extract the given model item, e.g. --item model. May be repeated. labels.txt is only written "
+            "when extracting all the items.")
+        ("stdout", "Write the items given with --item to standard output, in the order given, instead of to files.");
+
+    desc.add(unpack);
+}
+
+void setupLogging(const po::variables_map& vm)
+{
+    // --verbose, logged to standard error if standard output is taken by
+    // the package or the model files
+    if(vm.count("verbose")) {
+        if(vm.count("stdout") || (vm.count("gbdxm-file") && vm["gbdxm-file"].as<string>() == "-")) {
+            log::addCerrSink(level_t::info, level_t::info, log::dg_log_format::dg_short_log);
+        } else {
+            log::addCoutSink(level_t::info, level_t::info, log::dg_log_format::dg_short_log);
+        }
+    }
+}
+
+unique_ptr<GbdxmArgs> readArgs(const boost::program_options::variables_map& vm, const string& action)
+{
+    unique_ptr<GbdxmArgs> args;
+
+    if(action == "show") {
+        args = readShowArgs(vm);
+    } else if(action == "pack") {
+        args = readPackArgs(vm);
+    } else if(action == "unpack") {
+        args = readUnpackArgs(vm);
+    } else if(action == "update") {
+        args = readUpdateArgs(vm);
+    } else if(action == "batch") {
+        args = readBatchArgs(vm);
+    } else if(action == "verify") {
+        args = readVerifyArgs(vm);
+    } else if(action == "delta") {
+        args = readDeltaArgs(vm);
+    } else if(action == "patch") {
+        args = readPatchArgs(vm);
+    }
+
+    // If action is not in "show", "pack", "unpack", "update", "batch", "verify", "delta", or "patch", just return
+    // nullptr
+    if(!args) {
+        return nullptr;
+    }
+
+    // Only delta and patch take a second package
+    if(vm.count("input-file") && args->action != Action::DELTA && args->action != Action::PATCH) {
+        DG_ERROR_THROW("Unexpected argument '%s'", vm["input-file"].as<vector<string>>().front().c_str());
+    }
+
+    DG_CHECK(vm.count("gbdxm-file") > 0, "No GBDXM file specified.");
+    readCommonArgs(vm, action, *args);
+
+    return args;
+}
+
+void readCommonArgs(const po::variables_map& vm, const string& action, GbdxmArgs& args)
+{
+    // --gbdxm-file
+    if(vm.count("gbdxm-file")) {
+        args.gbdxFile = vm["gbdxm-file"].as<string>();
+    }
+
+    // --key-file
+    if(vm.count("key-file")) {
+        args.keyFile = vm["key-file"].as<string>();
+    }
+
+    // --threads
+    if(vm.count("threads")) {
+        args.threads = vm["threads"].as<size_t>();
+    }
+
+    // --io-engine
+    if(vm.count("io-engine")) {
+        auto engine = vm["io-engine"].as<string>();
+        to_lower(engine);
+        DG_CHECK(engine == "sync" || engine == "uring", "Unsupported option for --io-engine '%s'",
+                 vm["io-engine"].as<string>().c_str());
+        args.ioEngine = engine == "uring" ? IoEngine::URING : IoEngine::SYNC;
+    }
+
+    readStatsArgs(vm, action, args);
+}
+
+void readStatsArgs(const po::variables_map& vm, const string& action, GbdxmArgs& args)
+{
+    // Pack reads these early to time the metadata detection, don't start
+    // over afterwards
+    if(args.stats) {
+        return;
+    }
+
+    // --stats-file
+    if(vm.count("stats-file")) {
+        args.statsFile = vm["stats-file"].as<string>();
+        DG_CHECK(!args.statsFile.empty(), "--stats-file requires a file name");
+    }
+
+    // --stats
+    if(vm.count("stats") || !args.statsFile.empty()) {
+        bool packToStdout = action == "pack" && vm.count("gbdxm-file") && vm["gbdxm-file"].as<string>() == "-";
+        DG_CHECK((vm.count("stdout") == 0 && !packToStdout) || !args.statsFile.empty(),
+                 "--stats cannot be combined with --stdout or packing to standard output, use --stats-file");
+        args.stats = std::make_shared<ActionStats>(action);
+    }
+}
+
+unique_ptr<GbdxmArgs> readShowArgs(const po::variables_map& vm)
+{
+    unique_ptr<GbdxmShowArgs> args(new GbdxmShowArgs);
+    args->action = Action::SHOW;
+
+    // --fields
+    if(vm.count("fields")) {
+        boost::algorithm::split(args->fields, vm["fields"].as<string>(), boost::algorithm::is_any_of(","),
+                                boost::algorithm::token_compress_on);
+        for(auto& field : args->fields) {
+            boost::algorithm::trim(field);
+        }
+
+        args->fields.erase(remove_if(args->fields.begin(), args->fields.end(), [](const string& field) {
+            return field.empty();
+        }), args->fields.end());
+        DG_CHECK(!args->fields.empty(), "Invalid --fields argument: no field names given");
+    }
+
+    // --entries
+    if(vm.count("entries")) {
+        DG_CHECK(args->fields.empty(), "--entries cannot be used with --fields");
+        args->entries = true;
+    }
+
+    // --format
+    auto format = to_lower_copy(vm["format"].as<string>());
+    if(format == "json") {
+        args->format = ShowFormat::JSON;
+    } else if(format == "text") {
+        args->format = ShowFormat::TEXT;
+    } else {
+        DG_ERROR_THROW("Invalid --format argument '%s': must be one of the following: json, text", format.c_str());
+    }
+
+    return std::move(args);
+}
+
+void readFrameworkPackItems(map<string, string>& items,
+                            map<string, string>& options,
+                            vector<string>& missingArgs,
+                            const classification::ItemDescriptions& descriptions,
+                            const string& prefix)
+{
+    for(const auto& item : descriptions) {
+        auto it = options.find(item.name);
+        if(it != options.end()) {
+            if(!item.allowedValues.empty()) {
+                auto valueIt = find(item.allowedValues.begin(), item.allowedValues.end(), it->second);
+                DG_CHECK(valueIt != item.allowedValues.end(),
+                         "Invalid --%s-%s option: allowed values are: %s",
+                        item.name.c_str(), prefix.c_str(), join(item.allowedValues, ", ").c_str());
+            }
+
+            items[it->first] = it->second;
+            options.erase(it);
+        } else if(!item.optional && items.find(item.name) == items.end()) {
+            missingArgs.push_back(prefix + item.name);
+        }
+    }
+}
+
+vector<string> readFrameworkPackArgs(const po::variables_map& vm, GbdxmPackArgs& args)
+{
+    auto type = args.package->type();
+    map<string, string> cliOptions;
+    if(vm.count(type) > 0) {
+        const auto& argList = vm[args.package->type()].as<vector<string>>();
+        DG_CHECK(argList.size() % 2 == 0, "--%s must have an even number of arguments", type);
+
+        for(auto it = argList.begin(); it != argList.end(); ++it) {
+            const auto& key = *it++;
+            const auto& value = *it;
+            cliOptions[key] = value;
+        }
+    }
+
+    auto prefix = string(type) + "-";
+    vector<string> missingArgs;
+
+    readFrameworkPackItems(args.modelFiles, cliOptions, missingArgs, args.identifier->itemDescriptions(), prefix);
+
+    map<string, string> options;
+    readFrameworkPackItems(options, cliOptions, missingArgs, args.identifier->optionDescriptions(), prefix);
+    args.package->metadata().setOptions(options);
+
+    DG_CHECK(cliOptions.empty(), "Invalid %s options: %s",
+            args.identifier->type(), join(keys(cliOptions), ", ").c_str());
+
+    return missingArgs;
+}
+
+void readMetadataArgs(const po::variables_map& vm,
+                      classification::ModelMetadata& metadata,
+                      string& labelsFile,
+                      vector<string>& missingFields,
+                      vector<string>& errors)
+{
+    // --version
+    if(vm.count("version")) {
+        metadata.setVersion(vm["version"].as<string>());
+        tryErase(missingFields, "modelVersion");
+    }
+
+    // --name
+    if(vm.count("name")) {
+        metadata.setName(vm["name"].as<string>());
+        tryErase(missingFields, "name");
+    }
+
+    // --category
+    if(vm.count("category")) {
+        metadata.setCategory(to_lower_copy(vm["category"].as<string>()));
+        tryErase(missingFields, "category");
+    }
+
+    // --description
+    if(vm.count("description")) {
+        metadata.setDescription(vm["description"].as<string>());
+        tryErase(missingFields, "description");
+    }
+
+    // --label-names
+    if(vm.count("label-names")) {
+        metadata.setLabels(vm["label-names"].as<vector<string>>());
+        if(!metadata.labels().empty()) {
+            tryErase(missingFields, "labels");
+        }
+    }
+
+    // --labels
+    if(vm.count("labels")) {
+        DG_CHECK(vm.count("label-names") == 0, "Please specify either --labels or --label-names, not both");
+        labelsFile = vm["labels"].as<string>();
+        if (!labelsFile.empty()) {
+            tryErase(missingFields, "labels");
+        }
+    }
+
+    // --date-time
+    if(vm.count("date-time")) {
+        time_t timeCreated;
+        try {
+            timeCreated = to_time_t(from_iso_string(vm["date-time"].as<string>()));
+        } catch (...) {
+            DG_ERROR_THROW("Invalid date/time format in --date-time argument");
+        }
+        metadata.setTimeCreated(timeCreated);
+    } else if(find(missingFields.begin(), missingFields.end(), "timeCreated" ) != missingFields.end()) {
+        metadata.setTimeCreated(time(nullptr));
+    }
+
+    tryErase(missingFields, "timeCreated");
+
+    // --model-size
+    if(vm.count("model-size")) {
+        metadata.setModelSize(vm["model-size"].as<cv::Size>());
+        tryErase(missingFields, "modelSize");
+    }
+
+    // --bounding-box
+    if(vm.count("bounding-box")) {
+        metadata.setBoundingBox(vm["bounding-box"].as<cv::Rect2d>());
+        tryErase(missingFields, "boundingBox");
+    }
+
+    // --image-type
+    if(vm.count("image-type")) {
+        DG_LOG(gbdxm, warning) << "--image-type argument is deprecated and ignored";
+    }
+
+    // --color-mode
+    if(vm.count("color-mode")) {
+        auto colorMode = classification::colorModeFromString(vm["color-mode"].as<string>());
+        if(colorMode != classification::ColorMode::UNKNOWN) {
+            metadata.setColorMode(colorMode);
+            tryErase(missingFields, "colorMode");
+        } else {
+            errors.emplace_back("Unsupported option for --color-mode '" + vm["color-mode"].as<string>() + "'");
+        }
+    }
+
+    // --resolution
+    if(vm.count("resolution")) {
+        metadata.setResolution(vm["resolution"].as<cv::Size2d>());
+        tryErase(missingFields, "resolution");
+    }
+}
+
+unique_ptr<GbdxmPackArgs> readPackArgs(const po::variables_map& vm, map<string, vector<uint8_t>> modelData)
+{
+    auto args = make_unique<GbdxmPackArgs>();
+    args->action = Action::PACK;
+    vector<string> missingFields;
+    vector<string> errors;
+
+    // Start the clock before the model files are read for metadata detection
+    readStatsArgs(vm, "pack", *args);
+
+    // The model package, its metadata, and the categories come from the
+    // frameworks. The lock is let go while model files are read.
+    auto lock = lockFrameworks();
+
+    // --type
+    if(vm.count("type")) {
+        args->type = vm["type"].as<string>();
+        to_lower(args->type);
+
+        args->package = classification::ModelPackage::create(args->type.c_str());
+        missingFields = classification::ModelMetadataJson::fieldNames(args->type);
+        tryErase(missingFields, "type");
+    }
+
+    // --json
+    if(vm.count("json")) {
+        missingFields = readJsonMetadata(vm["json"].as<string>(), *args);
+    }
+
+    DG_CHECK(!args->type.empty() && args->package, "Missing model type")
+
+    // Files in memory are named after their items unless told otherwise
+    args->modelData = move(modelData);
+    for(const auto& item : args->modelData) {
+        if(!args->modelFiles.count(item.first)) {
+            args->modelFiles[item.first] = item.first;
+        }
+    }
+
+    tryErase(missingFields, "version");
+    tryErase(missingFields, "size");
+    args->identifier = &args->package->identifier();
+    auto& metadata = args->package->metadata();
+
+    readMetadataArgs(vm, metadata, args->labelsFile, missingFields, errors);
+
+    // "--<type>-<option>" arguments, e.g. "--caffe-model"
+    auto missingArgs = readFrameworkPackArgs(vm, *args);
+
+    if(!missingArgs.empty()) {
+        errors.push_back(string("Missing ") + metadata.type() + " model arguments: --" + join(missingArgs, ", --"));
+    } else if(vm.count("skip-detection")) {
+        DG_LOG(gbdxm, info) << "--skip-detection given, not reading model metadata";
+    } else {
+        // Try to retrieve fields from the model
+        readModelMetadata(*args, missingFields, lock);
+    }
+
+    // --plaintext
+    if(vm.count("plaintext")) {
+        args->encrypt = false;
+    }
+
+    // --cache-dir
+    if(vm.count("cache-dir")) {
+        args->cacheDir = vm["cache-dir"].as<string>();
+    }
+
+    // --compression
+    if(vm.count("compression")) {
+        auto compression = vm["compression"].as<string>();
+        to_lower(compression);
+        if(compression == "deflate") {
+            args->compression = EntryCodec::DEFLATE;
+        } else if(compression == "zstd") {
+            args->compression = EntryCodec::ZSTD;
+        } else if(compression == "store") {
+            args->compression = EntryCodec::STORE;
+        } else {
+            errors.emplace_back("Unsupported option for --compression '" + vm["compression"].as<string>() + "'");
+        }
+
+        if(!isCodecSupported(args->compression)) {
+            errors.emplace_back(string("This version of gbdxm was built without ") + codecName(args->compression) + " support");
+        }
+    }
+
+    // --level
+    if(vm.count("level")) {
+        args->level = vm["level"].as<int>();
+        if(args->compression == EntryCodec::STORE) {
+            errors.emplace_back("--level cannot be used with --compression store");
+        }
+    }
+
+    // --adaptive
+    if(vm.count("adaptive")) {
+        args->adaptive = true;
+        if(args->compression == EntryCodec::STORE) {
+            errors.emplace_back("--adaptive cannot be used with --compression store");
+        }
+    }
+
+    // --align
+    if(vm.count("align")) {
+        args->align = vm["align"].as<size_t>();
+        if(args->align < 2 || args->align > MAX_ALIGNMENT || (args->align & (args->align - 1)) != 0) {
+            errors.emplace_back("Invalid --align argument: must be a power of two up to 32768");
+        }
+    }
+
+    // --shard-size
+    if(vm.count("shard-size")) {
+        if(!parseByteSize(vm["shard-size"].as<string>(), args->shardSize) || args->shardSize < MIN_SHARD_SIZE) {
+            errors.emplace_back("Invalid --shard-size argument: must be a size of at least 1M, e.g. 512M");
+        }
+    }
+
+    // --stream, also implied by --cache-dir, --compression, --level, --adaptive, --align, and --shard-size
+    if(vm.count("stream") || vm.count("cache-dir") || vm.count("compression") || vm.count("level") ||
+       vm.count("adaptive") || vm.count("align") || vm.count("shard-size")) {
+        args->stream = true;
+    }
+
+    // --threads implies --stream only where the package stays readable by
+    // GbdxModelReader, or where gbdxm's own encryption was asked for with
+    // --key-file. DeepCore encrypts packages on a single thread.
+    if(vm.count("threads") && !args->stream) {
+        if(!args->encrypt || vm.count("key-file")) {
+            args->stream = true;
+        } else {
+            DG_LOG(gbdxm, warning) << "--threads has no effect on packages encrypted by DeepCore, use --plaintext "
+                                      "or --key-file to compress on several threads";
+        }
+    }
+
+    // Create an error message for missingFields
+    if(!missingFields.empty()) {
+        auto cliMap = classification::ModelMetadataJson::fieldToOption(metadata.type());
+        vector<string> cliFields;
+
+        for(const auto& missingField : missingFields){
+            auto it = cliMap.find(missingField);
+            if(it != end(cliMap)) {
+                cliFields.push_back(it->second);
+            }
+            else{
+                cliFields.push_back(missingField);
+            }
+        }
+        errors.push_back("Missing required metadata arguments: --" + join(cliFields, ", --"));
+    }
+
+    // Create an error if category is invalid or cannot be inferred
+    vector<string> categories;
+    if (args->identifier->canDetectCategory() && !vm.count("skip-detection")) {
+        categories = args->identifier->detectCategory(*args->package);
+        DG_CHECK(!categories.empty(), "Category could not be detected for type '%s'", args->type.c_str());
+    } else {
+        // Every category the framework supports, also with --skip-detection,
+        // when nothing was read from the model files to detect it from
+        categories = args->identifier->categories();
+        DG_CHECK(!categories.empty(), "No categories for invalid or unsupported type '%s'", args->type.c_str());
+    }
+
+    if(metadata.category().empty()) {
+        if(categories.size() == 1) {
+            metadata.setCategory(categories[0]);
+        } else {
+            errors.push_back("Please specify a category, possible categories "
+                             "for this model are: " + join(categories, ", "));
+        }
+    } else if(find(categories.begin(), categories.end(), metadata.category()) == categories.end()) {
+        errors.push_back("Category '" + metadata.category()  + "' is invalid,"
+                         " possible categories for this model are: " + join(categories, ", "));
+    }
+
+    DG_CHECK(errors.empty(), "%s", join(errors, "\n").c_str());
+    return args;
+}
+
+vector<string> readJsonMetadata(const string& fileName, GbdxmPackArgs& args)
+{
+    DG_CHECK(exists(fileName), "%s does not exist", fileName.c_str());
+    DG_CHECK(!is_directory(fileName), "%s is a directory", fileName.c_str());
+
+    vector<string> missingFields;
+    ifstream ifs(fileName);
+    DG_CHECK(ifs.good(), "Error opening %s: %s", fileName.c_str(), strerror(errno));
+
+    Json::Reader reader;
+    Json::Value root;
+    DG_CHECK(reader.parse(ifs, root), "Error parsing metadata: %s",
+             reader.getFormattedErrorMessages().c_str());
+
+    auto metadata = classification::ModelMetadataJson::fromJsonPartial(root, missingFields, args.type);
+    args.package = classification::ModelPackage::create(move(metadata));
+    args.type = args.package->type();
+
+    if(root.isMember("content")) {
+        DG_CHECK(root["content"].type() == Json::objectValue,
+                 "Invalid metadata \"content\" field: must be a JSON object.");
+
+        for(const auto& name : root["content"].getMemberNames()) {
+            args.modelFiles[name] = root["content"][name].asString();
+        }
+    }
+
+    return missingFields;
+}
+
+void readModelMetadata(GbdxmPackArgs& args, vector<string>& missingFields,
+                       std::unique_lock<std::recursive_mutex>& lock)
+{
+    // Load the files with metadata into the ModelPackage
+    for(const auto& itemName : args.identifier->metadataItems()) {
+        auto data = args.modelData.find(itemName);
+        if(data != args.modelData.end()) {
+            DG_LOG(gbdxm, info) << "Reading model metadata of " << itemName << " from memory";
+
+            ActionStats::Timer timer(args.stats.get(), "metadataRead", data->second.size());
+            args.package->setItem(itemName, data->second);
+            continue;
+        }
+
+        const auto& fileName = args.modelFiles[itemName];
+
+        const auto& descriptions = args.identifier->itemDescriptions();
+        auto it = find_if(descriptions.begin(), descriptions.end(), [&itemName](const classification::ItemDescription& desc) {
+            return desc.name == itemName;
+        });
+
+        // Sanity check, should never happen unless the ModelPackage
+        // and ModelIdentifier are set up wrong.
+        DG_CHECK(it != descriptions.end(), "'%s' is not registered as valid model package item", itemName.c_str());
+
+        if(fileName.empty()) {
+            DG_CHECK(it->optional, "--%s-%s argument is missing", args.identifier->type(), itemName.c_str());
+            continue;
+        }
+
+        if(!exists(fileName)) {
+            if(it->optional) {
+                DG_LOG(gbdxm, warning) << "Invalid --" << args.identifier->type() << "-" << itemName
+                                       << " argument: "<< fileName << " does not exist";
+                continue;
+            } else {
+                // Again, this shouldn't happen, but we'll handle it here anyway.
+                DG_ERROR_THROW("Invalid --%s-%s argument: %s does not exist",
+                               args.identifier->type(), itemName.c_str(), fileName.c_str());
+            }
+        }
+
+        DG_LOG(gbdxm, info) << "Reading model metadata from " << fileName;
+
+        vector<uint8_t> fileData;
+        lock.unlock();
+        {
+            ActionStats::Timer timer(args.stats.get(), "metadataRead", file_size(fileName));
+            fileData = readBinaryFile(fileName);
+        }
+        lock.lock();
+
+        args.package->setItem(itemName, move(fileData));
+    }
+
+    // Read the metadata
+    ActionStats::Timer timer(args.stats.get(), "metadataDetect");
+    auto itemsRead = args.identifier->readMetadata(*args.package);
+
+    // Remove items retrieved from the missingFields list
+    missingFields.erase(remove_if(missingFields.begin(), missingFields.end(), [&itemsRead](const string& item) {
+        return find(itemsRead.begin(), itemsRead.end(), item) != itemsRead.end();
+    }), missingFields.end());
+}
+
+unique_ptr<GbdxmArgs> readUnpackArgs(const po::variables_map& vm)
+{
+    unique_ptr<GbdxmUnpackArgs> args(new GbdxmUnpackArgs);
+    args->action = Action::UNPACK;
+
+    // --output-dir
+    args->outputDir = vm["output-dir"].as<string>();
+
+    // --item
+    if(vm.count("item")) {
+        args->items = vm["item"].as<vector<string>>();
+    }
+
+    // --stdout
+    if(vm.count("stdout")) {
+        DG_CHECK(!args->items.empty(), "--stdout requires at least one --item");
+        args->toStdout = true;
+    }
+
+    return std::move(args);
+}
+
+unique_ptr<GbdxmArgs> readUpdateArgs(const po::variables_map& vm)
+{
+    auto args = make_unique<GbdxmUpdateArgs>();
+    args->action = Action::UPDATE;
+    args->inPlace = vm.count("in-place") > 0;
+
+    DG_CHECK(vm.count("type") == 0, "The model type of a package cannot be updated");
+    DG_CHECK(vm.count("json") == 0, "--json is not supported by update, use the individual metadata options");
+
+    DG_CHECK(vm.count("gbdxm-file") > 0, "No GBDXM file specified.");
+    const auto& fileName = vm["gbdxm-file"].as<string>();
+    DG_CHECK(exists(fileName) && !is_directory(fileName), "Input file does not exist at %s", fileName.c_str());
+
+    // Start with the metadata in the package
+    StreamingModelReader reader(fileName, nullptr);
+    args->package = reader.readPackage(args->contentMap);
+    auto& metadata = args->package->metadata();
+    auto lock = lockFrameworks();
+
+    vector<string> missingFields;
+    vector<string> errors;
+    readMetadataArgs(vm, metadata, args->labelsFile, missingFields, errors);
+
+    // --category
+    if(vm.count("category")) {
+        auto categories = args->package->identifier().categories();
+        if(!categories.empty() && find(categories.begin(), categories.end(), metadata.category()) == categories.end()) {
+            errors.push_back("Category '" + metadata.category() + "' is invalid, possible categories for this model "
+                             "are: " + join(categories, ", "));
+        }
+    }
+
+    DG_CHECK(errors.empty(), "%s", join(errors, "\n").c_str());
+
+    return std::move(args);
+}
+
+unique_ptr<GbdxmArgs> readBatchArgs(const po::variables_map& vm)
+{
+    unique_ptr<GbdxmBatchArgs> args(new GbdxmBatchArgs);
+    args->action = Action::BATCH;
+
+    // Run one job per CPU core unless --threads says otherwise
+    args->threads = 0;
+
+    // The manifest is given in place of the GBDXM file
+    DG_CHECK(vm.count("gbdxm-file") > 0, "No batch manifest specified.");
+    const auto& fileName = vm["gbdxm-file"].as<string>();
+
+    ifstream ifs(fileName);
+    DG_CHECK(ifs.good(), "Error opening %s: %s", fileName.c_str(), strerror(errno));
+
+    // Jobs are only split into arguments here, each one is parsed right
+    // before it runs so that model files aren't loaded up front
+    string line;
+    for(size_t lineNumber = 1; getline(ifs, line); ++lineNumber) {
+        boost::algorithm::trim(line);
+        if(line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        GbdxmBatchJob job;
+        job.line = lineNumber;
+        job.command = po::split_unix(line);
+        args->jobs.push_back(move(job));
+    }
+
+    DG_CHECK(!ifs.bad(), "Error reading %s: %s", fileName.c_str(), strerror(errno));
+
+    return std::move(args);
+}
+
+unique_ptr<GbdxmArgs> readVerifyArgs(const po::variables_map& vm)
+{
+    unique_ptr<GbdxmArgs> args(new GbdxmArgs);
+    args->action = Action::VERIFY;
+
+    // Verify items on every CPU core unless --threads says otherwise
+    args->threads = 0;
+
+    return args;
+}
+
+unique_ptr<GbdxmArgs> readDeltaArgs(const po::variables_map& vm)
+{
+    unique_ptr<GbdxmDeltaArgs> args(new GbdxmDeltaArgs);
+    args->action = Action::DELTA;
+
+    DG_CHECK(vm.count("input-file") && vm["input-file"].as<vector<string>>().size() == 1,
+             "delta takes the old and the new package: gbdxm delta OLD NEW -o PATCH");
+    args->newFile = vm["input-file"].as<vector<string>>().front();
+
+    DG_CHECK(!vm["output-dir"].defaulted(), "No patch file specified: gbdxm delta OLD NEW -o PATCH");
+    args->outputFile = vm["output-dir"].as<string>();
+
+    return std::move(args);
+}
+
+unique_ptr<GbdxmArgs> readPatchArgs(const po::variables_map& vm)
+{
+    unique_ptr<GbdxmPatchArgs> args(new GbdxmPatchArgs);
+    args->action = Action::PATCH;
+
+    DG_CHECK(vm.count("input-file") && vm["input-file"].as<vector<string>>().size() == 1,
+             "patch takes the old package and the patch: gbdxm patch OLD PATCH -o NEW");
+    args->patchFile = vm["input-file"].as<vector<string>>().front();
+
+    DG_CHECK(!vm["output-dir"].defaulted(), "No output package specified: gbdxm patch OLD PATCH -o NEW");
+    args->outputFile = vm["output-dir"].as<string>();
+
+    return std::move(args);
+}
+
+void tryErase(vector<string>& names, const string& name)
+{
+    auto it = find(names.begin(), names.end(), name);
+    if(it != names.end()) {
+        names.erase(it);
+    }
+}
+
+/**
+ * Parses a size in bytes with an optional K, M, or G suffix, e.g. 512M.
+ * @return false if the size is invalid.
+ */
+bool parseByteSize(const string& text, uint64_t& size)
+{
+    if(text.empty() || !isdigit(static_cast<unsigned char>(text[0]))) {
+        return false;
+    }
+
+    char* end = nullptr;
+    auto value = strtoull(text.c_str(), &end, 10);
+
+    auto suffix = boost::algorithm::to_upper_copy(string(end));
+    uint64_t scale = 1;
+    if(suffix == "K" || suffix == "KB") {
+        scale = 1ull << 10;
+    } else if(suffix == "M" || suffix == "MB") {
+        scale = 1ull << 20;
+    } else if(suffix == "G" || suffix == "GB") {
+        scale = 1ull << 30;
+    } else if(!suffix.empty() && suffix != "B") {
+        return false;
+    }
+
+    if(value > std::numeric_limits<uint64_t>::max() / scale) {
+        return false;
+    }
+
+    size = value * scale;
+    return true;
+}
+
+} } // namespace dg { namespace gbdxm {
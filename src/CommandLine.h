@@ -0,0 +1,52 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef DEEPCORE_GBDXM_COMMANDLINE_H
+#define DEEPCORE_GBDXM_COMMANDLINE_H
+
+#include "gbdxm.h"
+
+#include <boost/program_options.hpp>
+#include <string>
+#include <vector>
+
+namespace dg { namespace gbdxm {
+
+/**
+ * Prints the usage details of every action, initializing the model
+ * frameworks to list their options.
+ */
+void printHelp();
+
+/**
+ * Parses the options following the action. Only pack, update, and help
+ * initialize the model frameworks, and accept their options.
+ */
+boost::program_options::variables_map parseCommandLine(const std::vector<std::string>& args, const std::string& action);
+
+void setupLogging(const boost::program_options::variables_map& vm);
+
+/**
+ * Reads the arguments of an action from parsed options.
+ * @return nullptr if the action is not one of show, pack, unpack, update,
+ *         batch, or verify.
+ */
+std::unique_ptr<GbdxmArgs> readArgs(const boost::program_options::variables_map& vm, const std::string& action);
+
+} } // namespace dg { namespace gbdxm {
+
+#endif // DEEPCORE_GBDXM_COMMANDLINE_H
@@ -0,0 +1,144 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "Crypto.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/algorithm/hex.hpp>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <utility/Error.h>
+#include <utility/File.h>
+
+namespace dg { namespace gbdxm {
+
+using namespace dg::deepcore;
+
+using std::string;
+
+PackageKey PackageKey::fromFile(const string& fileName)
+{
+    auto data = readBinaryFile(fileName);
+
+    PackageKey key;
+    if(data.size() == KEY_SIZE) {
+        std::copy(data.begin(), data.end(), key.key_.begin());
+        return key;
+    }
+
+    string hex(data.begin(), data.end());
+    boost::algorithm::trim(hex);
+    DG_CHECK(hex.size() == KEY_SIZE * 2, "Invalid key in %s: must be %d raw bytes or %d hexadecimal digits",
+             fileName.c_str(), (int) KEY_SIZE, (int) KEY_SIZE * 2);
+
+    try {
+        boost::algorithm::unhex(hex.begin(), hex.end(), key.key_.begin());
+    } catch(...) {
+        DG_ERROR_THROW("Invalid key in %s: not a hexadecimal string", fileName.c_str());
+    }
+
+    return key;
+}
+
+ChunkCipher::ChunkCipher(const PackageKey& key) :
+    key_(key),
+    ctx_(EVP_CIPHER_CTX_new())
+{
+    DG_CHECK(ctx_ != nullptr, "Error creating cipher context");
+}
+
+ChunkCipher::~ChunkCipher()
+{
+    EVP_CIPHER_CTX_free(ctx_);
+}
+
+void ChunkCipher::seal(const uint8_t* nonce, const uint8_t* aad, size_t aadSize,
+                       const uint8_t* in, size_t size, uint8_t* out, uint8_t* tag)
+{
+    int len = 0;
+    bool ok = EVP_EncryptInit_ex(ctx_, EVP_aes_256_gcm(), nullptr, nullptr, nullptr) == 1
+        && EVP_CIPHER_CTX_ctrl(ctx_, EVP_CTRL_GCM_SET_IVLEN, NONCE_SIZE, nullptr) == 1
+        && EVP_EncryptInit_ex(ctx_, nullptr, nullptr, key_.data(), nonce) == 1
+        && EVP_EncryptUpdate(ctx_, nullptr, &len, aad, static_cast<int>(aadSize)) == 1
+        && (size == 0 || EVP_EncryptUpdate(ctx_, out, &len, in, static_cast<int>(size)) == 1)
+        && EVP_EncryptFinal_ex(ctx_, out + size, &len) == 1
+        && EVP_CIPHER_CTX_ctrl(ctx_, EVP_CTRL_GCM_GET_TAG, TAG_SIZE, tag) == 1;
+
+    DG_CHECK(ok, "Error encrypting model data");
+}
+
+bool ChunkCipher::open(const uint8_t* nonce, const uint8_t* aad, size_t aadSize,
+                       const uint8_t* in, size_t size, uint8_t* out, const uint8_t* tag)
+{
+    int len = 0;
+    bool ok = EVP_DecryptInit_ex(ctx_, EVP_aes_256_gcm(), nullptr, nullptr, nullptr) == 1
+        && EVP_CIPHER_CTX_ctrl(ctx_, EVP_CTRL_GCM_SET_IVLEN, NONCE_SIZE, nullptr) == 1
+        && EVP_DecryptInit_ex(ctx_, nullptr, nullptr, key_.data(), nonce) == 1
+        && EVP_DecryptUpdate(ctx_, nullptr, &len, aad, static_cast<int>(aadSize)) == 1
+        && (size == 0 || EVP_DecryptUpdate(ctx_, out, &len, in, static_cast<int>(size)) == 1)
+        && EVP_CIPHER_CTX_ctrl(ctx_, EVP_CTRL_GCM_SET_TAG, TAG_SIZE, const_cast<uint8_t*>(tag)) == 1;
+
+    DG_CHECK(ok, "Error decrypting model data");
+
+    return EVP_DecryptFinal_ex(ctx_, out + size, &len) == 1;
+}
+
+Sha256::Sha256() :
+    ctx_(EVP_MD_CTX_create())
+{
+    DG_CHECK(ctx_ != nullptr, "Error creating digest context");
+    DG_CHECK(EVP_DigestInit_ex(ctx_, EVP_sha256(), nullptr) == 1, "Error initializing SHA-256");
+}
+
+Sha256::~Sha256()
+{
+    EVP_MD_CTX_destroy(ctx_);
+}
+
+void Sha256::update(const void* data, size_t size)
+{
+    DG_CHECK(EVP_DigestUpdate(ctx_, data, size) == 1, "Error computing SHA-256");
+}
+
+Digest Sha256::final()
+{
+    Digest digest;
+    unsigned int size = 0;
+    DG_CHECK(EVP_DigestFinal_ex(ctx_, digest.data(), &size) == 1 && size == digest.size(), "Error computing SHA-256");
+    return digest;
+}
+
+string toHex(const Digest& digest)
+{
+    static const char digits[] = "0123456789abcdef";
+
+    string ret;
+    ret.reserve(digest.size() * 2);
+    for(auto byte : digest) {
+        ret += digits[byte >> 4];
+        ret += digits[byte & 0xf];
+    }
+
+    return ret;
+}
+
+void randomBytes(uint8_t* data, size_t size)
+{
+    DG_CHECK(RAND_bytes(data, static_cast<int>(size)) == 1, "Error generating random data");
+}
+
+} } // namespace dg { namespace gbdxm {
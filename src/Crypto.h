@@ -0,0 +1,124 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef DEEPCORE_GBDXM_CRYPTO_H
+#define DEEPCORE_GBDXM_CRYPTO_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+typedef struct evp_cipher_ctx_st EVP_CIPHER_CTX;
+typedef struct evp_md_ctx_st EVP_MD_CTX;
+
+namespace dg { namespace gbdxm {
+
+const size_t KEY_SIZE = 32;
+const size_t NONCE_SIZE = 12;
+const size_t TAG_SIZE = 16;
+const size_t DIGEST_SIZE = 32;
+
+typedef std::array<uint8_t, DIGEST_SIZE> Digest;
+
+/**
+ * 256-bit package encryption key.
+ */
+class PackageKey
+{
+public:
+    /**
+     * Loads a key from a file containing either 32 raw bytes or 64
+     * hexadecimal digits.
+     */
+    static PackageKey fromFile(const std::string& fileName);
+
+    const uint8_t* data() const { return key_.data(); }
+
+private:
+    std::array<uint8_t, KEY_SIZE> key_;
+};
+
+/**
+ * AES-256-GCM cipher for sealing and opening individual chunks. Not thread
+ * safe, use one instance per thread.
+ */
+class ChunkCipher
+{
+public:
+    explicit ChunkCipher(const PackageKey& key);
+    ~ChunkCipher();
+
+    ChunkCipher(const ChunkCipher&) = delete;
+    ChunkCipher& operator=(const ChunkCipher&) = delete;
+
+    /**
+     * Encrypts size bytes from in to out, and writes the authentication tag.
+     */
+    void seal(const uint8_t* nonce, const uint8_t* aad, size_t aadSize,
+              const uint8_t* in, size_t size, uint8_t* out, uint8_t* tag);
+
+    /**
+     * Decrypts size bytes from in to out.
+     * @return false if the authentication tag doesn't match.
+     */
+    bool open(const uint8_t* nonce, const uint8_t* aad, size_t aadSize,
+              const uint8_t* in, size_t size, uint8_t* out, const uint8_t* tag);
+
+private:
+    const PackageKey& key_;
+    EVP_CIPHER_CTX* ctx_;
+};
+
+/**
+ * Incremental SHA-256 hash.
+ */
+class Sha256
+{
+public:
+    Sha256();
+    ~Sha256();
+
+    Sha256(const Sha256&) = delete;
+    Sha256& operator=(const Sha256&) = delete;
+
+    void update(const void* data, size_t size);
+    void update(const std::string& data) { update(data.data(), data.size()); }
+
+    /**
+     * Returns the digest of all the data given so far. No more data can be
+     * added afterwards.
+     */
+    Digest final();
+
+private:
+    EVP_MD_CTX* ctx_;
+};
+
+/**
+ * Formats a digest as a lowercase hexadecimal string.
+ */
+std::string toHex(const Digest& digest);
+
+/**
+ * Fills the buffer with cryptographically secure random bytes.
+ */
+void randomBytes(uint8_t* data, size_t size);
+
+} } // namespace dg { namespace gbdxm {
+
+#endif // DEEPCORE_GBDXM_CRYPTO_H
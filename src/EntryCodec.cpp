@@ -0,0 +1,1319 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "EntryCodec.h"
+
+#include "ByteOrder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility/Error.h>
+
+namespace dg { namespace gbdxm {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+const size_t LAYOUT_RECORD_SIZE = 28;
+const size_t INFLATE_BUFFER_SIZE = 256 << 10;
+
+// Compressibility probe: number and size of the sample blocks
+const size_t SAMPLE_BLOCK_COUNT = 8;
+const size_t SAMPLE_BLOCK_SIZE = 64 << 10;
+
+// Chunk table trailer: uint32 chunk count, uint32 magic
+const uint32_t CHUNK_TABLE_MAGIC = 0x54434447; // "GDCT"
+const size_t CHUNK_TABLE_TRAILER_SIZE = 8;
+
+// Upper bound of a compressed chunk, anything larger means the frame is corrupt
+size_t maxFrameSize(size_t chunkSize)
+{
+    return chunkSize + (chunkSize >> 8) + 1024;
+}
+
+double blockEntropy(const uint8_t* data, size_t size)
+{
+    size_t histogram[256] = {};
+    for(size_t i = 0; i < size; ++i) {
+        ++histogram[data[i]];
+    }
+
+    double entropy = 0;
+    for(auto count : histogram) {
+        if(count > 0) {
+            auto p = static_cast<double>(count) / size;
+            entropy -= p * std::log2(p);
+        }
+    }
+
+    return entropy;
+}
+
+void makeNonce(const EntryLayout& layout, uint32_t index, uint8_t* nonce)
+{
+    std::copy(layout.noncePrefix.begin(), layout.noncePrefix.end(), nonce);
+    auto counter = nonce + layout.noncePrefix.size();
+    counter[0] = static_cast<uint8_t>(index >> 24);
+    counter[1] = static_cast<uint8_t>(index >> 16);
+    counter[2] = static_cast<uint8_t>(index >> 8);
+    counter[3] = static_cast<uint8_t>(index);
+}
+
+void openFrame(ChunkCipher& cipher, const EntryLayout& layout, const string& name, uint32_t index,
+               uint32_t lengthField, const vector<uint8_t>& frame, vector<uint8_t>& plain, ActionStats* stats)
+{
+    auto length = frame.size() - TAG_SIZE;
+
+    uint8_t nonce[NONCE_SIZE];
+    makeNonce(layout, index, nonce);
+    auto aad = frameAad(name, index, lengthField);
+
+    ActionStats::Timer timer(stats, "decrypt", length);
+    plain.resize(length);
+    DG_CHECK(cipher.open(nonce, aad.data(), aad.size(), frame.data(), length, plain.data(), &frame[length]),
+             "Could not decrypt chunk %u of %s: the key is wrong or the package is corrupt", index, name.c_str());
+}
+
+// Decompresses a chunk of an encrypted entry, which is compressed
+// independently of the other chunks. Returns the decompressed size, which
+// is at most maxSize.
+size_t decompressChunk(EntryCodec codec, vector<uint8_t>& input, bool final, size_t maxSize,
+                       vector<uint8_t>& output, const string& name, uint32_t index, ActionStats* stats)
+{
+    if(codec == EntryCodec::STORE) {
+        DG_CHECK(input.size() <= maxSize, "Invalid chunk %u in %s, the package is corrupt", index, name.c_str());
+        output.swap(input);
+        return output.size();
+    }
+
+    // The extra byte catches chunks that inflate to more than they should
+    output.resize(maxSize + 1);
+    ActionStats::Timer timer(stats, "decompress");
+
+#ifdef GBDXM_HAVE_ZSTD
+    if(codec == EntryCodec::ZSTD) {
+        auto ret = ZSTD_decompress(output.data(), output.size(), input.data(), input.size());
+        DG_CHECK(!ZSTD_isError(ret) && ret <= maxSize, "Error decompressing chunk %u of %s, the package is corrupt",
+                 index, name.c_str());
+        output.resize(ret);
+        timer.addBytes(ret);
+        return ret;
+    }
+#endif
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    DG_CHECK(inflateInit2(&stream, -MAX_WBITS) == Z_OK, "Error initializing decompression for %s", name.c_str());
+
+    stream.next_in = input.data();
+    stream.avail_in = static_cast<uInt>(input.size());
+    stream.next_out = output.data();
+    stream.avail_out = static_cast<uInt>(output.size());
+
+    auto ret = inflate(&stream, Z_SYNC_FLUSH);
+    auto produced = output.size() - stream.avail_out;
+    bool ok = stream.avail_in == 0 && produced <= maxSize && (final ? ret == Z_STREAM_END : ret == Z_OK);
+    inflateEnd(&stream);
+
+    DG_CHECK(ok, "Error decompressing chunk %u of %s, the package is corrupt", index, name.c_str());
+    output.resize(produced);
+    timer.addBytes(produced);
+    return produced;
+}
+
+// Checks a layout record before decoding the entry
+void checkLayout(const EntryLayout& layout, const string& name, const PackageKey* key)
+{
+    DG_CHECK(layout.version <= ENTRY_LAYOUT_VERSION,
+             "%s uses package layout version %d, this version of gbdxm supports up to %d",
+             name.c_str(), (int) layout.version, (int) ENTRY_LAYOUT_VERSION);
+    DG_CHECK(layout.codec == EntryCodec::STORE || layout.codec == EntryCodec::DEFLATE ||
+             layout.codec == EntryCodec::ZSTD, "%s is compressed with an unsupported codec", name.c_str());
+    DG_CHECK(isCodecSupported(layout.codec), "%s is compressed with %s, this version of gbdxm was built without it",
+             name.c_str(), codecName(layout.codec));
+    DG_CHECK(layout.cipher == EntryCipher::NONE || layout.cipher == EntryCipher::AES_256_GCM,
+             "%s is encrypted with an unsupported cipher", name.c_str());
+    DG_CHECK(layout.cipher == EntryCipher::NONE || key != nullptr,
+             "%s is encrypted, a key file is required to decrypt it", name.c_str());
+    DG_CHECK(layout.chunkSize > 0 && layout.chunkSize <= MAX_CHUNK_SIZE,
+             "Invalid chunk size in %s", name.c_str());
+}
+
+// Codec of an ordinary zip entry without a layout record
+EntryCodec methodCodec(const ZipEntry& entry)
+{
+    DG_CHECK((entry.flags & 1) == 0, "%s uses zip encryption, which is not supported", entry.name.c_str());
+    DG_CHECK(entry.method == ZIP_METHOD_STORE || entry.method == ZIP_METHOD_DEFLATE ||
+             (entry.method == ZIP_METHOD_ZSTD && isCodecSupported(EntryCodec::ZSTD)),
+             "%s is compressed with an unsupported method %d", entry.name.c_str(), (int) entry.method);
+
+    if(entry.method == ZIP_METHOD_DEFLATE) {
+        return EntryCodec::DEFLATE;
+    } else if(entry.method == ZIP_METHOD_ZSTD) {
+        return EntryCodec::ZSTD;
+    }
+
+    return EntryCodec::STORE;
+}
+
+} // namespace
+
+bool isCodecSupported(EntryCodec codec)
+{
+    switch(codec) {
+        case EntryCodec::STORE:
+        case EntryCodec::DEFLATE:
+            return true;
+
+        case EntryCodec::ZSTD:
+#ifdef GBDXM_HAVE_ZSTD
+            return true;
+#else
+            return false;
+#endif
+    }
+
+    return false;
+}
+
+const char* codecName(EntryCodec codec)
+{
+    switch(codec) {
+        case EntryCodec::STORE:
+            return "store";
+
+        case EntryCodec::DEFLATE:
+            return "deflate";
+
+        case EntryCodec::ZSTD:
+            return "zstd";
+    }
+
+    return "unknown";
+}
+
+double estimateCompressionRatio(const uint8_t* data, size_t size)
+{
+    if(size == 0) {
+        return 1;
+    }
+
+    // Average the entropy of blocks spread evenly over the data, a histogram
+    // over all of them would hide blocks that compress well.
+    auto blockSize = std::min(size, SAMPLE_BLOCK_SIZE);
+    auto blockCount = std::min(SAMPLE_BLOCK_COUNT, size / blockSize);
+
+    double entropy = 0;
+    for(size_t i = 0; i < blockCount; ++i) {
+        auto offset = blockCount > 1 ? (size - blockSize) / (blockCount - 1) * i : 0;
+        entropy += blockEntropy(data + offset, blockSize);
+    }
+
+    return entropy / blockCount / 8;
+}
+
+vector<uint8_t> EntryLayout::toExtraField() const
+{
+    vector<uint8_t> data;
+    data.reserve(LAYOUT_RECORD_SIZE);
+    data.push_back(version);
+    data.push_back(static_cast<uint8_t>(codec));
+    data.push_back(static_cast<uint8_t>(cipher));
+    data.push_back(0);
+    put32(data, chunkSize);
+    put64(data, size);
+    put32(data, crc);
+    data.insert(data.end(), noncePrefix.begin(), noncePrefix.end());
+
+    return makeExtraField(ENTRY_LAYOUT_EXTRA_ID, data);
+}
+
+bool EntryLayout::fromExtraField(const vector<uint8_t>& extra, EntryLayout& layout)
+{
+    vector<uint8_t> data;
+    if(!findExtraField(extra, ENTRY_LAYOUT_EXTRA_ID, data)) {
+        return false;
+    }
+
+    DG_CHECK(data.size() >= LAYOUT_RECORD_SIZE, "Invalid gbdxm entry layout record");
+
+    layout.version = data[0];
+    layout.codec = static_cast<EntryCodec>(data[1]);
+    layout.cipher = static_cast<EntryCipher>(data[2]);
+    layout.chunkSize = get32(&data[4]);
+    layout.size = get64(&data[8]);
+    layout.crc = get32(&data[16]);
+    std::copy(data.begin() + 20, data.begin() + 28, layout.noncePrefix.begin());
+
+    return true;
+}
+
+vector<uint8_t> frameAad(const string& name, uint32_t index, uint32_t lengthField)
+{
+    vector<uint8_t> aad(name.begin(), name.end());
+    put32(aad, index);
+    put32(aad, lengthField);
+    return aad;
+}
+
+struct EntryEncoder::Chunk
+{
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> dictionary;
+    std::vector<uint8_t> output;
+    size_t size = 0;
+    uint32_t crc = 0;
+    uint32_t index = 0;
+    bool final = false;
+    std::future<void> done;
+};
+
+namespace {
+
+const size_t DICTIONARY_SIZE = 32 << 10;
+
+void deflateChunk(const vector<uint8_t>& data, const vector<uint8_t>& dictionary, int level, bool final,
+                  vector<uint8_t>& output, const string& name)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    DG_CHECK(deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK,
+             "Error initializing compression for %s", name.c_str());
+
+    if(!dictionary.empty()) {
+        deflateSetDictionary(&stream, dictionary.data(), static_cast<uInt>(dictionary.size()));
+    }
+
+    // Non-final chunks end with a sync flush, which leaves the stream on a
+    // byte boundary without marking the last block, so that the next chunk
+    // can be appended to it.
+    int flush = final ? Z_FINISH : Z_SYNC_FLUSH;
+
+    stream.next_in = const_cast<uint8_t*>(data.data());
+    stream.avail_in = static_cast<uInt>(data.size());
+
+    output.resize(deflateBound(&stream, static_cast<uLong>(data.size())) + 16);
+    size_t used = 0;
+    int ret;
+    for(;;) {
+        if(used == output.size()) {
+            output.resize(output.size() * 2);
+        }
+
+        stream.next_out = &output[used];
+        stream.avail_out = static_cast<uInt>(output.size() - used);
+
+        ret = deflate(&stream, flush);
+        used = output.size() - stream.avail_out;
+
+        if(ret == Z_STREAM_ERROR || (stream.avail_out != 0 && (!final || ret == Z_STREAM_END))) {
+            break;
+        }
+    }
+
+    deflateEnd(&stream);
+    DG_CHECK(ret != Z_STREAM_ERROR, "Error compressing %s", name.c_str());
+
+    output.resize(used);
+}
+
+#ifdef GBDXM_HAVE_ZSTD
+void zstdChunk(const vector<uint8_t>& data, int level, vector<uint8_t>& output, const string& name)
+{
+    // Every chunk is a complete frame, a sequence of frames is a valid
+    // Zstandard stream.
+    output.resize(ZSTD_compressBound(data.size()));
+    auto ret = ZSTD_compress(output.data(), output.size(), data.data(), data.size(), level);
+    DG_CHECK(!ZSTD_isError(ret), "Error compressing %s: %s", name.c_str(), ZSTD_getErrorName(ret));
+
+    output.resize(ret);
+}
+#endif
+
+} // namespace
+
+EntryEncoder::EntryEncoder(ZipWriter& zip, const EntryOptions& options) :
+    zip_(zip),
+    options_(options)
+{
+    DG_CHECK(options_.chunkSize > 0 && options_.chunkSize <= MAX_CHUNK_SIZE,
+             "Invalid chunk size %d, must be between 1 and %d bytes", (int) options_.chunkSize, (int) MAX_CHUNK_SIZE);
+    DG_CHECK(isCodecSupported(options_.codec), "This version of gbdxm was built without %s support",
+             codecName(options_.codec));
+
+    switch(options_.codec) {
+        case EntryCodec::STORE:
+            break;
+
+        case EntryCodec::DEFLATE:
+            if(options_.level == DEFAULT_LEVEL) {
+                options_.level = Z_DEFAULT_COMPRESSION;
+            }
+
+            DG_CHECK(options_.level == Z_DEFAULT_COMPRESSION || (options_.level >= 0 && options_.level <= 9),
+                     "Invalid deflate compression level %d, must be between 0 and 9", options_.level);
+            break;
+
+        case EntryCodec::ZSTD:
+#ifdef GBDXM_HAVE_ZSTD
+            if(options_.level == DEFAULT_LEVEL) {
+                options_.level = ZSTD_CLEVEL_DEFAULT;
+            }
+
+            DG_CHECK(options_.level >= ZSTD_minCLevel() && options_.level <= ZSTD_maxCLevel(),
+                     "Invalid zstd compression level %d, must be between %d and %d", options_.level,
+                     ZSTD_minCLevel(), ZSTD_maxCLevel());
+#endif
+            break;
+    }
+}
+
+EntryEncoder::~EntryEncoder()
+{
+    // Chunks may still be in flight if we're unwinding from an error
+    waitAll();
+}
+
+void EntryEncoder::begin(const string& name)
+{
+    begin(name, options_.codec);
+}
+
+void EntryEncoder::begin(const string& name, EntryCodec codec, uint64_t size)
+{
+    DG_CHECK(codec == options_.codec || codec == EntryCodec::STORE, "Cannot compress %s with %s",
+             name.c_str(), codecName(codec));
+
+    name_ = name;
+
+    layout_ = EntryLayout();
+    layout_.codec = codec;
+    layout_.cipher = options_.key ? EntryCipher::AES_256_GCM : EntryCipher::NONE;
+    layout_.chunkSize = static_cast<uint32_t>(options_.chunkSize);
+    layout_.crc = crc32(0, Z_NULL, 0);
+    if(options_.key) {
+        randomBytes(layout_.noncePrefix.data(), layout_.noncePrefix.size());
+    }
+
+    chunkIndex_ = 0;
+    payloadCrc_ = crc32(0, Z_NULL, 0);
+    payloadSize_ = 0;
+    frameOffsets_.clear();
+    chunk_.clear();
+    chunk_.reserve(options_.chunkSize);
+    dictionary_.clear();
+
+    // Encrypted data is not compressible, so encrypted entries are always
+    // stored as far as zip is concerned.
+    auto method = ZIP_METHOD_STORE;
+    if(!options_.key && layout_.codec == EntryCodec::DEFLATE) {
+        method = ZIP_METHOD_DEFLATE;
+    } else if(!options_.key && layout_.codec == EntryCodec::ZSTD) {
+        method = ZIP_METHOD_ZSTD;
+    }
+
+    DG_CHECK(!zip_.isSequential() || method != ZIP_METHOD_STORE || options_.key || size != UNKNOWN_SIZE,
+             "The size of %s must be known up front to store it uncompressed in %s", name.c_str(),
+             zip_.fileName().c_str());
+
+    // The local layout record is only updated with the final CRC and size if
+    // the archive can seek
+    expectedSize_ = size;
+    auto localLayout = layout_;
+    if(size != UNKNOWN_SIZE) {
+        localLayout.size = size;
+    }
+
+    // Compressed and encrypted data can come out a little larger than it
+    // went in, so entries that get close to 4 GB get Zip64 sizes as well
+    bool zip64 = size == UNKNOWN_SIZE || size >= ZIP64_LIMIT - ZIP64_LIMIT / 16;
+    zip_.beginEntry(name, method, localLayout.toExtraField(), zip64);
+}
+
+void EntryEncoder::write(const uint8_t* data, size_t size)
+{
+    while(size > 0) {
+        // Hold on to a full chunk until more data comes in, so that the
+        // last chunk can be marked as final.
+        if(chunk_.size() == options_.chunkSize) {
+            submitChunk(false);
+        }
+
+        auto count = std::min(size, options_.chunkSize - chunk_.size());
+        {
+            // Mapped model files are paged in here
+            ActionStats::Timer timer(options_.stats, "read", count);
+            chunk_.insert(chunk_.end(), data, data + count);
+        }
+        data += count;
+        size -= count;
+    }
+}
+
+const EntryLayout& EntryEncoder::end()
+{
+    submitChunk(true);
+    while(!pending_.empty()) {
+        writeChunk();
+    }
+
+    DG_CHECK(expectedSize_ == UNKNOWN_SIZE || layout_.size == expectedSize_,
+             "Size of %s changed while it was being packed", name_.c_str());
+
+    if(options_.key) {
+        writeChunkTable();
+        zip_.endEntry(payloadCrc_, payloadSize_, layout_.toExtraField());
+    } else {
+        zip_.endEntry(layout_.crc, layout_.size, layout_.toExtraField());
+    }
+
+    return layout_;
+}
+
+void EntryEncoder::submitChunk(bool final)
+{
+    DG_CHECK(chunkIndex_ < 0xffffffffu, "Too many chunks in %s", name_.c_str());
+
+    std::shared_ptr<Chunk> chunk(new Chunk);
+    chunk->data.swap(chunk_);
+    chunk->size = chunk->data.size();
+    chunk->index = chunkIndex_++;
+    chunk->final = final;
+    chunk_.reserve(options_.chunkSize);
+
+    if(layout_.codec == EntryCodec::DEFLATE && layout_.cipher == EntryCipher::NONE) {
+        chunk->dictionary = dictionary_;
+
+        auto dictionarySize = std::min(chunk->data.size(), DICTIONARY_SIZE);
+        dictionary_.assign(chunk->data.end() - dictionarySize, chunk->data.end());
+    }
+
+    if(options_.pool) {
+        auto options = options_;
+        auto layout = layout_;
+        auto name = name_;
+        auto chunkPtr = chunk.get();
+        chunk->done = options_.pool->submit([chunkPtr, options, layout, name]() {
+            encodeChunk(*chunkPtr, options, layout, name);
+        });
+
+        pending_.push_back(chunk);
+
+        // Keep every thread busy, but bound the number of chunks in memory
+        while(pending_.size() > 2 * options_.pool->size()) {
+            writeChunk();
+        }
+    } else {
+        encodeChunk(*chunk, options_, layout_, name_);
+        pending_.push_back(chunk);
+        writeChunk();
+    }
+}
+
+void EntryEncoder::writeChunk()
+{
+    auto chunk = pending_.front();
+    pending_.pop_front();
+
+    if(chunk->done.valid()) {
+        chunk->done.get();
+    }
+
+    layout_.crc = crc32_combine(layout_.crc, chunk->crc, static_cast<z_off_t>(chunk->size));
+    layout_.size += chunk->size;
+
+    if(options_.key) {
+        payloadCrc_ = crc32(payloadCrc_, chunk->output.data(), static_cast<uInt>(chunk->output.size()));
+        frameOffsets_.push_back(payloadSize_);
+    }
+
+    payloadSize_ += chunk->output.size();
+
+    ActionStats::Timer timer(options_.stats, "write", chunk->output.size());
+    zip_.write(chunk->output.data(), chunk->output.size());
+}
+
+void EntryEncoder::writeChunkTable()
+{
+    vector<uint8_t> table;
+    table.reserve(frameOffsets_.size() * 8 + CHUNK_TABLE_TRAILER_SIZE);
+    for(auto offset : frameOffsets_) {
+        put64(table, offset);
+    }
+
+    put32(table, static_cast<uint32_t>(frameOffsets_.size()));
+    put32(table, CHUNK_TABLE_MAGIC);
+
+    payloadCrc_ = crc32(payloadCrc_, table.data(), static_cast<uInt>(table.size()));
+    payloadSize_ += table.size();
+    zip_.write(table.data(), table.size());
+}
+
+void EntryEncoder::waitAll()
+{
+    for(const auto& chunk : pending_) {
+        if(chunk->done.valid()) {
+            chunk->done.wait();
+        }
+    }
+
+    pending_.clear();
+}
+
+void EntryEncoder::encodeChunk(Chunk& chunk, const EntryOptions& options, const EntryLayout& layout, const string& name)
+{
+    {
+        ActionStats::Timer timer(options.stats, "checksum", chunk.data.size());
+        chunk.crc = crc32(crc32(0, Z_NULL, 0), chunk.data.data(), static_cast<uInt>(chunk.data.size()));
+    }
+
+    vector<uint8_t> compressed;
+    switch(layout.codec) {
+        case EntryCodec::DEFLATE:
+        {
+            ActionStats::Timer timer(options.stats, "compress", chunk.data.size());
+            deflateChunk(chunk.data, chunk.dictionary, options.level, chunk.final, compressed, name);
+            break;
+        }
+
+#ifdef GBDXM_HAVE_ZSTD
+        case EntryCodec::ZSTD:
+        {
+            ActionStats::Timer timer(options.stats, "compress", chunk.data.size());
+            zstdChunk(chunk.data, options.level, compressed, name);
+            break;
+        }
+#endif
+
+        default:
+            compressed.swap(chunk.data);
+            break;
+    }
+
+    // Release the input as soon as we're done with it
+    vector<uint8_t>().swap(chunk.data);
+    vector<uint8_t>().swap(chunk.dictionary);
+
+    if(layout.cipher == EntryCipher::NONE) {
+        chunk.output.swap(compressed);
+        return;
+    }
+
+    auto length = static_cast<uint32_t>(compressed.size());
+    auto lengthField = length | (chunk.final ? FINAL_FRAME_FLAG : 0);
+
+    uint8_t nonce[NONCE_SIZE];
+    makeNonce(layout, chunk.index, nonce);
+    auto aad = frameAad(name, chunk.index, lengthField);
+
+    chunk.output.clear();
+    put32(chunk.output, lengthField);
+    chunk.output.resize(4 + length + TAG_SIZE);
+
+    ActionStats::Timer timer(options.stats, "encrypt", length);
+    ChunkCipher cipher(*options.key);
+    cipher.seal(nonce, aad.data(), aad.size(), compressed.data(), length, &chunk.output[4], &chunk.output[4 + length]);
+}
+
+EntryDecoder::EntryDecoder(const ZipReader& zip, const ZipEntry& entry, const PackageKey* key, ThreadPool* pool) :
+    zip_(zip),
+    entry_(entry),
+    key_(key),
+    pool_(pool)
+{
+    memset(&stream_, 0, sizeof(stream_));
+
+    haveLayout_ = EntryLayout::fromExtraField(entry.extra, layout_);
+    if(haveLayout_) {
+        checkLayout(layout_, entry.name, key_);
+        codec_ = layout_.codec;
+    } else {
+        codec_ = methodCodec(entry);
+    }
+
+    dataOffset_ = zip_.dataOffset(entry_);
+}
+
+EntryDecoder::~EntryDecoder()
+{
+    if(streamInit_) {
+        inflateEnd(&stream_);
+    }
+
+#ifdef GBDXM_HAVE_ZSTD
+    ZSTD_freeDStream(zstdStream_);
+#endif
+}
+
+uint64_t EntryDecoder::size() const
+{
+    return haveLayout_ ? layout_.size : entry_.size;
+}
+
+bool EntryDecoder::isSeekable() const
+{
+    return haveChunkTable() || (codec_ == EntryCodec::STORE && !isEncrypted());
+}
+
+void EntryDecoder::decode(const Sink& sink)
+{
+    uint32_t crc = crc32(0, Z_NULL, 0);
+    uint64_t size = 0;
+    Sink checkedSink = [&crc, &size, &sink](const uint8_t* data, size_t count) {
+        crc = crc32(crc, data, static_cast<uInt>(count));
+        size += count;
+        sink(data, count);
+    };
+
+    stopped_ = false;
+    if(haveChunkTable()) {
+        decodeChunks(checkedSink);
+    } else {
+        if(codec_ == EntryCodec::DEFLATE) {
+            if(!streamInit_) {
+                DG_CHECK(inflateInit2(&stream_, -MAX_WBITS) == Z_OK, "Error initializing decompression for %s", entry_.name.c_str());
+                streamInit_ = true;
+            } else {
+                inflateReset(&stream_);
+            }
+        }
+
+#ifdef GBDXM_HAVE_ZSTD
+        if(codec_ == EntryCodec::ZSTD) {
+            if(!zstdStream_) {
+                zstdStream_ = ZSTD_createDStream();
+                DG_CHECK(zstdStream_, "Error initializing decompression for %s", entry_.name.c_str());
+            }
+
+            ZSTD_initDStream(zstdStream_);
+        }
+#endif
+
+        streamEnd_ = false;
+        if(codec_ != EntryCodec::STORE) {
+            output_.resize(INFLATE_BUFFER_SIZE);
+        }
+
+        if(isEncrypted()) {
+            decodeFrames(checkedSink);
+        } else {
+            decodeRaw(checkedSink);
+        }
+
+        if(stopped_) {
+            return;
+        }
+
+        DG_CHECK(codec_ == EntryCodec::STORE || streamEnd_, "Compressed data for %s is truncated", entry_.name.c_str());
+    }
+
+    if(stopped_) {
+        return;
+    }
+
+    auto expectedCrc = haveLayout_ ? layout_.crc : entry_.crc;
+    DG_CHECK(size == this->size(), "Size mismatch in %s: expected %llu bytes, got %llu", entry_.name.c_str(),
+             (unsigned long long) this->size(), (unsigned long long) size);
+    DG_CHECK(crc == expectedCrc, "CRC mismatch in %s, the package is corrupt", entry_.name.c_str());
+}
+
+void EntryDecoder::readAt(uint64_t offset, void* data, size_t size)
+{
+    DG_CHECK(offset <= this->size() && size <= this->size() - offset,
+             "Cannot read past the end of %s", entry_.name.c_str());
+    DG_CHECK(isSeekable(), "%s is compressed as a single stream and can only be read from the start",
+             entry_.name.c_str());
+
+    if(!haveChunkTable()) {
+        ActionStats::Timer timer(stats_, "read", size);
+        zip_.readAt(dataOffset_ + offset, data, size);
+        return;
+    }
+
+    loadChunkTable();
+
+    auto out = static_cast<uint8_t*>(data);
+    while(size > 0) {
+        auto index = static_cast<uint32_t>(offset / layout_.chunkSize);
+        if(cachedIndex_ != static_cast<int64_t>(index)) {
+            decodeChunk(index, cachedChunk_);
+            cachedIndex_ = index;
+        }
+
+        auto chunkOffset = static_cast<size_t>(offset - static_cast<uint64_t>(index) * layout_.chunkSize);
+        auto count = std::min(size, cachedChunk_.size() - chunkOffset);
+        memcpy(out, &cachedChunk_[chunkOffset], count);
+
+        out += count;
+        offset += count;
+        size -= count;
+    }
+}
+
+bool EntryDecoder::isEncrypted() const
+{
+    return haveLayout_ && layout_.cipher != EntryCipher::NONE;
+}
+
+bool EntryDecoder::haveChunkTable() const
+{
+    return isEncrypted() && layout_.version >= 2;
+}
+
+uint32_t EntryDecoder::chunkCount() const
+{
+    if(layout_.size == 0) {
+        return 1;
+    }
+
+    return static_cast<uint32_t>((layout_.size + layout_.chunkSize - 1) / layout_.chunkSize);
+}
+
+void EntryDecoder::loadChunkTable()
+{
+    if(!chunkTable_.empty()) {
+        return;
+    }
+
+    DG_CHECK(entry_.compressedSize >= CHUNK_TABLE_TRAILER_SIZE, "Chunk table of %s is missing", entry_.name.c_str());
+
+    uint8_t trailer[CHUNK_TABLE_TRAILER_SIZE];
+    zip_.readAt(dataOffset_ + entry_.compressedSize - sizeof(trailer), trailer, sizeof(trailer));
+
+    auto count = get32(trailer);
+    DG_CHECK(get32(trailer + 4) == CHUNK_TABLE_MAGIC && count == chunkCount(),
+             "Invalid chunk table in %s, the package is corrupt", entry_.name.c_str());
+
+    auto tableSize = static_cast<uint64_t>(count) * 8;
+    DG_CHECK(tableSize + sizeof(trailer) <= entry_.compressedSize,
+             "Invalid chunk table in %s, the package is corrupt", entry_.name.c_str());
+    framesEnd_ = entry_.compressedSize - sizeof(trailer) - tableSize;
+
+    vector<uint8_t> table(static_cast<size_t>(tableSize));
+    zip_.readAt(dataOffset_ + framesEnd_, table.data(), table.size());
+
+    chunkTable_.resize(count);
+    for(uint32_t i = 0; i < count; ++i) {
+        chunkTable_[i] = get64(&table[i * 8]);
+        DG_CHECK(chunkTable_[i] < framesEnd_ && (i == 0 ? chunkTable_[i] == 0 : chunkTable_[i] > chunkTable_[i - 1]),
+                 "Invalid chunk table in %s, the package is corrupt", entry_.name.c_str());
+    }
+}
+
+bool EntryDecoder::readFrame(ChunkCipher& cipher, uint32_t index, uint64_t offset, uint64_t end,
+                             vector<uint8_t>& plain, uint64_t& next) const
+{
+    DG_CHECK(offset + 4 <= end, "Encrypted data for %s is truncated", entry_.name.c_str());
+
+    uint8_t lengthBytes[4];
+    {
+        ActionStats::Timer timer(stats_, "read", sizeof(lengthBytes));
+        zip_.readAt(dataOffset_ + offset, lengthBytes, sizeof(lengthBytes));
+    }
+    auto lengthField = get32(lengthBytes);
+    auto length = lengthField & ~EntryEncoder::FINAL_FRAME_FLAG;
+    bool final = (lengthField & EntryEncoder::FINAL_FRAME_FLAG) != 0;
+
+    DG_CHECK(length <= maxFrameSize(layout_.chunkSize) && offset + 4 + length + TAG_SIZE <= end,
+             "Invalid chunk %u in %s, the package is corrupt", index, entry_.name.c_str());
+
+    vector<uint8_t> frame(length + TAG_SIZE);
+    {
+        ActionStats::Timer timer(stats_, "read", frame.size());
+        zip_.readAt(dataOffset_ + offset + 4, frame.data(), frame.size());
+    }
+
+    openFrame(cipher, layout_, entry_.name, index, lengthField, frame, plain, stats_);
+
+    next = offset + 4 + length + TAG_SIZE;
+    return final;
+}
+
+void EntryDecoder::decodeChunk(uint32_t index, vector<uint8_t>& output) const
+{
+    auto count = static_cast<uint32_t>(chunkTable_.size());
+    DG_CHECK(index < count, "Chunk %u is out of range in %s", index, entry_.name.c_str());
+
+    ChunkCipher cipher(*key_);
+    auto end = index + 1 < count ? chunkTable_[index + 1] : framesEnd_;
+
+    vector<uint8_t> plain;
+    uint64_t next;
+    bool final = readFrame(cipher, index, chunkTable_[index], end, plain, next);
+    DG_CHECK(final == (index + 1 == count) && next == end, "Invalid chunk %u in %s, the package is corrupt",
+             index, entry_.name.c_str());
+
+    // Encrypted chunks are compressed independently of each other, so each
+    // one inflates on its own
+    auto expectedSize = static_cast<size_t>(std::min<uint64_t>(layout_.chunkSize,
+                                                               layout_.size - static_cast<uint64_t>(index) * layout_.chunkSize));
+    auto size = decompressChunk(codec_, plain, final, expectedSize, output, entry_.name, index, stats_);
+    DG_CHECK(size == expectedSize, "Invalid chunk %u in %s, the package is corrupt", index, entry_.name.c_str());
+}
+
+void EntryDecoder::decodeChunks(const Sink& sink)
+{
+    loadChunkTable();
+
+    struct DecodedChunk
+    {
+        vector<uint8_t> data;
+        std::future<void> done;
+    };
+
+    std::deque<std::shared_ptr<DecodedChunk>> pending;
+    auto maxPending = pool_ ? 2 * pool_->size() : 0;
+
+    auto writeFront = [&pending, &sink]() {
+        auto chunk = pending.front();
+        pending.pop_front();
+
+        if(chunk->done.valid()) {
+            chunk->done.get();
+        }
+
+        sink(chunk->data.data(), chunk->data.size());
+    };
+
+    try {
+        auto count = static_cast<uint32_t>(chunkTable_.size());
+        for(uint32_t index = 0; index < count && !stopped_; ++index) {
+            std::shared_ptr<DecodedChunk> chunk(new DecodedChunk);
+            if(pool_) {
+                auto chunkPtr = chunk.get();
+                chunk->done = pool_->submit([this, index, chunkPtr]() {
+                    decodeChunk(index, chunkPtr->data);
+                });
+            } else {
+                decodeChunk(index, chunk->data);
+            }
+
+            pending.push_back(chunk);
+            while(pending.size() > maxPending) {
+                writeFront();
+            }
+        }
+
+        while(!pending.empty() && !stopped_) {
+            writeFront();
+        }
+
+        // Chunks still in flight when the sink stops decoding
+        for(const auto& chunk : pending) {
+            if(chunk->done.valid()) {
+                chunk->done.wait();
+            }
+        }
+    } catch(...) {
+        // The chunks in flight refer to this decoder, let them finish
+        for(const auto& chunk : pending) {
+            if(chunk->done.valid()) {
+                chunk->done.wait();
+            }
+        }
+
+        throw;
+    }
+}
+
+void EntryDecoder::decodeRaw(const Sink& sink)
+{
+    vector<uint8_t> buffer(haveLayout_ ? layout_.chunkSize : DEFAULT_CHUNK_SIZE);
+
+    auto offset = dataOffset_;
+    auto remaining = entry_.compressedSize;
+    while(remaining > 0 && !stopped_) {
+        auto count = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+        {
+            ActionStats::Timer timer(stats_, "read", count);
+            zip_.readAt(offset, buffer.data(), count);
+        }
+        offset += count;
+        remaining -= count;
+
+        decompressData(buffer.data(), count, sink);
+    }
+}
+
+void EntryDecoder::decodeFrames(const Sink& sink)
+{
+    // Layout version 1 has no chunk table, the frames are read in order
+    ChunkCipher cipher(*key_);
+    uint64_t offset = 0;
+    vector<uint8_t> plain;
+
+    for(uint32_t index = 0; ; ++index) {
+        bool final = readFrame(cipher, index, offset, entry_.compressedSize, plain, offset);
+
+        decompressData(plain.data(), plain.size(), sink);
+
+        if(final || stopped_) {
+            break;
+        }
+    }
+
+    DG_CHECK(stopped_ || offset == entry_.compressedSize, "Unexpected data after the last chunk of %s", entry_.name.c_str());
+}
+
+void EntryDecoder::decompressData(const uint8_t* data, size_t size, const Sink& sink)
+{
+    switch(codec_) {
+        case EntryCodec::DEFLATE:
+            inflateData(data, size, sink);
+            break;
+
+#ifdef GBDXM_HAVE_ZSTD
+        case EntryCodec::ZSTD:
+            zstdData(data, size, sink);
+            break;
+#endif
+
+        default:
+            sink(data, size);
+            break;
+    }
+}
+
+void EntryDecoder::inflateData(const uint8_t* data, size_t size, const Sink& sink)
+{
+    stream_.next_in = const_cast<uint8_t*>(data);
+    stream_.avail_in = static_cast<uInt>(size);
+
+    while(!streamEnd_) {
+        stream_.next_out = output_.data();
+        stream_.avail_out = static_cast<uInt>(output_.size());
+
+        int ret;
+        {
+            ActionStats::Timer timer(stats_, "decompress");
+            ret = inflate(&stream_, Z_NO_FLUSH);
+            timer.addBytes(output_.size() - stream_.avail_out);
+        }
+        DG_CHECK(ret == Z_OK || ret == Z_STREAM_END || ret == Z_BUF_ERROR,
+                 "Error decompressing %s: %s", entry_.name.c_str(), stream_.msg ? stream_.msg : "corrupt data");
+
+        auto count = output_.size() - stream_.avail_out;
+        if(count > 0) {
+            sink(output_.data(), count);
+        }
+
+        if(stopped_) {
+            return;
+        }
+
+        streamEnd_ = ret == Z_STREAM_END;
+        if(stream_.avail_in == 0 && stream_.avail_out != 0) {
+            break;
+        }
+    }
+
+    DG_CHECK(stream_.avail_in == 0, "Unexpected data after the end of compressed %s", entry_.name.c_str());
+}
+
+#ifdef GBDXM_HAVE_ZSTD
+void EntryDecoder::zstdData(const uint8_t* data, size_t size, const Sink& sink)
+{
+    ZSTD_inBuffer input = { data, size, 0 };
+
+    // The entry is a sequence of frames, one per chunk. It's complete once
+    // the last frame is fully decoded and flushed.
+    for(;;) {
+        ZSTD_outBuffer output = { output_.data(), output_.size(), 0 };
+        auto consumed = input.pos;
+
+        size_t ret;
+        {
+            ActionStats::Timer timer(stats_, "decompress");
+            ret = ZSTD_decompressStream(zstdStream_, &output, &input);
+            timer.addBytes(output.pos);
+        }
+        DG_CHECK(!ZSTD_isError(ret), "Error decompressing %s: %s", entry_.name.c_str(), ZSTD_getErrorName(ret));
+
+        if(output.pos > 0) {
+            sink(output_.data(), output.pos);
+        }
+
+        // When the last frame exactly fills the output buffer, the call
+        // after it has nothing left to do and would report the start of
+        // another frame, so only calls that made progress count
+        if(input.pos > consumed || output.pos > 0) {
+            streamEnd_ = ret == 0;
+        }
+
+        if(stopped_ || (input.pos == input.size && output.pos < output.size)) {
+            break;
+        }
+    }
+}
+#endif
+
+EntryStreamDecoder::EntryStreamDecoder(ZipStreamReader& zip, ZipEntry& entry, const PackageKey* key) :
+    zip_(zip),
+    entry_(entry),
+    key_(key)
+{
+    haveLayout_ = EntryLayout::fromExtraField(entry.extra, layout_);
+    if(haveLayout_) {
+        checkLayout(layout_, entry.name, key_);
+        codec_ = layout_.codec;
+    } else {
+        codec_ = methodCodec(entry);
+    }
+
+    // Version 1 frames are one compressed stream, this reader only decodes
+    // chunks compressed on their own
+    DG_CHECK(!isEncrypted() || layout_.version >= 2, "%s was written by an older gbdxm and can only be read from a file",
+             entry.name.c_str());
+    DG_CHECK((entry.flags & ZIP_FLAG_DATA_DESCRIPTOR) == 0 || haveLayout_ || codec_ == EntryCodec::DEFLATE,
+             "The end of %s can't be found without the central directory, it can only be read from a file",
+             entry.name.c_str());
+}
+
+void EntryStreamDecoder::decode(const Sink& sink)
+{
+    uint32_t crc = crc32(0, Z_NULL, 0);
+    uint64_t size = 0;
+    Sink checkedSink = [&crc, &size, &sink](const uint8_t* data, size_t count) {
+        crc = crc32(crc, data, static_cast<uInt>(count));
+        size += count;
+        if(sink) {
+            sink(data, count);
+        }
+    };
+
+    payloadCrc_ = crc32(0, Z_NULL, 0);
+
+    if(isEncrypted()) {
+        decodeFrames(checkedSink);
+    } else if(codec_ == EntryCodec::DEFLATE) {
+        inflateStream(checkedSink);
+#ifdef GBDXM_HAVE_ZSTD
+    } else if(codec_ == EntryCodec::ZSTD) {
+        zstdStream(checkedSink);
+#endif
+    } else {
+        decodeStored(checkedSink);
+    }
+
+    zip_.endEntry(entry_);
+
+    // The zip CRC of encrypted entries covers the frames, the frames
+    // themselves are authenticated
+    if(isEncrypted()) {
+        DG_CHECK(payloadCrc_ == entry_.crc, "CRC mismatch in %s, the package is corrupt", entry_.name.c_str());
+    } else {
+        DG_CHECK(size == entry_.size, "Size mismatch in %s: expected %llu bytes, got %llu", entry_.name.c_str(),
+                 (unsigned long long) entry_.size, (unsigned long long) size);
+        DG_CHECK(crc == entry_.crc, "CRC mismatch in %s, the package is corrupt", entry_.name.c_str());
+    }
+}
+
+bool EntryStreamDecoder::isEncrypted() const
+{
+    return haveLayout_ && layout_.cipher != EntryCipher::NONE;
+}
+
+void EntryStreamDecoder::readPayload(void* data, size_t size)
+{
+    {
+        ActionStats::Timer timer(stats_, "read", size);
+        zip_.readFully(data, size);
+    }
+
+    payloadCrc_ = crc32(payloadCrc_, static_cast<const uint8_t*>(data), static_cast<uInt>(size));
+}
+
+void EntryStreamDecoder::decodeFrames(const Sink& sink)
+{
+    ChunkCipher cipher(*key_);
+    vector<uint64_t> offsets;
+    uint64_t offset = 0;
+    vector<uint8_t> frame;
+    vector<uint8_t> plain;
+    vector<uint8_t> output;
+
+    for(uint32_t index = 0; ; ++index) {
+        uint8_t lengthBytes[4];
+        readPayload(lengthBytes, sizeof(lengthBytes));
+        auto lengthField = get32(lengthBytes);
+        auto length = lengthField & ~EntryEncoder::FINAL_FRAME_FLAG;
+        bool final = (lengthField & EntryEncoder::FINAL_FRAME_FLAG) != 0;
+        DG_CHECK(length <= maxFrameSize(layout_.chunkSize), "Invalid chunk %u in %s, the package is corrupt",
+                 index, entry_.name.c_str());
+
+        frame.resize(length + TAG_SIZE);
+        readPayload(frame.data(), frame.size());
+        offsets.push_back(offset);
+        offset += sizeof(lengthBytes) + frame.size();
+
+        openFrame(cipher, layout_, entry_.name, index, lengthField, frame, plain, stats_);
+        auto size = decompressChunk(codec_, plain, final, layout_.chunkSize, output, entry_.name, index, stats_);
+        DG_CHECK(final || size == layout_.chunkSize, "Invalid chunk %u in %s, the package is corrupt",
+                 index, entry_.name.c_str());
+        sink(output.data(), size);
+
+        if(final) {
+            break;
+        }
+    }
+
+    // The chunk table isn't needed to read the frames in order, but it has
+    // to match them
+    vector<uint8_t> table(offsets.size() * 8 + CHUNK_TABLE_TRAILER_SIZE);
+    readPayload(table.data(), table.size());
+
+    bool valid = get32(&table[offsets.size() * 8]) == offsets.size() &&
+                 get32(&table[offsets.size() * 8 + 4]) == CHUNK_TABLE_MAGIC;
+    for(size_t i = 0; i < offsets.size() && valid; ++i) {
+        valid = get64(&table[i * 8]) == offsets[i];
+    }
+
+    DG_CHECK(valid, "Invalid chunk table in %s, the package is corrupt", entry_.name.c_str());
+}
+
+void EntryStreamDecoder::decodeStored(const Sink& sink)
+{
+    vector<uint8_t> buffer(haveLayout_ ? layout_.chunkSize : DEFAULT_CHUNK_SIZE);
+
+    // Stored entries written to a pipe have their size in the local layout
+    // record instead
+    auto remaining = (entry_.flags & ZIP_FLAG_DATA_DESCRIPTOR) ? layout_.size : entry_.compressedSize;
+    while(remaining > 0) {
+        auto count = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+        {
+            ActionStats::Timer timer(stats_, "read", count);
+            zip_.readFully(buffer.data(), count);
+        }
+        remaining -= count;
+
+        sink(buffer.data(), count);
+    }
+}
+
+void EntryStreamDecoder::inflateStream(const Sink& sink)
+{
+    vector<uint8_t> input(INFLATE_BUFFER_SIZE);
+    vector<uint8_t> output(INFLATE_BUFFER_SIZE);
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    DG_CHECK(inflateInit2(&stream, -MAX_WBITS) == Z_OK, "Error initializing decompression for %s", entry_.name.c_str());
+
+    try {
+        bool end = false;
+        while(!end) {
+            size_t count;
+            {
+                ActionStats::Timer timer(stats_, "read");
+                count = zip_.read(input.data(), input.size());
+                timer.addBytes(count);
+            }
+            DG_CHECK(count > 0, "Compressed data for %s is truncated", entry_.name.c_str());
+
+            stream.next_in = input.data();
+            stream.avail_in = static_cast<uInt>(count);
+
+            do {
+                stream.next_out = output.data();
+                stream.avail_out = static_cast<uInt>(output.size());
+
+                int ret;
+                {
+                    ActionStats::Timer timer(stats_, "decompress");
+                    ret = inflate(&stream, Z_NO_FLUSH);
+                    timer.addBytes(output.size() - stream.avail_out);
+                }
+                DG_CHECK(ret == Z_OK || ret == Z_STREAM_END || ret == Z_BUF_ERROR,
+                         "Error decompressing %s: %s", entry_.name.c_str(), stream.msg ? stream.msg : "corrupt data");
+
+                auto produced = output.size() - stream.avail_out;
+                if(produced > 0) {
+                    sink(output.data(), produced);
+                }
+
+                end = ret == Z_STREAM_END;
+            } while(!end && (stream.avail_in > 0 || stream.avail_out == 0));
+        }
+
+        // Whatever follows the deflate stream belongs to the data descriptor
+        zip_.unread(stream.avail_in);
+    } catch(...) {
+        inflateEnd(&stream);
+        throw;
+    }
+
+    inflateEnd(&stream);
+}
+
+#ifdef GBDXM_HAVE_ZSTD
+void EntryStreamDecoder::zstdStream(const Sink& sink)
+{
+    vector<uint8_t> input(INFLATE_BUFFER_SIZE);
+    vector<uint8_t> output(INFLATE_BUFFER_SIZE);
+
+    std::unique_ptr<ZSTD_DStream, size_t (*)(ZSTD_DStream*)> stream(ZSTD_createDStream(), &ZSTD_freeDStream);
+    DG_CHECK(stream, "Error initializing decompression for %s", entry_.name.c_str());
+    ZSTD_initDStream(stream.get());
+
+    // The entry is a sequence of frames, one per chunk. It ends with the
+    // first frame that isn't followed by another one.
+    bool end = false;
+    while(!end) {
+        size_t count;
+        {
+            ActionStats::Timer timer(stats_, "read");
+            count = zip_.read(input.data(), input.size());
+            timer.addBytes(count);
+        }
+        DG_CHECK(count > 0, "Compressed data for %s is truncated", entry_.name.c_str());
+
+        ZSTD_inBuffer in = { input.data(), count, 0 };
+        for(;;) {
+            ZSTD_outBuffer out = { output.data(), output.size(), 0 };
+
+            size_t ret;
+            {
+                ActionStats::Timer timer(stats_, "decompress");
+                ret = ZSTD_decompressStream(stream.get(), &out, &in);
+                timer.addBytes(out.pos);
+            }
+            DG_CHECK(!ZSTD_isError(ret), "Error decompressing %s: %s", entry_.name.c_str(), ZSTD_getErrorName(ret));
+
+            if(out.pos > 0) {
+                sink(output.data(), out.pos);
+            }
+
+            if(ret == 0) {
+                zip_.unread(in.size - in.pos);
+
+                uint8_t magic[4];
+                end = !zip_.peek(magic, sizeof(magic)) || get32(magic) != ZSTD_MAGICNUMBER;
+                break;
+            }
+
+            if(in.pos == in.size && out.pos < out.size) {
+                break;
+            }
+        }
+    }
+}
+#endif
+
+} } // namespace dg { namespace gbdxm {
@@ -0,0 +1,396 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef DEEPCORE_GBDXM_ENTRYCODEC_H
+#define DEEPCORE_GBDXM_ENTRYCODEC_H
+
+#include "Crypto.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+#include "ZipArchive.h"
+
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <zlib.h>
+
+#ifdef GBDXM_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace dg { namespace gbdxm {
+
+/**
+ * Zip extra field header ID of the gbdxm entry layout record ("GD").
+ */
+const uint16_t ENTRY_LAYOUT_EXTRA_ID = 0x4447;
+const uint8_t ENTRY_LAYOUT_VERSION = 2;
+
+const size_t DEFAULT_CHUNK_SIZE = 1 << 20;
+const size_t MAX_CHUNK_SIZE = 64 << 20;
+
+// Zip compression method ID of Zstandard
+const uint16_t ZIP_METHOD_ZSTD = 93;
+
+// Selects the default compression level of the codec
+const int DEFAULT_LEVEL = std::numeric_limits<int>::min();
+
+// Size of an entry that isn't known until it's written
+const uint64_t UNKNOWN_SIZE = std::numeric_limits<uint64_t>::max();
+
+enum class EntryCodec : uint8_t
+{
+    STORE = 0,
+    DEFLATE = 1,
+    ZSTD = 2
+};
+
+/**
+ * Returns true if gbdxm was built with support for the codec.
+ */
+bool isCodecSupported(EntryCodec codec);
+
+/**
+ * Returns the codec name as used on the command line, e.g. "zstd".
+ */
+const char* codecName(EntryCodec codec);
+
+/**
+ * Entries estimated to compress to more than this fraction of their size are
+ * stored uncompressed when EntryOptions::adaptive is set.
+ */
+const double ADAPTIVE_STORE_RATIO = 0.9;
+
+/**
+ * Estimates how well data compresses from the byte entropy of a few sample
+ * blocks spread over the data. Cheap enough to run on every entry, and a good
+ * match for deflate on float weights, but underestimates how well text
+ * compresses.
+ *
+ * @return The expected compressed size as a fraction of size, from 0 to 1.
+ */
+double estimateCompressionRatio(const uint8_t* data, size_t size);
+
+enum class EntryCipher : uint8_t
+{
+    NONE = 0,
+    AES_256_GCM = 1
+};
+
+/**
+ * Describes how a package entry is chunked, compressed, and encrypted. Stored
+ * in the zip extra field of each entry written by StreamingModelWriter.
+ */
+struct EntryLayout
+{
+    uint8_t version = ENTRY_LAYOUT_VERSION;
+    EntryCodec codec = EntryCodec::DEFLATE;
+    EntryCipher cipher = EntryCipher::NONE;
+    uint32_t chunkSize = DEFAULT_CHUNK_SIZE;
+    uint64_t size = 0;
+    uint32_t crc = 0;
+    std::array<uint8_t, NONCE_SIZE - 4> noncePrefix {};
+
+    std::vector<uint8_t> toExtraField() const;
+
+    /**
+     * Reads the layout from the entry's extra field.
+     * @return false if the entry doesn't have a layout record.
+     */
+    static bool fromExtraField(const std::vector<uint8_t>& extra, EntryLayout& layout);
+};
+
+/**
+ * Options for encoding package entries.
+ */
+struct EntryOptions
+{
+    EntryCodec codec = EntryCodec::DEFLATE;
+
+    // Codec specific compression level: 0 to 9 for deflate, the range
+    // reported by ZSTD_minCLevel() and ZSTD_maxCLevel() for Zstandard
+    int level = DEFAULT_LEVEL;
+    size_t chunkSize = DEFAULT_CHUNK_SIZE;
+
+    // Store entries that don't compress well uncompressed, see
+    // estimateCompressionRatio()
+    bool adaptive = false;
+
+    // Encryption key, entries are written in plaintext if nullptr
+    const PackageKey* key = nullptr;
+
+    // Pool for compressing and encrypting chunks in parallel, chunks are
+    // processed on the calling thread if nullptr
+    ThreadPool* pool = nullptr;
+
+    // Phase timings for --stats, not collected if nullptr
+    ActionStats* stats = nullptr;
+
+    // Start the data of stored entries at a multiple of this many bytes in
+    // the package, see ZipWriter::setAlignment()
+    size_t alignment = 0;
+
+    // Engine model files are read with and packages written with, where
+    // the writer opens them
+    IoEngine ioEngine = IoEngine::SYNC;
+};
+
+/**
+ * Compresses and optionally encrypts a single entry in fixed-size chunks as
+ * the data is written, so that only a few chunks are in memory at a time.
+ *
+ * Each chunk is deflated on its own and ends on a byte boundary, so chunks
+ * can be compressed in parallel and concatenated into one valid deflate
+ * stream, the way pigz does it. Plaintext chunks are primed with the last
+ * 32K of the previous chunk to keep the compression ratio, encrypted chunks
+ * are independent of each other. With Zstandard every chunk is a separate
+ * frame, and concatenated frames are a valid Zstandard stream.
+ *
+ * Plaintext entries are ordinary stored, deflated, or Zstandard (method 93)
+ * zip entries. Encrypted entries are stored zip entries made of
+ * authenticated frames, one per chunk, each holding the compressed chunk:
+ *
+ *   uint32 length | FINAL_FRAME_FLAG, ciphertext[length], tag[16]
+ *
+ * followed by a chunk table with the offset of each frame (layout version 2):
+ *
+ *   uint64 offset[count], uint32 count, uint32 CHUNK_TABLE_MAGIC
+ */
+class EntryEncoder
+{
+public:
+    static const uint32_t FINAL_FRAME_FLAG = 0x80000000u;
+
+    EntryEncoder(ZipWriter& zip, const EntryOptions& options);
+    ~EntryEncoder();
+
+    EntryEncoder(const EntryEncoder&) = delete;
+    EntryEncoder& operator=(const EntryEncoder&) = delete;
+
+    void begin(const std::string& name);
+
+    /**
+     * Begins an entry with a different codec than the options say, either
+     * the same codec or EntryCodec::STORE.
+     * @param size Size of the data that will be written, recorded in the
+     *             local layout record up front. Required for stored
+     *             plaintext entries written to a pipe, their data can't be
+     *             told apart from what follows it otherwise. Entries of
+     *             unknown size or close to 4 GB get Zip64 sizes.
+     */
+    void begin(const std::string& name, EntryCodec codec, uint64_t size = UNKNOWN_SIZE);
+    void write(const uint8_t* data, size_t size);
+    const EntryLayout& end();
+
+private:
+    struct Chunk;
+
+    void submitChunk(bool final);
+    void writeChunk();
+    void writeChunkTable();
+    void waitAll();
+
+    static void encodeChunk(Chunk& chunk, const EntryOptions& options, const EntryLayout& layout, const std::string& name);
+
+    ZipWriter& zip_;
+    EntryOptions options_;
+    EntryLayout layout_;
+    std::string name_;
+    uint64_t expectedSize_ = UNKNOWN_SIZE;
+    uint32_t chunkIndex_ = 0;
+    uint32_t payloadCrc_ = 0;
+    uint64_t payloadSize_ = 0;
+    std::vector<uint64_t> frameOffsets_;
+    std::vector<uint8_t> chunk_;
+    std::vector<uint8_t> dictionary_;
+    std::deque<std::shared_ptr<Chunk>> pending_;
+};
+
+/**
+ * Decodes a package entry in chunks. Handles entries written by
+ * EntryEncoder as well as ordinary stored, deflated, or Zstandard zip
+ * entries.
+ *
+ * Encrypted entries with a chunk table are decoded chunk by chunk, in
+ * parallel if a thread pool is given, and support random access.
+ */
+class EntryDecoder
+{
+public:
+    typedef std::function<void(const uint8_t* data, size_t size)> Sink;
+
+    /**
+     * @param zip Archive to read from.
+     * @param entry Entry to decode.
+     * @param key Decryption key, may be nullptr for plaintext entries.
+     * @param pool Pool for decoding chunks in parallel, may be nullptr.
+     */
+    EntryDecoder(const ZipReader& zip, const ZipEntry& entry, const PackageKey* key, ThreadPool* pool = nullptr);
+    ~EntryDecoder();
+
+    EntryDecoder(const EntryDecoder&) = delete;
+    EntryDecoder& operator=(const EntryDecoder&) = delete;
+
+    const EntryLayout& layout() const { return layout_; }
+    bool haveLayout() const { return haveLayout_; }
+
+    /**
+     * Collects the time spent reading, decrypting, and decompressing, may be
+     * nullptr.
+     */
+    void setStats(ActionStats* stats) { stats_ = stats; }
+
+    /**
+     * Returns the size of the decoded entry.
+     */
+    uint64_t size() const;
+
+    /**
+     * Decodes the whole entry, passing the data to sink one chunk at a time
+     * in order, and checks the CRC.
+     */
+    void decode(const Sink& sink);
+
+    /**
+     * Called from the sink to make decode() return after the current piece
+     * of data. The rest of the entry isn't read, and its CRC isn't checked.
+     */
+    void stop() { stopped_ = true; }
+
+    /**
+     * Returns true if readAt() is supported: the entry is either stored, or
+     * encrypted with a chunk table.
+     */
+    bool isSeekable() const;
+
+    /**
+     * Reads decoded data at the given offset. Only the chunks overlapping
+     * the requested range are decrypted and inflated.
+     */
+    void readAt(uint64_t offset, void* data, size_t size);
+
+private:
+    bool isEncrypted() const;
+    bool haveChunkTable() const;
+    uint32_t chunkCount() const;
+    void loadChunkTable();
+    bool readFrame(ChunkCipher& cipher, uint32_t index, uint64_t offset, uint64_t end,
+                   std::vector<uint8_t>& plain, uint64_t& next) const;
+    void decodeChunk(uint32_t index, std::vector<uint8_t>& output) const;
+    void decodeChunks(const Sink& sink);
+    void decodeFrames(const Sink& sink);
+    void decodeRaw(const Sink& sink);
+    void decompressData(const uint8_t* data, size_t size, const Sink& sink);
+    void inflateData(const uint8_t* data, size_t size, const Sink& sink);
+#ifdef GBDXM_HAVE_ZSTD
+    void zstdData(const uint8_t* data, size_t size, const Sink& sink);
+#endif
+
+    const ZipReader& zip_;
+    const ZipEntry& entry_;
+    const PackageKey* key_;
+    ThreadPool* pool_;
+    ActionStats* stats_ = nullptr;
+    EntryLayout layout_;
+    bool haveLayout_ = false;
+    EntryCodec codec_ = EntryCodec::STORE;
+    uint64_t dataOffset_ = 0;
+    uint64_t framesEnd_ = 0;
+    std::vector<uint64_t> chunkTable_;
+    int64_t cachedIndex_ = -1;
+    std::vector<uint8_t> cachedChunk_;
+    z_stream stream_;
+#ifdef GBDXM_HAVE_ZSTD
+    ZSTD_DStream* zstdStream_ = nullptr;
+#endif
+    bool streamInit_ = false;
+    bool streamEnd_ = false;
+    bool stopped_ = false;
+    std::vector<uint8_t> output_;
+};
+
+/**
+ * Decodes the current entry of a ZipStreamReader front to back, for packages
+ * read from a pipe.
+ *
+ * Entries written to a pipe are followed by a data descriptor and don't say
+ * how long they are, so the end of the data is found from the data itself:
+ * the final frame and chunk table of encrypted entries, the end of the
+ * deflate stream, the last Zstandard frame, or the size in the layout record
+ * of stored entries.
+ */
+class EntryStreamDecoder
+{
+public:
+    typedef EntryDecoder::Sink Sink;
+
+    /**
+     * @param zip Archive to read from, positioned at the entry data.
+     * @param entry Entry from ZipStreamReader::nextEntry(), its CRC and sizes
+     *              are filled in from the data descriptor.
+     * @param key Decryption key, may be nullptr for plaintext entries.
+     */
+    EntryStreamDecoder(ZipStreamReader& zip, ZipEntry& entry, const PackageKey* key);
+
+    EntryStreamDecoder(const EntryStreamDecoder&) = delete;
+    EntryStreamDecoder& operator=(const EntryStreamDecoder&) = delete;
+
+    const EntryLayout& layout() const { return layout_; }
+    bool haveLayout() const { return haveLayout_; }
+
+    /**
+     * Collects the time spent reading, decrypting, and decompressing, may be
+     * nullptr.
+     */
+    void setStats(ActionStats* stats) { stats_ = stats; }
+
+    /**
+     * Decodes the whole entry, passing the data to sink one chunk at a time,
+     * finishes the entry, and checks the CRC. The sink may be empty to skip
+     * the entry.
+     */
+    void decode(const Sink& sink);
+
+private:
+    bool isEncrypted() const;
+    void readPayload(void* data, size_t size);
+    void decodeFrames(const Sink& sink);
+    void decodeStored(const Sink& sink);
+    void inflateStream(const Sink& sink);
+#ifdef GBDXM_HAVE_ZSTD
+    void zstdStream(const Sink& sink);
+#endif
+
+    ZipStreamReader& zip_;
+    ZipEntry& entry_;
+    const PackageKey* key_;
+    ActionStats* stats_ = nullptr;
+    EntryLayout layout_;
+    bool haveLayout_ = false;
+    EntryCodec codec_ = EntryCodec::STORE;
+    uint32_t payloadCrc_ = 0;
+};
+
+/**
+ * Builds the additional authenticated data for an encrypted frame.
+ */
+std::vector<uint8_t> frameAad(const std::string& name, uint32_t index, uint32_t lengthField);
+
+} } // namespace dg { namespace gbdxm {
+
+#endif // DEEPCORE_GBDXM_ENTRYCODEC_H
@@ -0,0 +1,834 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "FileIO.h"
+#include "IoRing.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <mutex>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility/Error.h>
+#include <utility/Logging.h>
+
+namespace dg { namespace gbdxm {
+
+using namespace dg::deepcore;
+
+using std::string;
+using std::vector;
+
+namespace {
+
+// Requests in flight per file with io_uring, and the size of each
+const unsigned IO_QUEUE_DEPTH = 8;
+const size_t IO_BUFFER_SIZE = 1 << 20;
+
+// Largest kernel copy at a time, and the buffer of copies that go through
+// this process
+const size_t MAX_KERNEL_COPY = 1 << 30;
+const size_t COPY_BUFFER_SIZE = 1 << 20;
+
+bool isRegularFile(int fd)
+{
+    struct stat st;
+    return fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+// Errors of copy_file_range() and sendfile() that mean the files can't be
+// copied that way, rather than that the copy failed
+bool isCopyUnsupported(int error)
+{
+    return error == EXDEV || error == EINVAL || error == ENOSYS || error == EOPNOTSUPP || error == EBADF;
+}
+
+void readFullyAt(int fd, uint8_t* data, size_t size, uint64_t offset, const string& fileName)
+{
+    size_t total = 0;
+    while(total < size) {
+        auto ret = ::pread(fd, data + total, size - total, static_cast<off_t>(offset + total));
+        if(ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        DG_CHECK(ret >= 0, "Error reading %s: %s", fileName.c_str(), strerror(errno));
+        DG_CHECK(ret > 0, "Unexpected end of file in %s", fileName.c_str());
+        total += static_cast<size_t>(ret);
+    }
+}
+
+void writeFullyAt(int fd, const uint8_t* data, size_t size, uint64_t offset, const string& fileName)
+{
+    size_t total = 0;
+    while(total < size) {
+        auto ret = ::pwrite(fd, data + total, size - total, static_cast<off_t>(offset + total));
+        if(ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        DG_CHECK(ret > 0, "Error writing to %s: %s", fileName.c_str(), strerror(errno));
+        total += static_cast<size_t>(ret);
+    }
+}
+
+} // namespace {
+
+IoEngine supportedIoEngine(IoEngine engine)
+{
+    if(engine == IoEngine::URING && !IoRing::isSupported()) {
+        // Every batch job asks, only warn once
+        static std::once_flag warned;
+        std::call_once(warned, [] {
+            DG_LOG(gbdxm, warning) << "io_uring is not available, reading and writing files with blocking I/O";
+        });
+
+        return IoEngine::SYNC;
+    }
+
+    return engine;
+}
+
+const char* ioEngineName(IoEngine engine)
+{
+    return engine == IoEngine::URING ? "uring" : "sync";
+}
+
+/**
+ * Reads of an InputFile in flight on an io_uring. Every buffer of the ring
+ * reads the next chunk of the file as soon as read() has used up the one
+ * before, so the disk always has several requests to work on.
+ */
+class InputFile::ReadQueue
+{
+public:
+    ReadQueue(int fd, const string& fileName, uint64_t position, uint64_t end) :
+        ring_(IO_QUEUE_DEPTH, IO_BUFFER_SIZE, fileName),
+        fd_(fd),
+        fileName_(fileName),
+        next_(position),
+        end_(end),
+        offsets_(IO_QUEUE_DEPTH),
+        sizes_(IO_QUEUE_DEPTH),
+        done_(IO_QUEUE_DEPTH)
+    {
+        for(unsigned i = 0; i < ring_.bufferCount() && next_ < end_; ++i) {
+            submit(i);
+        }
+    }
+
+    size_t read(uint8_t* data, size_t size)
+    {
+        size_t total = 0;
+        while(total < size && !order_.empty()) {
+            auto index = order_.front();
+            while(!done_[index]) {
+                complete();
+            }
+
+            auto count = std::min(size - total, sizes_[index] - consumed_);
+            memcpy(data + total, ring_.buffer(index) + consumed_, count);
+            total += count;
+            consumed_ += count;
+
+            if(consumed_ == sizes_[index]) {
+                order_.pop_front();
+                consumed_ = 0;
+                if(next_ < end_) {
+                    submit(index);
+                }
+            }
+        }
+
+        return total;
+    }
+
+private:
+    void submit(unsigned index)
+    {
+        auto size = static_cast<size_t>(std::min<uint64_t>(ring_.bufferSize(), end_ - next_));
+        ring_.read(fd_, index, size, next_);
+        offsets_[index] = next_;
+        sizes_[index] = size;
+        done_[index] = false;
+        order_.push_back(index);
+        next_ += size;
+    }
+
+    void complete()
+    {
+        unsigned index;
+        auto result = ring_.wait(index);
+        DG_CHECK(result >= 0, "Error reading %s: %s", fileName_.c_str(), strerror(-result));
+
+        // The rest of a short read is read the usual way
+        auto count = static_cast<size_t>(result);
+        if(count < sizes_[index]) {
+            readFullyAt(fd_, ring_.buffer(index) + count, sizes_[index] - count, offsets_[index] + count, fileName_);
+        }
+
+        done_[index] = true;
+    }
+
+    IoRing ring_;
+    int fd_;
+    string fileName_;
+    uint64_t next_;
+    uint64_t end_;
+    vector<uint64_t> offsets_;
+    vector<size_t> sizes_;
+    vector<bool> done_;
+
+    // Buffers in file order, and how much of the first one was read
+    std::deque<unsigned> order_;
+    size_t consumed_ = 0;
+};
+
+/**
+ * Writes of an OutputFile in flight on an io_uring. Data is gathered in one
+ * buffer of the ring at a time, which is written once full while the next
+ * one fills up.
+ */
+class OutputFile::WriteQueue
+{
+public:
+    WriteQueue(int fd, const string& fileName) :
+        ring_(IO_QUEUE_DEPTH, IO_BUFFER_SIZE, fileName),
+        fd_(fd),
+        fileName_(fileName),
+        offsets_(IO_QUEUE_DEPTH),
+        sizes_(IO_QUEUE_DEPTH)
+    {
+        for(unsigned i = 0; i < ring_.bufferCount(); ++i) {
+            free_.push_back(i);
+        }
+    }
+
+    void write(uint64_t offset, const uint8_t* data, size_t size)
+    {
+        while(size > 0) {
+            if(current_ < 0) {
+                if(free_.empty()) {
+                    complete();
+                }
+
+                current_ = static_cast<int>(free_.back());
+                free_.pop_back();
+                offsets_[current_] = offset;
+                sizes_[current_] = 0;
+            }
+
+            auto& fill = sizes_[current_];
+            auto count = std::min(size, ring_.bufferSize() - fill);
+            memcpy(ring_.buffer(static_cast<unsigned>(current_)) + fill, data, count);
+            fill += count;
+            data += count;
+            size -= count;
+            offset += count;
+
+            if(fill == ring_.bufferSize()) {
+                submit();
+            }
+        }
+    }
+
+    void flush()
+    {
+        if(current_ >= 0) {
+            submit();
+        }
+
+        while(ring_.inFlight() > 0) {
+            complete();
+        }
+    }
+
+private:
+    void submit()
+    {
+        auto index = static_cast<unsigned>(current_);
+        current_ = -1;
+        ring_.write(fd_, index, sizes_[index], offsets_[index]);
+    }
+
+    void complete()
+    {
+        unsigned index;
+        auto result = ring_.wait(index);
+        DG_CHECK(result >= 0, "Error writing to %s: %s", fileName_.c_str(), strerror(-result));
+
+        // The rest of a short write is written the usual way
+        auto count = static_cast<size_t>(result);
+        if(count < sizes_[index]) {
+            writeFullyAt(fd_, ring_.buffer(index) + count, sizes_[index] - count, offsets_[index] + count, fileName_);
+        }
+
+        free_.push_back(index);
+    }
+
+    IoRing ring_;
+    int fd_;
+    string fileName_;
+    vector<uint64_t> offsets_;
+    vector<size_t> sizes_;
+    vector<unsigned> free_;
+
+    // Buffer being filled, -1 if none
+    int current_ = -1;
+};
+
+InputFile::InputFile() = default;
+
+InputFile::InputFile(const string& fileName)
+{
+    open(fileName);
+}
+
+InputFile::InputFile(const void* data, size_t size, const string& name) :
+    fileName_(name),
+    memory_(static_cast<const uint8_t*>(data)),
+    memorySize_(size)
+{
+    DG_CHECK(memory_ != nullptr || size == 0, "No data given for %s", name.c_str());
+
+    // An empty buffer is still open
+    static const uint8_t empty = 0;
+    if(memory_ == nullptr) {
+        memory_ = &empty;
+    }
+}
+
+InputFile::InputFile(InputFile&& other) :
+    fd_(other.fd_),
+    fileName_(std::move(other.fileName_)),
+    memory_(other.memory_),
+    memorySize_(other.memorySize_),
+    memoryPosition_(other.memoryPosition_),
+    queue_(std::move(other.queue_))
+{
+    other.fd_ = -1;
+    other.memory_ = nullptr;
+}
+
+InputFile& InputFile::operator=(InputFile&& other)
+{
+    if(this != &other) {
+        close();
+        fd_ = other.fd_;
+        fileName_ = std::move(other.fileName_);
+        memory_ = other.memory_;
+        memorySize_ = other.memorySize_;
+        memoryPosition_ = other.memoryPosition_;
+        queue_ = std::move(other.queue_);
+        other.fd_ = -1;
+        other.memory_ = nullptr;
+    }
+
+    return *this;
+}
+
+InputFile::~InputFile()
+{
+    close();
+}
+
+void InputFile::open(const string& fileName)
+{
+    close();
+
+    fd_ = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    DG_CHECK(fd_ >= 0, "Error opening %s for reading: %s", fileName.c_str(), strerror(errno));
+    fileName_ = fileName;
+}
+
+void InputFile::close()
+{
+    queue_.reset();
+
+    if(fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+    memory_ = nullptr;
+}
+
+uint64_t InputFile::size() const
+{
+    if(memory_) {
+        return memorySize_;
+    }
+
+    struct stat st;
+    DG_CHECK(fstat(fd_, &st) == 0, "Error reading size of %s: %s", fileName_.c_str(), strerror(errno));
+    return static_cast<uint64_t>(st.st_size);
+}
+
+InputFile InputFile::standardInput()
+{
+    // Closing the duplicate leaves standard input open
+    InputFile file;
+    file.fd_ = ::fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+    DG_CHECK(file.fd_ >= 0, "Error opening standard input: %s", strerror(errno));
+    file.fileName_ = "standard input";
+    return file;
+}
+
+void InputFile::queueReads(IoEngine engine)
+{
+    if(queue_ || engine != IoEngine::URING || !IoRing::isSupported() || !isRegularFile(fd_)) {
+        return;
+    }
+
+    auto position = ::lseek(fd_, 0, SEEK_CUR);
+    DG_CHECK(position >= 0, "Error seeking in %s: %s", fileName_.c_str(), strerror(errno));
+
+    try {
+        queue_.reset(new ReadQueue(fd_, fileName_, static_cast<uint64_t>(position), size()));
+    } catch(const std::exception& e) {
+        DG_LOG(gbdxm, warning) << "Reading " << fileName_ << " with blocking I/O: " << e.what();
+    }
+}
+
+size_t InputFile::read(void* data, size_t size)
+{
+    if(queue_) {
+        return queue_->read(static_cast<uint8_t*>(data), size);
+    }
+
+    if(memory_) {
+        auto count = static_cast<size_t>(std::min<uint64_t>(size, memorySize_ - memoryPosition_));
+        memcpy(data, memory_ + memoryPosition_, count);
+        memoryPosition_ += count;
+        return count;
+    }
+
+    auto out = static_cast<uint8_t*>(data);
+    size_t total = 0;
+    while(total < size) {
+        auto ret = ::read(fd_, out + total, size - total);
+        if(ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        DG_CHECK(ret >= 0, "Error reading %s: %s", fileName_.c_str(), strerror(errno));
+        if(ret == 0) {
+            break;
+        }
+
+        total += static_cast<size_t>(ret);
+    }
+
+    return total;
+}
+
+void InputFile::readAt(uint64_t offset, void* data, size_t size) const
+{
+    if(memory_) {
+        DG_CHECK(offset <= memorySize_ && size <= memorySize_ - offset, "Unexpected end of file in %s",
+                 fileName_.c_str());
+        memcpy(data, memory_ + offset, size);
+        return;
+    }
+
+    readFullyAt(fd_, static_cast<uint8_t*>(data), size, offset, fileName_);
+}
+
+OutputFile::OutputFile() = default;
+
+OutputFile::OutputFile(const string& fileName)
+{
+    open(fileName);
+}
+
+OutputFile::OutputFile(std::vector<uint8_t>& buffer, const string& name) :
+    fileName_(name),
+    memory_(&buffer)
+{
+    buffer.clear();
+}
+
+OutputFile::OutputFile(OutputFile&& other) :
+    fd_(other.fd_),
+    fileName_(std::move(other.fileName_)),
+    position_(other.position_),
+    memory_(other.memory_),
+    queue_(std::move(other.queue_))
+{
+    other.fd_ = -1;
+    other.memory_ = nullptr;
+}
+
+OutputFile& OutputFile::operator=(OutputFile&& other)
+{
+    if(this != &other) {
+        close();
+        fd_ = other.fd_;
+        fileName_ = std::move(other.fileName_);
+        position_ = other.position_;
+        memory_ = other.memory_;
+        queue_ = std::move(other.queue_);
+        other.fd_ = -1;
+        other.memory_ = nullptr;
+    }
+
+    return *this;
+}
+
+OutputFile::~OutputFile()
+{
+    // Waits for the writes in flight
+    queue_.reset();
+
+    if(fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+OutputFile OutputFile::standardOutput()
+{
+    OutputFile file;
+    file.fd_ = ::fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    DG_CHECK(file.fd_ >= 0, "Error opening standard output: %s", strerror(errno));
+    file.fileName_ = "standard output";
+
+    // Standard output may be a file that already has data in it
+    auto offset = ::lseek(file.fd_, 0, SEEK_CUR);
+    file.position_ = offset > 0 ? static_cast<uint64_t>(offset) : 0;
+    return file;
+}
+
+void OutputFile::open(const string& fileName)
+{
+    close();
+
+    fd_ = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    DG_CHECK(fd_ >= 0, "Error creating %s: %s", fileName.c_str(), strerror(errno));
+    fileName_ = fileName;
+    position_ = 0;
+}
+
+void OutputFile::openAt(const string& fileName, uint64_t offset)
+{
+    close();
+
+    fd_ = ::open(fileName.c_str(), O_WRONLY | O_CLOEXEC);
+    DG_CHECK(fd_ >= 0, "Error opening %s for writing: %s", fileName.c_str(), strerror(errno));
+    fileName_ = fileName;
+
+    DG_CHECK(::lseek(fd_, static_cast<off_t>(offset), SEEK_SET) >= 0, "Error seeking in %s: %s",
+             fileName.c_str(), strerror(errno));
+    position_ = offset;
+}
+
+void OutputFile::close()
+{
+    memory_ = nullptr;
+
+    // The file is closed even if a queued write failed
+    try {
+        flush();
+    } catch(...) {
+        queue_.reset();
+        ::close(fd_);
+        fd_ = -1;
+        throw;
+    }
+
+    queue_.reset();
+
+    if(fd_ >= 0) {
+        auto ret = ::close(fd_);
+        fd_ = -1;
+        DG_CHECK(ret == 0, "Error closing %s: %s", fileName_.c_str(), strerror(errno));
+    }
+}
+
+void OutputFile::queueWrites(IoEngine engine, uint64_t size)
+{
+    if(queue_ || engine != IoEngine::URING || !IoRing::isSupported() || !isRegularFile(fd_)) {
+        return;
+    }
+
+    // File systems that can't preallocate just grow the file as it's
+    // written, only running out of space is an error
+    if(size > position_) {
+        int ret;
+        do {
+            ret = ::fallocate(fd_, 0, 0, static_cast<off_t>(size));
+        } while(ret != 0 && errno == EINTR);
+
+        DG_CHECK(ret == 0 || (errno != ENOSPC && errno != EFBIG), "Error allocating %llu bytes for %s: %s",
+                 (unsigned long long) size, fileName_.c_str(), strerror(errno));
+    }
+
+    try {
+        queue_.reset(new WriteQueue(fd_, fileName_));
+    } catch(const std::exception& e) {
+        DG_LOG(gbdxm, warning) << "Writing " << fileName_ << " with blocking I/O: " << e.what();
+    }
+}
+
+void OutputFile::write(const void* data, size_t size)
+{
+    if(queue_) {
+        queue_->write(position_, static_cast<const uint8_t*>(data), size);
+        position_ += size;
+        return;
+    }
+
+    if(memory_) {
+        writeAt(position_, data, size);
+        position_ += size;
+        return;
+    }
+
+    auto in = static_cast<const uint8_t*>(data);
+    size_t total = 0;
+    while(total < size) {
+        auto ret = ::write(fd_, in + total, size - total);
+        if(ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        DG_CHECK(ret > 0, "Error writing to %s: %s", fileName_.c_str(), strerror(errno));
+        total += static_cast<size_t>(ret);
+    }
+
+    position_ += size;
+}
+
+void OutputFile::flush()
+{
+    if(queue_) {
+        queue_->flush();
+    }
+}
+
+void OutputFile::truncate()
+{
+    if(memory_) {
+        memory_->resize(static_cast<size_t>(position_));
+        return;
+    }
+
+    flush();
+
+    DG_CHECK(::ftruncate(fd_, static_cast<off_t>(position_)) == 0, "Error truncating %s: %s",
+             fileName_.c_str(), strerror(errno));
+}
+
+void OutputFile::writeAt(uint64_t offset, const void* data, size_t size)
+{
+    auto in = static_cast<const uint8_t*>(data);
+    if(memory_) {
+        DG_CHECK(offset + size <= memory_->max_size(), "%s is too large to keep in memory", fileName_.c_str());
+        if(offset == memory_->size()) {
+            memory_->insert(memory_->end(), in, in + size);
+            return;
+        }
+
+        auto end = static_cast<size_t>(offset + size);
+        if(end > memory_->size()) {
+            memory_->resize(end);
+        }
+
+        std::copy(in, in + size, memory_->begin() + static_cast<size_t>(offset));
+        return;
+    }
+
+    // The range may still be in a queue buffer
+    flush();
+    writeFullyAt(fd_, in, size, offset, fileName_);
+}
+
+void OutputFile::copyFrom(const InputFile& file, uint64_t offset, uint64_t size)
+{
+    bool copyRange = fd_ >= 0 && file.fd() >= 0;
+    bool sendFile = copyRange;
+
+    // The kernel copies to the file position, which queued writes don't move
+    if(copyRange && queue_) {
+        flush();
+        DG_CHECK(::lseek(fd_, static_cast<off_t>(position_), SEEK_SET) >= 0, "Error seeking in %s: %s",
+                 fileName_.c_str(), strerror(errno));
+    }
+
+    vector<uint8_t> buffer;
+    while(size > 0) {
+        auto count = static_cast<size_t>(std::min<uint64_t>(size, MAX_KERNEL_COPY));
+        ssize_t ret;
+        if(copyRange) {
+            loff_t inOffset = static_cast<loff_t>(offset);
+            ret = ::copy_file_range(file.fd(), &inOffset, fd_, nullptr, count, 0);
+            if(ret < 0 && isCopyUnsupported(errno)) {
+                copyRange = false;
+                continue;
+            }
+        } else if(sendFile) {
+            off_t inOffset = static_cast<off_t>(offset);
+            ret = ::sendfile(fd_, file.fd(), &inOffset, count);
+            if(ret < 0 && isCopyUnsupported(errno)) {
+                sendFile = false;
+                continue;
+            }
+        } else {
+            // write() moves the position itself
+            buffer.resize(std::min(count, COPY_BUFFER_SIZE));
+            auto chunk = std::min(count, buffer.size());
+            file.readAt(offset, buffer.data(), chunk);
+            write(buffer.data(), chunk);
+            offset += chunk;
+            size -= chunk;
+            continue;
+        }
+
+        if(ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        DG_CHECK(ret >= 0, "Error copying %s to %s: %s", file.fileName().c_str(), fileName_.c_str(), strerror(errno));
+        DG_CHECK(ret > 0, "Unexpected end of file in %s", file.fileName().c_str());
+        offset += static_cast<uint64_t>(ret);
+        size -= static_cast<uint64_t>(ret);
+        position_ += static_cast<uint64_t>(ret);
+    }
+}
+
+bool OutputFile::cloneFrom(const InputFile& file)
+{
+#ifdef FICLONE
+    if(fd_ < 0 || file.fd() < 0) {
+        return false;
+    }
+
+    flush();
+    if(::ioctl(fd_, FICLONE, file.fd()) < 0) {
+        DG_CHECK(isCopyUnsupported(errno) || errno == ENOTTY, "Error cloning %s to %s: %s", file.fileName().c_str(),
+                 fileName_.c_str(), strerror(errno));
+        return false;
+    }
+
+    position_ = file.size();
+    DG_CHECK(::lseek(fd_, static_cast<off_t>(position_), SEEK_SET) >= 0, "Error seeking in %s: %s",
+             fileName_.c_str(), strerror(errno));
+    return true;
+#else
+    return false;
+#endif
+}
+
+MappedFile::MappedFile(const string& fileName)
+{
+    open(fileName);
+}
+
+MappedFile::MappedFile(MappedFile&& other) :
+    data_(other.data_),
+    size_(other.size_),
+    isOpen_(other.isOpen_),
+    fileName_(std::move(other.fileName_))
+{
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.isOpen_ = false;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+    if(this != &other) {
+        close();
+        data_ = other.data_;
+        size_ = other.size_;
+        isOpen_ = other.isOpen_;
+        fileName_ = std::move(other.fileName_);
+        other.data_ = nullptr;
+        other.size_ = 0;
+        other.isOpen_ = false;
+    }
+
+    return *this;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+void MappedFile::open(const string& fileName)
+{
+    close();
+
+    InputFile file(fileName);
+    auto size = file.size();
+    DG_CHECK(size <= SIZE_MAX, "%s is too large to map", fileName.c_str());
+
+    // mmap() fails on empty files, leave data_ as nullptr instead
+    if(size > 0) {
+        auto data = ::mmap(nullptr, static_cast<size_t>(size), PROT_READ, MAP_PRIVATE, file.fd(), 0);
+        DG_CHECK(data != MAP_FAILED, "Error mapping %s: %s", fileName.c_str(), strerror(errno));
+        data_ = static_cast<const uint8_t*>(data);
+    }
+
+    size_ = static_cast<size_t>(size);
+    isOpen_ = true;
+    fileName_ = fileName;
+}
+
+void MappedFile::close()
+{
+    if(data_ != nullptr) {
+        ::munmap(const_cast<uint8_t*>(data_), size_);
+    }
+
+    data_ = nullptr;
+    size_ = 0;
+    isOpen_ = false;
+}
+
+void MappedFile::adviseSequential() const
+{
+    if(data_ != nullptr) {
+        ::madvise(const_cast<uint8_t*>(data_), size_, MADV_SEQUENTIAL);
+    }
+}
+
+void MappedFile::release(size_t offset, size_t size) const
+{
+    // madvise() needs a page aligned address, only drop whole pages
+    static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    auto begin = (offset + pageSize - 1) / pageSize * pageSize;
+    auto end = std::min(offset + size, size_);
+    if(data_ == nullptr || end <= begin) {
+        return;
+    }
+
+    end = end == size_ ? end : end / pageSize * pageSize;
+    if(end > begin) {
+        ::madvise(const_cast<uint8_t*>(data_) + begin, end - begin, MADV_DONTNEED);
+    }
+}
+
+} } // namespace dg { namespace gbdxm {
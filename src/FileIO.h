@@ -0,0 +1,255 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef DEEPCORE_GBDXM_FILEIO_H
+#define DEEPCORE_GBDXM_FILEIO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dg { namespace gbdxm {
+
+/**
+ * How files set up with InputFile::queueReads() and OutputFile::queueWrites()
+ * are read and written.
+ */
+enum class IoEngine
+{
+    // Blocking reads and writes, one at a time
+    SYNC,
+
+    // Several reads or writes in flight on an io_uring, see IoRing
+    URING
+};
+
+/**
+ * Returns the engine files are read and written with when asked for this
+ * one: SYNC, with a warning the first time, when the kernel or the build
+ * don't support io_uring.
+ */
+IoEngine supportedIoEngine(IoEngine engine);
+const char* ioEngineName(IoEngine engine);
+
+/**
+ * Read-only file opened with a raw file descriptor, used for chunked reads of
+ * large model files. Can also read from a buffer in memory, so that packages
+ * don't have to be on disk.
+ */
+class InputFile
+{
+public:
+    InputFile();
+    explicit InputFile(const std::string& fileName);
+
+    /**
+     * Reads from a memory buffer instead of a file. The buffer must outlive
+     * this object.
+     * @param name Name used in error messages.
+     */
+    InputFile(const void* data, size_t size, const std::string& name);
+    InputFile(InputFile&& other);
+    InputFile& operator=(InputFile&& other);
+    ~InputFile();
+
+    InputFile(const InputFile&) = delete;
+    InputFile& operator=(const InputFile&) = delete;
+
+    /**
+     * Reads standard input, which may be a pipe. Only read() works on a
+     * pipe, readAt() and size() need a regular file.
+     */
+    static InputFile standardInput();
+
+    void open(const std::string& fileName);
+    void close();
+
+    bool isOpen() const { return fd_ >= 0 || memory_ != nullptr; }
+
+    // File descriptor, -1 when reading from memory
+    int fd() const { return fd_; }
+    const std::string& fileName() const { return fileName_; }
+    uint64_t size() const;
+
+    // Buffer being read, nullptr when reading a file
+    const uint8_t* data() const { return memory_; }
+
+    /**
+     * Reads ahead of read() from here on, several chunks at a time, if the
+     * engine is io_uring, it is supported, and this is a regular file. Does
+     * nothing otherwise.
+     */
+    void queueReads(IoEngine engine);
+
+    // Reads up to size bytes from the current position, returns 0 at the end of file
+    size_t read(void* data, size_t size);
+
+    // Reads exactly size bytes at the given offset, throws on a short read
+    void readAt(uint64_t offset, void* data, size_t size) const;
+
+private:
+    class ReadQueue;
+
+    int fd_ = -1;
+    std::string fileName_;
+    const uint8_t* memory_ = nullptr;
+    uint64_t memorySize_ = 0;
+    uint64_t memoryPosition_ = 0;
+    std::unique_ptr<ReadQueue> queue_;
+};
+
+/**
+ * Write-only file opened with a raw file descriptor. Keeps track of the write
+ * position so archive writers can record entry offsets. Can also write to a
+ * buffer in memory.
+ */
+class OutputFile
+{
+public:
+    OutputFile();
+    explicit OutputFile(const std::string& fileName);
+
+    /**
+     * Writes to a memory buffer instead of a file, replacing its contents.
+     * The buffer must outlive this object.
+     * @param name Name used in error messages.
+     */
+    OutputFile(std::vector<uint8_t>& buffer, const std::string& name);
+    OutputFile(OutputFile&& other);
+    OutputFile& operator=(OutputFile&& other);
+    ~OutputFile();
+
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    /**
+     * Writes to standard output, which may be a pipe. Only write() works on
+     * a pipe, writeAt() and truncate() need a regular file.
+     */
+    static OutputFile standardOutput();
+
+    void open(const std::string& fileName);
+
+    /**
+     * Opens an existing file without truncating it, and moves the write
+     * position to the given offset.
+     */
+    void openAt(const std::string& fileName, uint64_t offset);
+    void close();
+
+    bool isOpen() const { return fd_ >= 0 || memory_ != nullptr; }
+
+    // File descriptor, -1 when writing to memory
+    int fd() const { return fd_; }
+    const std::string& fileName() const { return fileName_; }
+    uint64_t position() const { return position_; }
+
+    /**
+     * Keeps several writes in flight from here on if the engine is io_uring,
+     * it is supported, and this is a regular file, does nothing otherwise.
+     * write() then returns once the data is copied to a queue buffer.
+     * writeAt(), truncate(), flush(), and close() wait for the queued writes.
+     * Not thread safe, unlike writeAt() without the queue.
+     * @param size Final size of the file if known, preallocated with
+     *             fallocate() so the file isn't fragmented and a full disk
+     *             shows up before any data is written.
+     */
+    void queueWrites(IoEngine engine, uint64_t size = 0);
+
+    void write(const void* data, size_t size);
+
+    // Waits for the queued writes, see queueWrites()
+    void flush();
+
+    // Cuts the file off at the current position
+    void truncate();
+
+    // Writes at the given offset without moving the current position
+    void writeAt(uint64_t offset, const void* data, size_t size);
+
+    /**
+     * Writes size bytes of another file, starting at offset, at the current
+     * position. The kernel copies them with copy_file_range(), or sendfile()
+     * to a pipe, without going through this process, and file systems that
+     * support it share the blocks instead. Files that can't be copied that
+     * way, e.g. across file systems on older kernels, and memory buffers are
+     * read and written a chunk at a time instead.
+     */
+    void copyFrom(const InputFile& file, uint64_t offset, uint64_t size);
+
+    /**
+     * Replaces this file with the whole of another file by sharing its
+     * blocks with ioctl(FICLONE), which takes the same time whatever the size
+     * of the file. Only file systems with reflinks, e.g. Btrfs and XFS,
+     * support it.
+     * @return false, with the file left as it was, where it isn't supported.
+     */
+    bool cloneFrom(const InputFile& file);
+
+private:
+    class WriteQueue;
+
+    int fd_ = -1;
+    std::string fileName_;
+    uint64_t position_ = 0;
+    std::vector<uint8_t>* memory_ = nullptr;
+    std::unique_ptr<WriteQueue> queue_;
+};
+
+/**
+ * Read-only memory-mapped view of a whole file. Pages are loaded on demand
+ * by the kernel, so mapping a large model file doesn't copy it to the heap.
+ */
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& fileName);
+    MappedFile(MappedFile&& other);
+    MappedFile& operator=(MappedFile&& other);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    void open(const std::string& fileName);
+    void close();
+
+    bool isOpen() const { return isOpen_; }
+    const std::string& fileName() const { return fileName_; }
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    // Tells the kernel the file will be read front to back
+    void adviseSequential() const;
+
+    // Drops the pages in the given range from this process, they are read
+    // from the file again if accessed later
+    void release(size_t offset, size_t size) const;
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    bool isOpen_ = false;
+    std::string fileName_;
+};
+
+} } // namespace dg { namespace gbdxm {
+
+#endif // DEEPCORE_GBDXM_FILEIO_H
@@ -0,0 +1,296 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "IoRing.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <utility/Error.h>
+#include <vector>
+
+#ifdef GBDXM_HAVE_IO_URING
+#include <algorithm>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace dg { namespace gbdxm {
+
+using std::string;
+
+#ifdef GBDXM_HAVE_IO_URING
+
+namespace {
+
+int ioUringSetup(unsigned entries, io_uring_params* params)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+int ioUringRegister(int fd, unsigned opcode, const void* arg, unsigned count)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+void* mapRing(int fd, size_t size, off_t offset)
+{
+    auto ring = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return ring == MAP_FAILED ? nullptr : ring;
+}
+
+template<typename T>
+T* ringField(void* ring, uint32_t offset)
+{
+    return reinterpret_cast<T*>(static_cast<uint8_t*>(ring) + offset);
+}
+
+} // namespace {
+
+IoRing::IoRing(unsigned buffers, size_t bufferSize, const string& name) :
+    name_(name),
+    bufferCount_(buffers),
+    bufferSize_(bufferSize)
+{
+    DG_CHECK(isSupported(), "io_uring is not available for %s", name.c_str());
+    DG_CHECK(buffers > 0 && bufferSize > 0 && bufferSize <= UINT32_MAX, "Invalid io_uring buffers for %s",
+             name.c_str());
+
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd_ = ioUringSetup(buffers, &params);
+    DG_CHECK(fd_ >= 0, "Error setting up io_uring for %s: %s", name.c_str(), strerror(errno));
+
+    try {
+        sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if(params.features & IORING_FEAT_SINGLE_MMAP) {
+            sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+        }
+
+        sqRing_ = mapRing(fd_, sqRingSize_, IORING_OFF_SQ_RING);
+        DG_CHECK(sqRing_ != nullptr, "Error mapping the io_uring of %s: %s", name.c_str(), strerror(errno));
+
+        if(params.features & IORING_FEAT_SINGLE_MMAP) {
+            cqRing_ = sqRing_;
+        } else {
+            cqRing_ = mapRing(fd_, cqRingSize_, IORING_OFF_CQ_RING);
+            DG_CHECK(cqRing_ != nullptr, "Error mapping the io_uring of %s: %s", name.c_str(), strerror(errno));
+        }
+
+        sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = mapRing(fd_, sqesSize_, IORING_OFF_SQES);
+        DG_CHECK(sqes_ != nullptr, "Error mapping the io_uring of %s: %s", name.c_str(), strerror(errno));
+
+        sqTail_ = ringField<unsigned>(sqRing_, params.sq_off.tail);
+        sqMask_ = ringField<unsigned>(sqRing_, params.sq_off.ring_mask);
+        sqArray_ = ringField<unsigned>(sqRing_, params.sq_off.array);
+        cqHead_ = ringField<unsigned>(cqRing_, params.cq_off.head);
+        cqTail_ = ringField<unsigned>(cqRing_, params.cq_off.tail);
+        cqMask_ = ringField<unsigned>(cqRing_, params.cq_off.ring_mask);
+        cqes_ = ringField<io_uring_cqe>(cqRing_, params.cq_off.cqes);
+
+        // Page aligned, so the buffers also work with O_DIRECT
+        void* memory = nullptr;
+        DG_CHECK(::posix_memalign(&memory, 4096, buffers * bufferSize) == 0,
+                 "Error allocating io_uring buffers for %s", name.c_str());
+        buffers_ = static_cast<uint8_t*>(memory);
+
+        // Registration pins the buffers, which counts against the memory
+        // lock limit on older kernels. Unregistered buffers work as well.
+        std::vector<iovec> iovecs(buffers);
+        for(unsigned i = 0; i < buffers; ++i) {
+            iovecs[i].iov_base = buffer(i);
+            iovecs[i].iov_len = bufferSize;
+        }
+
+        registered_ = ioUringRegister(fd_, IORING_REGISTER_BUFFERS, iovecs.data(), buffers) == 0;
+    } catch(...) {
+        release();
+        throw;
+    }
+}
+
+IoRing::~IoRing()
+{
+    // The kernel may still be reading into or writing from the buffers
+    try {
+        unsigned index;
+        while(inFlight_ > 0) {
+            wait(index);
+        }
+    } catch(...) {
+    }
+
+    release();
+}
+
+bool IoRing::isSupported()
+{
+    // A ring of one entry is enough to see the features of the kernel
+    static const bool supported = [] {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        auto fd = ioUringSetup(1, &params);
+        if(fd < 0) {
+            return false;
+        }
+
+        ::close(fd);
+        return (params.features & IORING_FEAT_RW_CUR_POS) != 0;
+    }();
+
+    return supported;
+}
+
+void IoRing::read(int fd, unsigned index, size_t size, uint64_t offset)
+{
+    submit(registered_ ? IORING_OP_READ_FIXED : IORING_OP_READ, fd, index, size, offset);
+}
+
+void IoRing::write(int fd, unsigned index, size_t size, uint64_t offset)
+{
+    submit(registered_ ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE, fd, index, size, offset);
+}
+
+int IoRing::wait(unsigned& index)
+{
+    DG_CHECK(inFlight_ > 0, "No I/O in flight for %s", name_.c_str());
+
+    for(;;) {
+        auto head = *cqHead_;
+        if(head != __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+            const auto& cqe = static_cast<const io_uring_cqe*>(cqes_)[head & *cqMask_];
+            index = static_cast<unsigned>(cqe.user_data);
+            auto result = cqe.res;
+            __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+            --inFlight_;
+            return result;
+        }
+
+        auto ret = ioUringEnter(fd_, 0, 1, IORING_ENTER_GETEVENTS);
+        DG_CHECK(ret >= 0 || errno == EINTR, "Error waiting for I/O on %s: %s", name_.c_str(), strerror(errno));
+    }
+}
+
+void IoRing::submit(uint8_t opcode, int fd, unsigned index, size_t size, uint64_t offset)
+{
+    DG_CHECK(index < bufferCount_ && size <= bufferSize_, "Invalid io_uring request for %s", name_.c_str());
+
+    // This is the only thread adding to the submission queue
+    auto tail = *sqTail_;
+    auto slot = tail & *sqMask_;
+    auto& sqe = static_cast<io_uring_sqe*>(sqes_)[slot];
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = opcode;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<uint64_t>(buffer(index));
+    sqe.len = static_cast<uint32_t>(size);
+    sqe.off = offset;
+    sqe.buf_index = registered_ ? static_cast<uint16_t>(index) : 0;
+    sqe.user_data = index;
+    sqArray_[slot] = slot;
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+
+    int ret;
+    do {
+        ret = ioUringEnter(fd_, 1, 0, 0);
+    } while(ret < 0 && errno == EINTR);
+
+    DG_CHECK(ret == 1, "Error submitting I/O for %s: %s", name_.c_str(), ret < 0 ? strerror(errno) : "queue is full");
+    ++inFlight_;
+}
+
+void IoRing::release()
+{
+    if(sqes_ != nullptr) {
+        ::munmap(sqes_, sqesSize_);
+    }
+
+    if(cqRing_ != nullptr && cqRing_ != sqRing_) {
+        ::munmap(cqRing_, cqRingSize_);
+    }
+
+    if(sqRing_ != nullptr) {
+        ::munmap(sqRing_, sqRingSize_);
+    }
+
+    // Closing the ring unregisters the buffers
+    if(fd_ >= 0) {
+        ::close(fd_);
+    }
+
+    free(buffers_);
+    sqes_ = cqRing_ = sqRing_ = nullptr;
+    buffers_ = nullptr;
+    fd_ = -1;
+}
+
+#else // GBDXM_HAVE_IO_URING
+
+IoRing::IoRing(unsigned buffers, size_t bufferSize, const string& name) :
+    name_(name),
+    bufferCount_(buffers),
+    bufferSize_(bufferSize)
+{
+    DG_ERROR_THROW("io_uring is not available for %s, gbdxm was built without it", name.c_str());
+}
+
+IoRing::~IoRing()
+{
+}
+
+bool IoRing::isSupported()
+{
+    return false;
+}
+
+void IoRing::read(int, unsigned, size_t, uint64_t)
+{
+    DG_ERROR_THROW("gbdxm was built without io_uring");
+}
+
+void IoRing::write(int, unsigned, size_t, uint64_t)
+{
+    DG_ERROR_THROW("gbdxm was built without io_uring");
+}
+
+int IoRing::wait(unsigned&)
+{
+    DG_ERROR_THROW("gbdxm was built without io_uring");
+}
+
+void IoRing::submit(uint8_t, int, unsigned, size_t, uint64_t)
+{
+    DG_ERROR_THROW("gbdxm was built without io_uring");
+}
+
+void IoRing::release()
+{
+}
+
+#endif // GBDXM_HAVE_IO_URING
+
+} } // namespace dg { namespace gbdxm {
@@ -0,0 +1,112 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef DEEPCORE_GBDXM_IORING_H
+#define DEEPCORE_GBDXM_IORING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace dg { namespace gbdxm {
+
+/**
+ * Minimal io_uring submission and completion queue over a fixed set of
+ * equally sized buffers, one request per buffer at a time. Buffers are
+ * registered with the kernel when the memory lock limit allows, which saves
+ * mapping them on every request. Built on the raw system calls, so liburing
+ * isn't needed.
+ *
+ * Not thread safe, each ring belongs to one file being read or written
+ * sequentially.
+ */
+class IoRing
+{
+public:
+    /**
+     * Sets up a ring with buffers buffers of bufferSize bytes each. Throws if
+     * io_uring isn't available, see isSupported().
+     * @param name File name used in error messages.
+     */
+    IoRing(unsigned buffers, size_t bufferSize, const std::string& name);
+
+    // Waits for the requests still in flight, which reference the buffers
+    ~IoRing();
+
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+
+    /**
+     * Returns true if gbdxm was built with io_uring and the kernel supports
+     * reads, writes, and fallocate on it (Linux 5.6 or later). Containers and
+     * kernels may also turn io_uring off.
+     */
+    static bool isSupported();
+
+    unsigned bufferCount() const { return bufferCount_; }
+    size_t bufferSize() const { return bufferSize_; }
+    uint8_t* buffer(unsigned index) const { return buffers_ + index * bufferSize_; }
+    bool isRegistered() const { return registered_; }
+
+    // Number of requests submitted and not yet returned by wait()
+    unsigned inFlight() const { return inFlight_; }
+
+    // Queues a read of size bytes at offset into a buffer and submits it
+    void read(int fd, unsigned index, size_t size, uint64_t offset);
+
+    // Queues a write of the first size bytes of a buffer at offset and submits it
+    void write(int fd, unsigned index, size_t size, uint64_t offset);
+
+    /**
+     * Waits for the next request to complete.
+     * @param index Buffer of the request.
+     * @return Bytes read or written, or a negative errno value.
+     */
+    int wait(unsigned& index);
+
+private:
+    void submit(uint8_t opcode, int fd, unsigned index, size_t size, uint64_t offset);
+    void release();
+
+    int fd_ = -1;
+    std::string name_;
+    unsigned bufferCount_ = 0;
+    size_t bufferSize_ = 0;
+    uint8_t* buffers_ = nullptr;
+    bool registered_ = false;
+    unsigned inFlight_ = 0;
+
+    // Ring memory shared with the kernel
+    void* sqRing_ = nullptr;
+    size_t sqRingSize_ = 0;
+    void* cqRing_ = nullptr;
+    size_t cqRingSize_ = 0;
+    void* sqes_ = nullptr;
+    size_t sqesSize_ = 0;
+
+    unsigned* sqTail_ = nullptr;
+    unsigned* sqMask_ = nullptr;
+    unsigned* sqArray_ = nullptr;
+    unsigned* cqHead_ = nullptr;
+    unsigned* cqTail_ = nullptr;
+    unsigned* cqMask_ = nullptr;
+    void* cqes_ = nullptr;
+};
+
+} } // namespace dg { namespace gbdxm {
+
+#endif // DEEPCORE_GBDXM_IORING_H
@@ -0,0 +1,256 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "JsonFieldScanner.h"
+
+#include <cctype>
+#include <utility/Error.h>
+
+namespace dg { namespace gbdxm {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+// Longest key that is matched against the requested fields, longer keys are
+// skipped without being stored
+const size_t MAX_KEY_SIZE = 256;
+
+bool isSpace(char c)
+{
+    return isspace(static_cast<unsigned char>(c)) != 0;
+}
+
+uint32_t hexValue(char c)
+{
+    DG_CHECK(isxdigit(static_cast<unsigned char>(c)) != 0, "Invalid JSON: bad \\u escape in a field name");
+    return static_cast<uint32_t>(c <= '9' ? c - '0' : (tolower(static_cast<unsigned char>(c)) - 'a' + 10));
+}
+
+void appendUtf8(uint32_t codePoint, string& text)
+{
+    if(codePoint < 0x80) {
+        text += static_cast<char>(codePoint);
+    } else if(codePoint < 0x800) {
+        text += static_cast<char>(0xC0 | (codePoint >> 6));
+        text += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else if(codePoint < 0x10000) {
+        text += static_cast<char>(0xE0 | (codePoint >> 12));
+        text += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        text += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else {
+        text += static_cast<char>(0xF0 | (codePoint >> 18));
+        text += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+        text += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        text += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+}
+
+} // namespace
+
+JsonFieldScanner::JsonFieldScanner(const vector<string>& fields) :
+    fields_(fields.begin(), fields.end())
+{
+}
+
+void JsonFieldScanner::write(const char* data, size_t size)
+{
+    for(size_t i = 0; i < size && !haveAllFields(); ++i) {
+        auto c = data[i];
+        switch(state_) {
+            case State::START:
+                if(c == '{') {
+                    state_ = State::KEY_OR_END;
+                } else {
+                    DG_CHECK(isSpace(c), "Invalid JSON: expecting an object");
+                }
+                break;
+
+            case State::KEY_OR_END:
+                if(c == '"') {
+                    key_.clear();
+                    state_ = State::KEY;
+                } else if(c == '}') {
+                    state_ = State::DONE;
+                } else {
+                    DG_CHECK(isSpace(c) || c == ',', "Invalid JSON: expecting a field name");
+                }
+                break;
+
+            case State::KEY:
+                scanKey(c);
+                break;
+
+            case State::COLON:
+                if(c == ':') {
+                    state_ = State::VALUE_START;
+                } else {
+                    DG_CHECK(isSpace(c), "Invalid JSON: expecting ':' after \"%s\"", key_.c_str());
+                }
+                break;
+
+            case State::VALUE_START:
+                if(!isSpace(c)) {
+                    keep_ = key_.size() <= MAX_KEY_SIZE && (fields_.empty() || fields_.count(key_) > 0);
+                    value_.clear();
+                    depth_ = 0;
+                    state_ = State::VALUE;
+                    scanValue(c);
+                }
+                break;
+
+            case State::VALUE:
+                scanValue(c);
+                break;
+
+            case State::DONE:
+                DG_CHECK(isSpace(c), "Invalid JSON: unexpected data after the end of the object");
+                break;
+        }
+    }
+}
+
+void JsonFieldScanner::scanKey(char c)
+{
+    if(hexDigits_ > 0) {
+        codePoint_ = codePoint_ * 16 + hexValue(c);
+        if(--hexDigits_ == 0) {
+            appendCodePoint();
+        }
+        return;
+    }
+
+    if(escape_) {
+        escape_ = false;
+        switch(c) {
+            case '"':
+            case '\\':
+            case '/':
+                appendKey(c);
+                break;
+
+            case 'b':
+                appendKey('\b');
+                break;
+
+            case 'f':
+                appendKey('\f');
+                break;
+
+            case 'n':
+                appendKey('\n');
+                break;
+
+            case 'r':
+                appendKey('\r');
+                break;
+
+            case 't':
+                appendKey('\t');
+                break;
+
+            case 'u':
+                codePoint_ = 0;
+                hexDigits_ = 4;
+                break;
+
+            default:
+                DG_ERROR_THROW("Invalid JSON: bad escape sequence in a field name");
+        }
+    } else if(c == '\\') {
+        escape_ = true;
+    } else if(c == '"') {
+        DG_CHECK(highSurrogate_ == 0, "Invalid JSON: unpaired surrogate in a field name");
+        state_ = State::COLON;
+    } else {
+        appendKey(c);
+    }
+}
+
+void JsonFieldScanner::appendKey(char c)
+{
+    DG_CHECK(highSurrogate_ == 0, "Invalid JSON: unpaired surrogate in a field name");
+    if(key_.size() <= MAX_KEY_SIZE) {
+        key_ += c;
+    }
+}
+
+void JsonFieldScanner::appendCodePoint()
+{
+    // Characters outside the Basic Multilingual Plane are written as a
+    // surrogate pair of \u escapes
+    if(codePoint_ >= 0xD800 && codePoint_ <= 0xDBFF) {
+        DG_CHECK(highSurrogate_ == 0, "Invalid JSON: unpaired surrogate in a field name");
+        highSurrogate_ = codePoint_;
+        return;
+    }
+
+    if(codePoint_ >= 0xDC00 && codePoint_ <= 0xDFFF) {
+        DG_CHECK(highSurrogate_ != 0, "Invalid JSON: unpaired surrogate in a field name");
+        codePoint_ = 0x10000 + ((highSurrogate_ - 0xD800) << 10) + (codePoint_ - 0xDC00);
+        highSurrogate_ = 0;
+    }
+
+    DG_CHECK(highSurrogate_ == 0, "Invalid JSON: unpaired surrogate in a field name");
+    if(key_.size() <= MAX_KEY_SIZE) {
+        appendUtf8(codePoint_, key_);
+    }
+}
+
+void JsonFieldScanner::scanValue(char c)
+{
+    if(inString_) {
+        if(escape_) {
+            escape_ = false;
+        } else if(c == '\\') {
+            escape_ = true;
+        } else if(c == '"') {
+            inString_ = false;
+        }
+    } else if(c == '"') {
+        inString_ = true;
+    } else if(c == '{' || c == '[') {
+        ++depth_;
+    } else if((c == '}' || c == ']') && depth_ > 0) {
+        --depth_;
+    } else if(depth_ == 0 && (c == ',' || c == '}')) {
+        endValue();
+        state_ = c == ',' ? State::KEY_OR_END : State::DONE;
+        return;
+    }
+
+    if(keep_) {
+        value_ += c;
+    }
+}
+
+void JsonFieldScanner::endValue()
+{
+    if(keep_) {
+        while(!value_.empty() && isSpace(value_.back())) {
+            value_.pop_back();
+        }
+
+        values_[key_] = value_;
+    }
+
+    keep_ = false;
+    value_.clear();
+}
+
+} } // namespace dg { namespace gbdxm {
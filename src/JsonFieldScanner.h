@@ -0,0 +1,98 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef DEEPCORE_GBDXM_JSONFIELDSCANNER_H
+#define DEEPCORE_GBDXM_JSONFIELDSCANNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace dg { namespace gbdxm {
+
+/**
+ * Picks top-level fields out of a JSON object as it is read in pieces. Only
+ * the text of the requested fields is kept, everything else is skipped
+ * without being parsed, so memory use doesn't depend on the size of the
+ * fields that aren't needed, such as the label list in metadata.json.
+ *
+ * Escape sequences in field names are decoded before they are matched.
+ */
+class JsonFieldScanner
+{
+public:
+    /**
+     * @param fields Names of the fields to keep, all fields are kept if empty.
+     */
+    explicit JsonFieldScanner(const std::vector<std::string>& fields);
+
+    void write(const char* data, size_t size);
+
+    /**
+     * Returns true once the closing brace of the object has been read.
+     */
+    bool isComplete() const { return state_ == State::DONE; }
+
+    /**
+     * Returns true once every requested field has been read. The rest of the
+     * object doesn't need to be written, and is ignored if it is.
+     */
+    bool haveAllFields() const { return !fields_.empty() && values_.size() == fields_.size(); }
+
+    /**
+     * Returns the raw JSON text of each field found, keyed by field name.
+     */
+    const std::map<std::string, std::string>& values() const { return values_; }
+
+private:
+    enum class State
+    {
+        START,
+        KEY_OR_END,
+        KEY,
+        COLON,
+        VALUE_START,
+        VALUE,
+        DONE
+    };
+
+    void scanKey(char c);
+    void appendKey(char c);
+    void appendCodePoint();
+    void scanValue(char c);
+    void endValue();
+
+    std::set<std::string> fields_;
+    State state_ = State::START;
+    std::string key_;
+    std::string value_;
+    bool keep_ = false;
+    bool inString_ = false;
+    bool escape_ = false;
+    int hexDigits_ = 0;
+    uint32_t codePoint_ = 0;
+    uint32_t highSurrogate_ = 0;
+    size_t depth_ = 0;
+    std::map<std::string, std::string> values_;
+};
+
+} } // namespace dg { namespace gbdxm {
+
+#endif // DEEPCORE_GBDXM_JSONFIELDSCANNER_H
@@ -0,0 +1,680 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "PackageDelta.h"
+
+#include "ByteOrder.h"
+#include "Crypto.h"
+#include "Stats.h"
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <json/json.h>
+#include <utility/Error.h>
+#include <utility/Logging.h>
+
+namespace dg { namespace gbdxm {
+
+namespace fs = boost::filesystem;
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+const char* const DELTA_FORMAT = "gbdxm-delta";
+const int DELTA_VERSION = 1;
+const char* const MANIFEST_NAME = "delta.json";
+const char* const METADATA_NAME = "metadata.json";
+const string DELTA_PREFIX = "delta/";
+
+// Delta entries are a sequence of operations, each one an opcode followed by
+// little endian operands:
+//   COPY     uint64 offset in the old item, uint64 length
+//   LITERAL  uint64 length, followed by that many bytes
+const uint8_t DELTA_COPY = 1;
+const uint8_t DELTA_LITERAL = 2;
+const size_t COPY_OP_SIZE = 17;
+const size_t LITERAL_OP_SIZE = 9;
+
+// Bits of the filter that rules out most rolling hashes without searching
+// the block list
+const size_t FILTER_BITS = 24;
+
+// Equal blocks, e.g. runs of zeros, have the same hash, and any of them will
+// do. Blocks that only share the hash are rare, stop looking after a few.
+const size_t MAX_CANDIDATES = 32;
+
+/**
+ * rsync's weak checksum over a window of blockSize bytes, which can be
+ * moved forward one byte at a time.
+ */
+class RollingHash
+{
+public:
+    explicit RollingHash(size_t window) : window_(static_cast<uint32_t>(window)) {}
+
+    void reset(const uint8_t* data)
+    {
+        a_ = 0;
+        b_ = 0;
+        for(uint32_t i = 0; i < window_; ++i) {
+            a_ += data[i];
+            b_ += (window_ - i) * data[i];
+        }
+    }
+
+    void roll(uint8_t out, uint8_t in)
+    {
+        a_ += in - out;
+        b_ += a_ - window_ * out;
+    }
+
+    uint32_t value() const { return (a_ & 0xffff) | (b_ << 16); }
+
+private:
+    uint32_t window_;
+    uint32_t a_ = 0;
+    uint32_t b_ = 0;
+};
+
+/**
+ * Hashes of the blocks of an old item at multiples of the block size.
+ */
+class BlockIndex
+{
+public:
+    BlockIndex(const ItemSpan& base, size_t blockSize) :
+        base_(base),
+        blockSize_(blockSize),
+        filter_((size_t(1) << FILTER_BITS) / 64)
+    {
+        RollingHash hash(blockSize);
+        for(uint64_t offset = 0; offset + blockSize <= base.size; offset += blockSize) {
+            hash.reset(base.data + offset);
+            blocks_.emplace_back(hash.value(), offset);
+
+            auto bit = filterBit(hash.value());
+            filter_[bit / 64] |= uint64_t(1) << (bit % 64);
+        }
+
+        std::sort(blocks_.begin(), blocks_.end());
+    }
+
+    /**
+     * Looks for a block of the old item with the same content as the block
+     * size bytes at data, which have the given rolling hash.
+     */
+    bool find(uint32_t hash, const uint8_t* data, uint64_t& offset) const
+    {
+        auto bit = filterBit(hash);
+        if(!(filter_[bit / 64] & (uint64_t(1) << (bit % 64)))) {
+            return false;
+        }
+
+        auto it = std::lower_bound(blocks_.begin(), blocks_.end(), std::make_pair(hash, uint64_t(0)));
+        for(size_t i = 0; it != blocks_.end() && it->first == hash && i < MAX_CANDIDATES; ++it, ++i) {
+            if(memcmp(base_.data + it->second, data, blockSize_) == 0) {
+                offset = it->second;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+private:
+    static size_t filterBit(uint32_t hash) { return (hash * 2654435761u) >> (32 - FILTER_BITS); }
+
+    const ItemSpan& base_;
+    size_t blockSize_;
+    vector<uint64_t> filter_;
+    vector<std::pair<uint32_t, uint64_t>> blocks_;
+};
+
+/**
+ * Writes delta operations to an entry, merging copies of adjacent blocks.
+ */
+class DeltaWriter
+{
+public:
+    DeltaWriter(EntryEncoder& encoder, const ItemSpan& target, DeltaSummary& summary) :
+        encoder_(encoder),
+        target_(target),
+        summary_(summary)
+    {
+    }
+
+    void copy(uint64_t offset, uint64_t length)
+    {
+        if(copyLength_ > 0 && copyOffset_ + copyLength_ == offset) {
+            copyLength_ += length;
+            return;
+        }
+
+        flushCopy();
+        copyOffset_ = offset;
+        copyLength_ = length;
+    }
+
+    void literal(uint64_t begin, uint64_t end)
+    {
+        if(begin == end) {
+            return;
+        }
+
+        flushCopy();
+
+        vector<uint8_t> op;
+        op.push_back(DELTA_LITERAL);
+        put64(op, end - begin);
+        encoder_.write(op.data(), op.size());
+        encoder_.write(target_.data + begin, static_cast<size_t>(end - begin));
+        summary_.literal += end - begin;
+    }
+
+    void finish() { flushCopy(); }
+
+private:
+    void flushCopy()
+    {
+        if(copyLength_ == 0) {
+            return;
+        }
+
+        vector<uint8_t> op;
+        op.push_back(DELTA_COPY);
+        put64(op, copyOffset_);
+        put64(op, copyLength_);
+        encoder_.write(op.data(), op.size());
+        summary_.copied += copyLength_;
+        copyLength_ = 0;
+    }
+
+    EntryEncoder& encoder_;
+    const ItemSpan& target_;
+    DeltaSummary& summary_;
+    uint64_t copyOffset_ = 0;
+    uint64_t copyLength_ = 0;
+};
+
+/**
+ * Runs the operations of a delta entry as it is decoded, passing the new
+ * item to sink.
+ */
+class DeltaApplier
+{
+public:
+    DeltaApplier(const ItemSpan& base, const EntryDecoder::Sink& sink, const string& name) :
+        base_(base),
+        sink_(sink),
+        name_(name)
+    {
+    }
+
+    void write(const uint8_t* data, size_t size)
+    {
+        while(size > 0) {
+            if(literal_ > 0) {
+                auto count = static_cast<size_t>(std::min<uint64_t>(literal_, size));
+                sink_(data, count);
+                data += count;
+                size -= count;
+                literal_ -= count;
+                continue;
+            }
+
+            op_.push_back(*data++);
+            --size;
+
+            auto code = op_.front();
+            DG_CHECK(code == DELTA_COPY || code == DELTA_LITERAL, "Invalid delta operation %d for %s",
+                     (int) code, name_.c_str());
+            if(op_.size() < (code == DELTA_COPY ? COPY_OP_SIZE : LITERAL_OP_SIZE)) {
+                continue;
+            }
+
+            if(code == DELTA_COPY) {
+                auto offset = get64(&op_[1]);
+                auto length = get64(&op_[9]);
+                DG_CHECK(offset <= base_.size && length <= base_.size - offset,
+                         "The delta of %s copies past the end of the old item", name_.c_str());
+                sink_(base_.data + offset, static_cast<size_t>(length));
+            } else {
+                literal_ = get64(&op_[1]);
+            }
+
+            op_.clear();
+        }
+    }
+
+    void finish() const
+    {
+        DG_CHECK(op_.empty() && literal_ == 0, "The delta of %s is truncated", name_.c_str());
+    }
+
+private:
+    const ItemSpan& base_;
+    const EntryDecoder::Sink& sink_;
+    const string& name_;
+    vector<uint8_t> op_;
+    uint64_t literal_ = 0;
+};
+
+/**
+ * Decoded content of an item, either in place in a mapped package or decoded
+ * to a temporary file and mapped.
+ */
+struct ItemContent
+{
+    MappedFile file;
+    ItemSpan span;
+    string sha256;
+};
+
+EntryLayout itemLayout(const ZipReader& zip, const ZipEntry& entry)
+{
+    EntryLayout layout;
+    DG_CHECK(EntryLayout::fromExtraField(entry.extra, layout), "%s in %s has no entry layout record",
+             entry.name.c_str(), zip.fileName().c_str());
+    return layout;
+}
+
+unique_ptr<ItemContent> loadItem(const StreamingModelReader& reader, const string& name,
+                                 const DeltaOptions& options)
+{
+    unique_ptr<ItemContent> item(new ItemContent);
+    if(reader.isMappable(name)) {
+        item->span = reader.mapItem(name);
+    } else {
+        auto entry = reader.zip().find(name);
+        DG_CHECK(entry != nullptr, "%s is missing from %s", name.c_str(), reader.zip().fileName().c_str());
+
+        // The file is removed as soon as it's mapped, the mapping keeps it
+        // until the item is done with
+        auto directory = options.tempDir.empty() ? fs::temp_directory_path() : fs::path(options.tempDir);
+        auto fileName = (directory / fs::unique_path(".gbdxm-delta-%%%%-%%%%-%%%%.part")).string();
+        try {
+            OutputFile file(fileName);
+            reader.readItem(name, [&file, &options](const uint8_t* data, size_t size) {
+                ActionStats::Timer timer(options.stats, "write", size);
+                file.write(data, size);
+            });
+            file.close();
+
+            item->file.open(fileName);
+            fs::remove(fileName);
+        } catch(...) {
+            boost::system::error_code ec;
+            fs::remove(fileName, ec);
+            throw;
+        }
+
+        item->span.data = item->file.data();
+        item->span.size = item->file.size();
+    }
+
+    ActionStats::Timer timer(options.stats, "hash", item->span.size);
+    Sha256 hash;
+    hash.update(item->span.data, item->span.size);
+    item->sha256 = toHex(hash.final());
+    return item;
+}
+
+string readText(const StreamingModelReader& reader, const string& name)
+{
+    DG_CHECK(reader.zip().find(name) != nullptr, "%s is missing from %s", name.c_str(),
+             reader.zip().fileName().c_str());
+
+    string text;
+    reader.readItem(name, [&text](const uint8_t* data, size_t size) {
+        text.append(reinterpret_cast<const char*>(data), size);
+    });
+
+    return text;
+}
+
+string sha256(const string& text)
+{
+    Sha256 hash;
+    hash.update(text);
+    return toHex(hash.final());
+}
+
+EntryCodec parseCodec(const string& name)
+{
+    for(auto codec : { EntryCodec::STORE, EntryCodec::DEFLATE, EntryCodec::ZSTD }) {
+        if(name == codecName(codec)) {
+            return codec;
+        }
+    }
+
+    DG_ERROR_THROW("Unknown codec '%s' in the delta manifest", name.c_str());
+}
+
+/**
+ * Returns the item entries of a package in the order they are in the file.
+ */
+vector<ZipEntry> itemEntries(const ZipReader& zip)
+{
+    vector<ZipEntry> entries;
+    for(const auto& entry : zip.entries()) {
+        if(entry.name != METADATA_NAME) {
+            entries.push_back(entry);
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const ZipEntry& a, const ZipEntry& b) {
+        return a.offset < b.offset;
+    });
+
+    return entries;
+}
+
+/**
+ * Returns the alignment the entry was padded to by ZipWriter, 0 if none.
+ */
+size_t entryAlignment(const ZipReader& zip, const ZipEntry& entry)
+{
+    vector<uint8_t> data;
+    if(entry.method != ZIP_METHOD_STORE || !findExtraField(zip.localExtra(entry), ALIGNMENT_EXTRA_ID, data) ||
+       data.size() < 2) {
+        return 0;
+    }
+
+    return get16(data.data());
+}
+
+void encodeDelta(const ItemSpan& base, const ItemSpan& target, size_t blockSize, EntryEncoder& encoder,
+                 DeltaSummary& summary, ActionStats* stats)
+{
+    unique_ptr<BlockIndex> index;
+    {
+        ActionStats::Timer timer(stats, "index", base.size);
+        index.reset(new BlockIndex(base, blockSize));
+    }
+
+    ActionStats::Timer timer(stats, "match", target.size);
+    DeltaWriter writer(encoder, target, summary);
+    uint64_t literalBegin = 0;
+
+    if(base.size >= blockSize && target.size >= blockSize) {
+        RollingHash hash(blockSize);
+        hash.reset(target.data);
+
+        uint64_t position = 0;
+        while(true) {
+            uint64_t offset;
+            if(index->find(hash.value(), target.data + position, offset)) {
+                // Grow the match both ways, past the block boundaries
+                auto begin = position;
+                while(begin > literalBegin && offset > 0 && target.data[begin - 1] == base.data[offset - 1]) {
+                    --begin;
+                    --offset;
+                }
+
+                auto end = position + blockSize;
+                auto baseEnd = offset + (end - begin);
+                while(end < target.size && baseEnd < base.size && target.data[end] == base.data[baseEnd]) {
+                    ++end;
+                    ++baseEnd;
+                }
+
+                writer.literal(literalBegin, begin);
+                writer.copy(offset, end - begin);
+                literalBegin = end;
+                position = end;
+
+                if(position + blockSize > target.size) {
+                    break;
+                }
+
+                hash.reset(target.data + position);
+                continue;
+            }
+
+            if(position + blockSize >= target.size) {
+                break;
+            }
+
+            hash.roll(target.data[position], target.data[position + blockSize]);
+            ++position;
+        }
+    }
+
+    writer.literal(literalBegin, target.size);
+    writer.finish();
+}
+
+} // namespace
+
+DeltaSummary writeDelta(const StreamingModelReader& base, const StreamingModelReader& target, ZipWriter&& patch,
+                        const DeltaOptions& options)
+{
+    DG_CHECK(base.isStreamingPackage(), "%s was not written by a streaming pack, deltas need streaming packages",
+             base.zip().fileName().c_str());
+    DG_CHECK(target.isStreamingPackage(), "%s was not written by a streaming pack, deltas need streaming packages",
+             target.zip().fileName().c_str());
+    DG_CHECK(base.shards().empty() && target.shards().empty(),
+             "%s or %s is split into shards, deltas can't be taken of sharded packages",
+             base.zip().fileName().c_str(), target.zip().fileName().c_str());
+    DG_CHECK(options.blockSize >= 16, "The delta block size must be at least 16 bytes");
+
+    auto entries = itemEntries(target.zip());
+
+    // The delta entries hold the content of the new items in the clear, so
+    // they're encrypted if any of the items are
+    bool encrypted = std::any_of(entries.begin(), entries.end(), [&target](const ZipEntry& entry) {
+        return itemLayout(target.zip(), entry).cipher != EntryCipher::NONE;
+    });
+    DG_CHECK(!encrypted || options.key, "%s is encrypted, taking a delta requires its key",
+             target.zip().fileName().c_str());
+
+    EntryOptions entryOptions;
+    entryOptions.codec = options.codec;
+    entryOptions.level = options.level;
+    entryOptions.key = encrypted ? options.key : nullptr;
+    entryOptions.pool = options.pool;
+    entryOptions.stats = options.stats;
+
+    ZipWriter zip(std::move(patch));
+    zip.reserveEntry(MANIFEST_NAME);
+
+    Json::Value baseItems(Json::objectValue);
+    Json::Value targetItems(Json::arrayValue);
+    size_t alignment = 0;
+    DeltaSummary summary;
+
+    for(const auto& entry : entries) {
+        auto layout = itemLayout(target.zip(), entry);
+        alignment = std::max(alignment, entryAlignment(target.zip(), entry));
+
+        DG_LOG(gbdxm, info) << "Comparing " << entry.name;
+        auto newItem = loadItem(target, entry.name, options);
+
+        // New items are all literals
+        unique_ptr<ItemContent> oldItem(new ItemContent);
+        if(base.zip().find(entry.name)) {
+            oldItem = loadItem(base, entry.name, options);
+
+            auto& baseItem = baseItems[entry.name];
+            baseItem["size"] = Json::UInt64(oldItem->span.size);
+            baseItem["sha256"] = oldItem->sha256;
+        }
+
+        EntryEncoder encoder(zip, entryOptions);
+        encoder.begin(DELTA_PREFIX + entry.name);
+        encodeDelta(oldItem->span, newItem->span, options.blockSize, encoder, summary, options.stats);
+        encoder.end();
+
+        Json::Value item;
+        item["name"] = entry.name;
+        item["size"] = Json::UInt64(newItem->span.size);
+        item["sha256"] = newItem->sha256;
+        item["codec"] = codecName(layout.codec);
+        item["encrypted"] = layout.cipher != EntryCipher::NONE;
+        item["chunkSize"] = Json::UInt64(layout.chunkSize);
+        targetItems.append(item);
+    }
+
+    // metadata.json is carried over as is, its checksums still hold for the
+    // rebuilt items
+    auto metadataEntry = target.zip().find(METADATA_NAME);
+    DG_CHECK(metadataEntry != nullptr, "%s is missing from %s", METADATA_NAME, target.zip().fileName().c_str());
+    auto metadataCodec = itemLayout(target.zip(), *metadataEntry).codec;
+    auto metadata = readText(target, METADATA_NAME);
+
+    // Neither metadata.json nor the manifest is encrypted, so that the patch
+    // can be shown without the key
+    auto plainOptions = entryOptions;
+    plainOptions.key = nullptr;
+    {
+        EntryEncoder encoder(zip, plainOptions);
+        encoder.begin(METADATA_NAME);
+        encoder.write(reinterpret_cast<const uint8_t*>(metadata.data()), metadata.size());
+        encoder.end();
+    }
+
+    Json::Value root;
+    root["format"] = DELTA_FORMAT;
+    root["version"] = DELTA_VERSION;
+    root["blockSize"] = Json::UInt64(options.blockSize);
+    root["base"]["items"] = baseItems;
+    root["target"]["alignment"] = Json::UInt64(alignment);
+    root["target"]["items"] = targetItems;
+    root["target"]["metadata"]["size"] = Json::UInt64(metadata.size());
+    root["target"]["metadata"]["sha256"] = sha256(metadata);
+    root["target"]["metadata"]["codec"] = codecName(metadataCodec);
+
+    auto manifest = Json::StyledWriter().write(root);
+    {
+        EntryEncoder encoder(zip, plainOptions);
+        encoder.begin(MANIFEST_NAME);
+        encoder.write(reinterpret_cast<const uint8_t*>(manifest.data()), manifest.size());
+        encoder.end();
+    }
+
+    zip.close();
+    return summary;
+}
+
+void applyDelta(const StreamingModelReader& base, const StreamingModelReader& patch, ZipWriter&& output,
+                const DeltaOptions& options)
+{
+    DG_CHECK(base.isStreamingPackage(), "%s was not written by a streaming pack, deltas need streaming packages",
+             base.zip().fileName().c_str());
+    DG_CHECK(base.shards().empty(), "%s is split into shards, sharded packages can't be patched",
+             base.zip().fileName().c_str());
+
+    Json::Value root;
+    Json::Reader reader;
+    DG_CHECK(reader.parse(readText(patch, MANIFEST_NAME), root) && root.isObject(),
+             "Error parsing the delta manifest of %s: %s", patch.zip().fileName().c_str(),
+             reader.getFormattedErrorMessages().c_str());
+    DG_CHECK(root["format"].asString() == DELTA_FORMAT, "%s is not a gbdxm delta", patch.zip().fileName().c_str());
+    DG_CHECK(root["version"].asInt() == DELTA_VERSION, "Unsupported delta version %d in %s",
+             root["version"].asInt(), patch.zip().fileName().c_str());
+
+    const auto& baseItems = root["base"]["items"];
+    const auto& target = root["target"];
+
+    ZipWriter zip(std::move(output));
+    zip.setAlignment(static_cast<size_t>(target["alignment"].asUInt64()));
+    zip.reserveEntry(METADATA_NAME);
+
+    for(const auto& item : target["items"]) {
+        auto name = item["name"].asString();
+        auto size = item["size"].asUInt64();
+        bool encrypted = item["encrypted"].asBool();
+        DG_CHECK(!encrypted || options.key, "%s is encrypted in the new package, patching requires its key",
+                 name.c_str());
+
+        // Copies come from the old item the delta was taken against, nothing
+        // else will do
+        unique_ptr<ItemContent> oldItem(new ItemContent);
+        if(baseItems.isMember(name)) {
+            oldItem = loadItem(base, name, options);
+            DG_CHECK(oldItem->sha256 == baseItems[name]["sha256"].asString(),
+                     "%s in %s is not the one the delta was taken against", name.c_str(),
+                     base.zip().fileName().c_str());
+        }
+
+        EntryOptions entryOptions;
+        entryOptions.codec = parseCodec(item["codec"].asString());
+        entryOptions.chunkSize = static_cast<size_t>(item["chunkSize"].asUInt64());
+        entryOptions.key = encrypted ? options.key : nullptr;
+        entryOptions.pool = options.pool;
+        entryOptions.stats = options.stats;
+
+        // Unchanged items that are stored as-is in both packages are copied
+        // from the old package without going through the encoder
+        bool unchanged = baseItems.isMember(name) && oldItem->span.size == size &&
+                         oldItem->sha256 == item["sha256"].asString();
+        if(unchanged && !encrypted && entryOptions.codec == EntryCodec::STORE && base.isStored(name)) {
+            DG_LOG(gbdxm, info) << "Copying " << name << " from " << base.zip().fileName();
+            auto layout = itemLayout(base.zip(), *base.zip().find(name));
+            layout.chunkSize = static_cast<uint32_t>(entryOptions.chunkSize);
+
+            zip.beginEntry(name, ZIP_METHOD_STORE, layout.toExtraField(), size >= ZIP64_LIMIT - ZIP64_LIMIT / 16);
+            base.copyItem(name, zip);
+            zip.endEntry(layout.crc, layout.size, layout.toExtraField());
+            continue;
+        }
+
+        DG_LOG(gbdxm, info) << "Rebuilding " << name;
+        EntryEncoder encoder(zip, entryOptions);
+        encoder.begin(name, entryOptions.codec, size);
+
+        Sha256 hash;
+        uint64_t written = 0;
+        EntryDecoder::Sink sink = [&hash, &encoder, &written](const uint8_t* data, size_t count) {
+            hash.update(data, count);
+            encoder.write(data, count);
+            written += count;
+        };
+
+        DeltaApplier applier(oldItem->span, sink, name);
+        patch.readItem(DELTA_PREFIX + name, [&applier](const uint8_t* data, size_t count) {
+            applier.write(data, count);
+        });
+        applier.finish();
+
+        DG_CHECK(written == size && toHex(hash.final()) == item["sha256"].asString(),
+                 "%s doesn't match the new package after patching", name.c_str());
+        encoder.end();
+    }
+
+    auto metadata = readText(patch, METADATA_NAME);
+    DG_CHECK(sha256(metadata) == target["metadata"]["sha256"].asString(),
+             "metadata.json doesn't match the new package after patching");
+
+    EntryOptions metadataOptions;
+    metadataOptions.codec = parseCodec(target["metadata"]["codec"].asString());
+    metadataOptions.pool = options.pool;
+    metadataOptions.stats = options.stats;
+
+    EntryEncoder encoder(zip, metadataOptions);
+    encoder.begin(METADATA_NAME, metadataOptions.codec, metadata.size());
+    encoder.write(reinterpret_cast<const uint8_t*>(metadata.data()), metadata.size());
+    encoder.end();
+
+    zip.close();
+}
+
+} } // namespace dg { namespace gbdxm {
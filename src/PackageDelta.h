@@ -0,0 +1,108 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef DEEPCORE_GBDXM_PACKAGEDELTA_H
+#define DEEPCORE_GBDXM_PACKAGEDELTA_H
+
+#include "EntryCodec.h"
+#include "StreamingModelReader.h"
+#include "ZipArchive.h"
+
+#include <cstdint>
+
+namespace dg { namespace gbdxm {
+
+const size_t DEFAULT_DELTA_BLOCK_SIZE = 2048;
+
+/**
+ * Options for writing and applying deltas between two versions of a
+ * streaming package.
+ */
+struct DeltaOptions
+{
+    // Size of the blocks of the old items that are looked up in the new
+    // ones. Smaller blocks find more matches in weights that only changed
+    // in places, at the cost of a larger index.
+    size_t blockSize = DEFAULT_DELTA_BLOCK_SIZE;
+
+    // Compression of the delta entries
+    EntryCodec codec = EntryCodec::DEFLATE;
+    int level = DEFAULT_LEVEL;
+
+    // Decrypts the packages, and encrypts the delta entries and the rebuilt
+    // items of encrypted packages
+    const PackageKey* key = nullptr;
+
+    ThreadPool* pool = nullptr;
+    ActionStats* stats = nullptr;
+
+    // Directory the items that aren't stored as-is are decoded to, so that
+    // they're mapped instead of held in memory. The system temporary
+    // directory if empty.
+    std::string tempDir;
+};
+
+/**
+ * Sizes of the delta of one package to another.
+ */
+struct DeltaSummary
+{
+    // Bytes of the new items copied from the old ones, and included as is
+    uint64_t copied = 0;
+    uint64_t literal = 0;
+};
+
+/**
+ * Writes the difference between two versions of a streaming package as a
+ * patch package, so that only what changed needs to be shipped to where the
+ * old version already is.
+ *
+ * Deltas work on the decrypted and decompressed content of the items: each
+ * item of the new package is encoded as blocks copied from the item of the
+ * same name in the old package, found with a rolling hash the way rsync
+ * finds them, and literal bytes for the rest. The patch records the SHA-256
+ * of the old items it copies from and of every new item, and how each new
+ * item was encoded, see applyDelta().
+ *
+ * Both versions of an item are held in memory while it is compared, unless
+ * they are stored plaintext items of mapped packages.
+ *
+ * @param base Old package.
+ * @param target New package.
+ * @param patch Archive to write the patch to.
+ */
+DeltaSummary writeDelta(const StreamingModelReader& base, const StreamingModelReader& target, ZipWriter&& patch,
+                        const DeltaOptions& options);
+
+/**
+ * Rebuilds the new package from the old one and a patch written by
+ * writeDelta(). Items are encoded again the way they were in the new
+ * package, with the same codec, encryption, chunk size, and alignment, and
+ * checked against their SHA-256 as they are written. The package has the
+ * same content as the new one, but not necessarily the same bytes, as
+ * compression levels aren't recorded and encryption nonces are random.
+ *
+ * @param base Old package.
+ * @param patch Patch written by writeDelta().
+ * @param output Archive to write the rebuilt package to.
+ */
+void applyDelta(const StreamingModelReader& base, const StreamingModelReader& patch, ZipWriter&& output,
+                const DeltaOptions& options);
+
+} } // namespace dg { namespace gbdxm {
+
+#endif // DEEPCORE_GBDXM_PACKAGEDELTA_H
@@ -0,0 +1,205 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "ShardIndex.h"
+
+#include "Crypto.h"
+#include "EntryCodec.h"
+#include "FileIO.h"
+#include "StreamingModelReader.h"
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <cstdio>
+#include <json/json.h>
+#include <utility/Error.h>
+#include <zlib.h>
+
+namespace dg { namespace gbdxm {
+
+namespace fs = boost::filesystem;
+
+using std::string;
+using std::vector;
+
+namespace {
+
+const char* const SHARD_FORMAT = "gbdxm-shards";
+const int SHARD_VERSION = 1;
+
+// Shard packages are hashed a few chunks at a time, and their pages dropped
+const size_t DIGEST_BUFFER_SIZE = 8 << 20;
+
+} // namespace
+
+bool ShardIndex::haveItem(const string& item) const
+{
+    return std::any_of(shards.begin(), shards.end(), [&item](const Shard& shard) {
+        return shard.item == item;
+    });
+}
+
+vector<const Shard*> ShardIndex::itemShards(const string& item) const
+{
+    vector<const Shard*> ret;
+    for(const auto& shard : shards) {
+        if(shard.item == item) {
+            ret.push_back(&shard);
+        }
+    }
+
+    return ret;
+}
+
+uint64_t ShardIndex::itemSize(const string& item) const
+{
+    uint64_t size = 0;
+    for(auto shard : itemShards(item)) {
+        size += shard->size;
+    }
+
+    return size;
+}
+
+uint32_t ShardIndex::itemCrc(const string& item) const
+{
+    auto crc = crc32(0, nullptr, 0);
+    for(auto shard : itemShards(item)) {
+        crc = crc32_combine(crc, shard->crc, static_cast<z_off_t>(shard->size));
+    }
+
+    return static_cast<uint32_t>(crc);
+}
+
+string ShardIndex::toJson() const
+{
+    Json::Value root;
+    root["format"] = SHARD_FORMAT;
+    root["version"] = SHARD_VERSION;
+    root["shardSize"] = Json::UInt64(shardSize);
+
+    auto& items = root["shards"];
+    items = Json::Value(Json::arrayValue);
+    for(const auto& shard : shards) {
+        Json::Value item;
+        item["file"] = shard.fileName;
+        item["item"] = shard.item;
+        item["offset"] = Json::UInt64(shard.offset);
+        item["size"] = Json::UInt64(shard.size);
+        item["crc32"] = formatCrc(shard.crc);
+        item["packageSize"] = Json::UInt64(shard.packageSize);
+        item["sha256"] = shard.sha256;
+        items.append(item);
+    }
+
+    return Json::StyledWriter().write(root);
+}
+
+ShardIndex ShardIndex::fromJson(const string& json, const string& fileName)
+{
+    Json::Value root;
+    Json::Reader reader;
+    DG_CHECK(reader.parse(json, root) && root.isObject(), "Error parsing the shard index of %s: %s",
+             fileName.c_str(), reader.getFormattedErrorMessages().c_str());
+    DG_CHECK(root["format"].asString() == SHARD_FORMAT, "Invalid shard index in %s", fileName.c_str());
+    DG_CHECK(root["version"].asInt() == SHARD_VERSION, "Unsupported shard index version %d in %s",
+             root["version"].asInt(), fileName.c_str());
+    DG_CHECK(root["shards"].isArray(), "Invalid shard index in %s: \"shards\" must be a JSON array", fileName.c_str());
+
+    ShardIndex index;
+    index.shardSize = root["shardSize"].asUInt64();
+
+    for(const auto& item : root["shards"]) {
+        DG_CHECK(item.isObject() && item["file"].isString() && item["item"].isString() &&
+                 item["offset"].isIntegral() && item["size"].isIntegral() && item["crc32"].isString() &&
+                 item["packageSize"].isIntegral() && item["sha256"].isString(),
+                 "Invalid shard in the shard index of %s", fileName.c_str());
+
+        Shard shard;
+        shard.fileName = item["file"].asString();
+        shard.item = item["item"].asString();
+        shard.offset = item["offset"].asUInt64();
+        shard.size = item["size"].asUInt64();
+        shard.packageSize = item["packageSize"].asUInt64();
+        shard.sha256 = item["sha256"].asString();
+
+        DG_CHECK(parseCrc(item["crc32"].asString(), shard.crc), "Invalid shard checksum of %s in %s",
+                 shard.fileName.c_str(), fileName.c_str());
+
+        // Shards can only be next to the package
+        DG_CHECK(!shard.fileName.empty() && fs::path(shard.fileName).filename().string() == shard.fileName &&
+                 shard.fileName != "." && shard.fileName != "..",
+                 "Invalid shard file name '%s' in %s", shard.fileName.c_str(), fileName.c_str());
+
+        // The shards of each item follow each other without gaps
+        auto previous = index.itemShards(shard.item);
+        auto offset = previous.empty() ? 0 : previous.back()->offset + previous.back()->size;
+        DG_CHECK(shard.offset == offset, "Shard %s of %s is out of order in %s", shard.fileName.c_str(),
+                 shard.item.c_str(), fileName.c_str());
+
+        index.shards.push_back(shard);
+    }
+
+    return index;
+}
+
+bool ShardIndex::read(const ZipReader& zip, ShardIndex& index)
+{
+    auto entry = zip.find(SHARD_INDEX_NAME);
+    if(!entry) {
+        return false;
+    }
+
+    // The index is always in plaintext
+    string json;
+    EntryDecoder decoder(zip, *entry, nullptr);
+    decoder.decode([&json](const uint8_t* data, size_t size) {
+        json.append(reinterpret_cast<const char*>(data), size);
+    });
+
+    index = fromJson(json, zip.fileName());
+    return true;
+}
+
+string shardFileName(const string& packageFile, size_t number)
+{
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%03llu", static_cast<unsigned long long>(number));
+    return packageFile + suffix;
+}
+
+string shardPath(const string& packageFile, const Shard& shard)
+{
+    return (fs::path(packageFile).parent_path() / shard.fileName).string();
+}
+
+string shardDigest(const string& fileName)
+{
+    MappedFile file(fileName);
+    file.adviseSequential();
+
+    Sha256 hash;
+    for(size_t offset = 0; offset < file.size(); offset += DIGEST_BUFFER_SIZE) {
+        auto count = std::min(DIGEST_BUFFER_SIZE, file.size() - offset);
+        hash.update(file.data() + offset, count);
+        file.release(offset, count);
+    }
+
+    return toHex(hash.final());
+}
+
+} } // namespace dg { namespace gbdxm {
@@ -0,0 +1,112 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef DEEPCORE_GBDXM_SHARDINDEX_H
+#define DEEPCORE_GBDXM_SHARDINDEX_H
+
+#include "ZipArchive.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dg { namespace gbdxm {
+
+// Name of the shard index entry, which metadata.json points to
+const char* const SHARD_INDEX_NAME = "shards.json";
+
+const uint64_t MIN_SHARD_SIZE = 1 << 20;
+
+/**
+ * A piece of an item in its own shard package. Shard packages are streaming
+ * packages with a single entry, named after the item, holding shard.size
+ * bytes of it from shard.offset on.
+ */
+struct Shard
+{
+    // File name of the shard package, in the same directory as the package
+    std::string fileName;
+    std::string item;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+
+    // CRC-32 of the piece of the item
+    uint32_t crc = 0;
+
+    // Size and SHA-256 of the shard package file, so that a damaged or
+    // incomplete shard can be found and fetched again on its own
+    uint64_t packageSize = 0;
+    std::string sha256;
+};
+
+/**
+ * Index of the items of a package that are split into shard packages with
+ * pack --shard-size, kept in the package as shards.json. Sharded items have
+ * no entry in the package itself.
+ */
+struct ShardIndex
+{
+    uint64_t shardSize = 0;
+
+    // Shards of each item are in order of their offsets
+    std::vector<Shard> shards;
+
+    bool empty() const { return shards.empty(); }
+    bool haveItem(const std::string& item) const;
+    std::vector<const Shard*> itemShards(const std::string& item) const;
+
+    /**
+     * Returns the size and CRC-32 of a whole item, combined from those of
+     * its shards.
+     */
+    uint64_t itemSize(const std::string& item) const;
+    uint32_t itemCrc(const std::string& item) const;
+
+    std::string toJson() const;
+
+    /**
+     * Parses and checks shards.json.
+     * @param fileName Package the index is from, for error messages.
+     */
+    static ShardIndex fromJson(const std::string& json, const std::string& fileName);
+
+    /**
+     * Reads the index from a package.
+     * @return false if the package has no shards.
+     */
+    static bool read(const ZipReader& zip, ShardIndex& index);
+};
+
+/**
+ * Returns the file name of the given shard of a package, numbered from 1,
+ * e.g. model.gbdxm.003.
+ */
+std::string shardFileName(const std::string& packageFile, size_t number);
+
+/**
+ * Returns the path of a shard package, next to the package.
+ */
+std::string shardPath(const std::string& packageFile, const Shard& shard);
+
+/**
+ * Returns the SHA-256 of a shard package file in hexadecimal.
+ */
+std::string shardDigest(const std::string& fileName);
+
+} } // namespace dg { namespace gbdxm {
+
+#endif // DEEPCORE_GBDXM_SHARDINDEX_H
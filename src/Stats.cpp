@@ -0,0 +1,117 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "Stats.h"
+
+#include <cstdio>
+#include <sys/resource.h>
+
+namespace dg { namespace gbdxm {
+
+using std::string;
+
+uint64_t peakResidentBytes()
+{
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+
+#ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+    // Linux reports kilobytes
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+string formatBytes(uint64_t bytes)
+{
+    static const char* units[] = { "B", "KB", "MB", "GB", "TB" };
+
+    auto value = static_cast<double>(bytes);
+    size_t unit = 0;
+    while(value >= 1024 && unit < sizeof(units) / sizeof(units[0]) - 1) {
+        value /= 1024;
+        ++unit;
+    }
+
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), unit == 0 ? "%.0f %s" : "%.1f %s", value, units[unit]);
+    return buffer;
+}
+
+ActionStats::Timer::Timer(ActionStats* stats, const char* phase, uint64_t bytes) :
+    stats_(stats),
+    phase_(phase),
+    bytes_(bytes)
+{
+    if(stats_) {
+        start_ = std::chrono::steady_clock::now();
+    }
+}
+
+ActionStats::Timer::~Timer()
+{
+    if(stats_) {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_;
+        stats_->add(phase_, elapsed.count(), bytes_);
+    }
+}
+
+ActionStats::ActionStats(const string& action) :
+    action_(action),
+    start_(std::chrono::steady_clock::now())
+{
+}
+
+void ActionStats::add(const string& phase, double seconds, uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = phases_[phase];
+    entry.seconds += seconds;
+    entry.bytes += bytes;
+    ++entry.calls;
+}
+
+Json::Value ActionStats::toJson() const
+{
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_;
+
+    Json::Value root;
+    root["action"] = action_;
+    root["seconds"] = elapsed.count();
+    root["peakRss"] = Json::UInt64(peakResidentBytes());
+
+    auto& phases = root["phases"];
+    phases = Json::Value(Json::objectValue);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for(const auto& item : phases_) {
+        auto& phase = phases[item.first];
+        phase["seconds"] = item.second.seconds;
+        phase["calls"] = Json::UInt64(item.second.calls);
+        if(item.second.bytes > 0) {
+            phase["bytes"] = Json::UInt64(item.second.bytes);
+            phase["throughput"] = item.second.seconds > 0 ? item.second.bytes / item.second.seconds : 0.0;
+        }
+    }
+
+    return root;
+}
+
+} } // namespace dg { namespace gbdxm {
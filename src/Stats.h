@@ -0,0 +1,95 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef DEEPCORE_GBDXM_STATS_H
+#define DEEPCORE_GBDXM_STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <json/json.h>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace dg { namespace gbdxm {
+
+/**
+ * Returns the peak resident set size of this process in bytes.
+ */
+uint64_t peakResidentBytes();
+
+/**
+ * Formats a byte count for log output, e.g. "12.3 MB".
+ */
+std::string formatBytes(uint64_t bytes);
+
+/**
+ * Time spent and bytes processed in each phase of an action, for --stats.
+ * Phases may be timed on several threads at once, their times add up.
+ */
+class ActionStats
+{
+public:
+    /**
+     * Times a phase from construction to destruction. Does nothing if stats
+     * is nullptr, so call sites don't have to check.
+     */
+    class Timer
+    {
+    public:
+        Timer(ActionStats* stats, const char* phase, uint64_t bytes = 0);
+        ~Timer();
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        void addBytes(uint64_t bytes) { bytes_ += bytes; }
+
+    private:
+        ActionStats* stats_;
+        const char* phase_;
+        uint64_t bytes_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    explicit ActionStats(const std::string& action);
+
+    void add(const std::string& phase, double seconds, uint64_t bytes = 0);
+
+    /**
+     * Returns the report: the action, its wall clock time, peak resident
+     * set size, and the seconds, bytes, calls, and throughput of each phase.
+     */
+    Json::Value toJson() const;
+
+private:
+    struct Phase
+    {
+        double seconds = 0;
+        uint64_t bytes = 0;
+        uint64_t calls = 0;
+    };
+
+    std::string action_;
+    std::chrono::steady_clock::time_point start_;
+    mutable std::mutex mutex_;
+    std::map<std::string, Phase> phases_;
+};
+
+} } // namespace dg { namespace gbdxm {
+
+#endif // DEEPCORE_GBDXM_STATS_H
@@ -0,0 +1,388 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "StreamingModelReader.h"
+
+#include "gbdxm.h"
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <classification/ModelMetadataJson.h>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <json/json.h>
+#include <utility/Error.h>
+#include <zlib.h>
+
+namespace dg { namespace gbdxm {
+
+namespace fs = boost::filesystem;
+
+using namespace dg::deepcore;
+
+using std::map;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+// Largest span crc32() takes at a time
+const size_t MAX_CRC_SIZE = 1 << 30;
+
+} // namespace
+
+string formatCrc(uint32_t crc)
+{
+    char text[9];
+    snprintf(text, sizeof(text), "%08x", crc);
+    return text;
+}
+
+bool parseCrc(const string& text, uint32_t& crc)
+{
+    // strtoul() alone would take signs and spaces
+    if(text.size() != 8 || !std::all_of(text.begin(), text.end(), [](char c) {
+        return isxdigit(static_cast<unsigned char>(c)) != 0;
+    })) {
+        return false;
+    }
+
+    crc = static_cast<uint32_t>(strtoul(text.c_str(), nullptr, 16));
+    return true;
+}
+
+StreamingModelReader::StreamingModelReader(const string& fileName, const PackageKey* key, ThreadPool* pool) :
+    zip_(fileName),
+    key_(key),
+    pool_(pool),
+    packageFile_(fileName)
+{
+    ShardIndex::read(zip_, shards_);
+}
+
+StreamingModelReader::StreamingModelReader(const void* data, size_t size, const PackageKey* key, ThreadPool* pool) :
+    zip_(data, size),
+    key_(key),
+    pool_(pool)
+{
+    ShardIndex::read(zip_, shards_);
+}
+
+StreamingModelReader::StreamingModelReader(MappedFile&& file, const PackageKey* key, ThreadPool* pool) :
+    file_(std::move(file)),
+    zip_(file_.data(), file_.size(), file_.fileName()),
+    key_(key),
+    pool_(pool),
+    packageFile_(file_.fileName())
+{
+    ShardIndex::read(zip_, shards_);
+}
+
+bool StreamingModelReader::isStreamingPackage() const
+{
+    // gbdxm update can add a layout record to metadata.json of a package
+    // written by GbdxModelWriter, so check every entry
+    if(!zip_.find("metadata.json")) {
+        return false;
+    }
+
+    EntryLayout layout;
+    for(const auto& entry : zip_.entries()) {
+        if(!EntryLayout::fromExtraField(entry.extra, layout)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+unique_ptr<classification::ModelPackage> StreamingModelReader::readPackage(map<string, string>& contentMap,
+                                                                          map<string, ItemChecksum>* checksums) const
+{
+    auto metadata = readMetadata(contentMap, checksums);
+    auto lock = lockFrameworks();
+    return classification::ModelPackage::create(std::move(metadata));
+}
+
+unique_ptr<classification::ModelMetadata> StreamingModelReader::readMetadata(map<string, string>& contentMap,
+                                                                            map<string, ItemChecksum>* checksums) const
+{
+    string metadata;
+    readItem("metadata.json", [&metadata](const uint8_t* data, size_t size) {
+        metadata.append(reinterpret_cast<const char*>(data), size);
+    });
+
+    return parseMetadata(metadata, contentMap, checksums, stats_);
+}
+
+unique_ptr<classification::ModelMetadata> StreamingModelReader::parseMetadata(const string& metadata,
+                                                                             map<string, string>& contentMap,
+                                                                             map<string, ItemChecksum>* checksums,
+                                                                             ActionStats* stats)
+{
+    ActionStats::Timer timer(stats, "parse", metadata.size());
+    Json::Reader reader;
+    Json::Value root;
+    DG_CHECK(reader.parse(metadata, root), "Error parsing metadata: %s",
+             reader.getFormattedErrorMessages().c_str());
+
+    contentMap.clear();
+    if(root.isMember("content")) {
+        DG_CHECK(root["content"].type() == Json::objectValue,
+                 "Invalid metadata \"content\" field: must be a JSON object.");
+
+        for(const auto& name : root["content"].getMemberNames()) {
+            contentMap[name] = root["content"][name].asString();
+        }
+    }
+
+    if(checksums) {
+        checksums->clear();
+        if(root.isMember("checksums")) {
+            const auto& items = root["checksums"];
+            DG_CHECK(items.type() == Json::objectValue, "Invalid metadata \"checksums\" field: must be a JSON object.");
+
+            for(const auto& name : items.getMemberNames()) {
+                const auto& item = items[name];
+                DG_CHECK(item.isObject() && item["crc32"].isString() && item["size"].isIntegral(),
+                         "Invalid metadata checksum of %s", name.c_str());
+
+                auto& checksum = (*checksums)[name];
+                DG_CHECK(parseCrc(item["crc32"].asString(), checksum.crc), "Invalid metadata checksum of %s",
+                         name.c_str());
+                checksum.size = item["size"].asUInt64();
+            }
+        }
+    }
+
+    vector<string> missingFields;
+    auto lock = lockFrameworks();
+    return classification::ModelMetadataJson::fromJsonPartial(root, missingFields, "");
+}
+
+void StreamingModelReader::readItem(const string& name, const EntryDecoder::Sink& sink) const
+{
+    if(shards_.haveItem(name)) {
+        readShards(name, false, [&sink](const Shard&, EntryDecoder& decoder) {
+            decoder.decode(sink);
+        });
+
+        return;
+    }
+
+    EntryDecoder decoder(zip_, entry(name), key_, pool_);
+    decoder.setStats(stats_);
+    decoder.decode(sink);
+}
+
+void StreamingModelReader::extractItem(const string& name, const string& fileName) const
+{
+    OutputFile file(fileName);
+    auto stats = stats_;
+    if(shards_.haveItem(name)) {
+        // Each shard goes straight to its place in the file
+        readShards(name, true, [&file, stats](const Shard& shard, EntryDecoder& decoder) {
+            auto offset = shard.offset;
+            decoder.decode([&file, &offset, stats](const uint8_t* data, size_t size) {
+                ActionStats::Timer timer(stats, "write", size);
+                file.writeAt(offset, data, size);
+                offset += size;
+            });
+        });
+    } else if(isStored(name)) {
+        // The item is in the package as-is, there is nothing to decode. The
+        // copy is read back for the CRC check decoding would have made.
+        file.queueWrites(ioEngine_, entry(name).size);
+        copyItem(name, file);
+        file.close();
+        checkCopy(name, fileName);
+        return;
+    } else {
+        auto decoder = openItem(name);
+        file.queueWrites(ioEngine_, decoder->size());
+        decoder->decode([&file, stats](const uint8_t* data, size_t size) {
+            ActionStats::Timer timer(stats, "write", size);
+            file.write(data, size);
+        });
+    }
+
+    ActionStats::Timer timer(stats_, "write");
+    file.close();
+}
+
+ItemChecksum StreamingModelReader::checkItem(const string& name) const
+{
+    ItemChecksum checksum;
+    if(!shards_.haveItem(name)) {
+        auto decoder = openItem(name);
+        decoder->decode([](const uint8_t*, size_t) {});
+        checksum.size = decoder->layout().size;
+        checksum.crc = decoder->layout().crc;
+        return checksum;
+    }
+
+    readShards(name, true, [this](const Shard& shard, EntryDecoder& decoder) {
+        auto fileName = shardPath(packageFile_, shard);
+        {
+            ActionStats::Timer timer(stats_, "hash", shard.packageSize);
+            DG_CHECK(fs::file_size(fileName) == shard.packageSize && shardDigest(fileName) == shard.sha256,
+                     "Shard %s is damaged or incomplete, its SHA-256 doesn't match the shard index",
+                     shard.fileName.c_str());
+        }
+
+        decoder.decode([](const uint8_t*, size_t) {});
+    });
+
+    checksum.size = shards_.itemSize(name);
+    checksum.crc = shards_.itemCrc(name);
+    return checksum;
+}
+
+unique_ptr<EntryDecoder> StreamingModelReader::openItem(const string& name) const
+{
+    DG_CHECK(!shards_.haveItem(name), "%s is split into shards, it can only be read from start to end",
+             name.c_str());
+
+    unique_ptr<EntryDecoder> decoder(new EntryDecoder(zip_, entry(name), key_, pool_));
+    decoder->setStats(stats_);
+    return decoder;
+}
+
+bool StreamingModelReader::isStored(const string& name) const
+{
+    if(shards_.haveItem(name)) {
+        return false;
+    }
+
+    const auto& item = entry(name);
+
+    // Stored plaintext entries are the item as-is, encrypted ones are frames
+    // even when they aren't compressed
+    EntryLayout layout;
+    return item.method == ZIP_METHOD_STORE && item.compressedSize == item.size &&
+           (!EntryLayout::fromExtraField(item.extra, layout) || layout.cipher == EntryCipher::NONE);
+}
+
+bool StreamingModelReader::isMappable(const string& name) const
+{
+    return zip_.data() != nullptr && isStored(name);
+}
+
+void StreamingModelReader::copyItem(const string& name, OutputFile& out) const
+{
+    copyStored(name, out);
+}
+
+void StreamingModelReader::copyItem(const string& name, ZipWriter& zip) const
+{
+    copyStored(name, zip);
+}
+
+template<typename Output>
+void StreamingModelReader::copyStored(const string& name, Output& out) const
+{
+    DG_CHECK(isStored(name), "Can't copy %s in %s as-is, it is compressed, encrypted, or split into shards",
+             name.c_str(), zip_.fileName().c_str());
+
+    const auto& item = entry(name);
+    auto offset = zip_.dataOffset(item);
+    ActionStats::Timer timer(stats_, "copy", item.size);
+
+    // A mapped package is opened again, the kernel copies between file
+    // descriptors
+    if(zip_.data() != nullptr && !packageFile_.empty()) {
+        InputFile package(packageFile_);
+        out.copyFrom(package, offset, item.size);
+    } else {
+        out.copyFrom(zip_.file(), offset, item.size);
+    }
+}
+
+void StreamingModelReader::checkCopy(const string& name, const string& fileName) const
+{
+    const auto& item = entry(name);
+    EntryLayout layout;
+    auto expectedCrc = EntryLayout::fromExtraField(item.extra, layout) ? layout.crc : item.crc;
+
+    MappedFile copy(fileName);
+    DG_CHECK(copy.size() == item.size, "Size mismatch in %s: expected %llu bytes, got %llu", fileName.c_str(),
+             (unsigned long long) item.size, (unsigned long long) copy.size());
+
+    ActionStats::Timer timer(stats_, "checksum", copy.size());
+    uint32_t crc = crc32(0, Z_NULL, 0);
+    for(size_t offset = 0; offset < copy.size(); offset += MAX_CRC_SIZE) {
+        auto size = std::min(copy.size() - offset, MAX_CRC_SIZE);
+        crc = crc32(crc, copy.data() + offset, static_cast<uInt>(size));
+    }
+
+    DG_CHECK(crc == expectedCrc, "CRC mismatch in %s, the package is corrupt", name.c_str());
+}
+
+ItemSpan StreamingModelReader::mapItem(const string& name) const
+{
+    DG_CHECK(zip_.data() != nullptr, "Can't map %s, %s isn't mapped", name.c_str(), zip_.fileName().c_str());
+    DG_CHECK(!shards_.haveItem(name), "Can't map %s, it is split into shards", name.c_str());
+    DG_CHECK(isMappable(name), "Can't map %s in %s, it is compressed or encrypted", name.c_str(),
+             zip_.fileName().c_str());
+
+    const auto& item = entry(name);
+    auto offset = zip_.dataOffset(item);
+    DG_CHECK(offset <= zip_.size() && item.size <= zip_.size() - offset, "Unexpected end of file in %s",
+             zip_.fileName().c_str());
+
+    ItemSpan span;
+    span.data = zip_.data() + offset;
+    span.size = static_cast<size_t>(item.size);
+    return span;
+}
+
+void StreamingModelReader::readShards(const string& name, bool parallel, const ShardReader& read) const
+{
+    DG_CHECK(!packageFile_.empty(), "%s is split into shards, which can only be read next to a package file",
+             name.c_str());
+
+    auto readShard = [this, &name, &read](const Shard& shard) {
+        StreamingModelReader reader(shardPath(packageFile_, shard), key_, pool_);
+        reader.setStats(stats_);
+
+        auto decoder = reader.openItem(name);
+        DG_CHECK(decoder->haveLayout() && decoder->layout().size == shard.size && decoder->layout().crc == shard.crc,
+                 "Shard %s of %s doesn't match the shard index of %s", shard.fileName.c_str(), name.c_str(),
+                 zip_.fileName().c_str());
+
+        read(shard, *decoder);
+    };
+
+    // Shards are read on their own threads, separate from the pool the
+    // decoders use for chunks, the same way unpack reads items
+    auto shards = shards_.itemShards(name);
+    auto threads = parallel && pool_ ? pool_->size() : 1;
+    runEach(shards.size(), threads, [&readShard, &shards](size_t index) {
+        readShard(*shards[index]);
+    });
+}
+
+const ZipEntry& StreamingModelReader::entry(const string& name) const
+{
+    auto entry = zip_.find(name);
+    DG_CHECK(entry != nullptr, "%s is missing from %s", name.c_str(), zip_.fileName().c_str());
+    return *entry;
+}
+
+} } // namespace dg { namespace gbdxm {
@@ -0,0 +1,213 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef DEEPCORE_GBDXM_STREAMINGMODELREADER_H
+#define DEEPCORE_GBDXM_STREAMINGMODELREADER_H
+
+#include "EntryCodec.h"
+#include "ShardIndex.h"
+
+#include <classification/ModelPackage.h>
+#include <map>
+
+namespace dg { namespace gbdxm {
+
+/**
+ * Size and CRC-32 of a decoded item, as recorded in metadata.json.
+ */
+struct ItemChecksum
+{
+    uint64_t size = 0;
+    uint32_t crc = 0;
+};
+
+/**
+ * Formats a CRC-32 the way metadata.json and the shard index record it, as 8
+ * lowercase hex digits.
+ */
+std::string formatCrc(uint32_t crc);
+
+/**
+ * Parses a CRC-32 written by formatCrc(), returns false unless the text is 8
+ * hex digits.
+ */
+bool parseCrc(const std::string& text, uint32_t& crc);
+
+/**
+ * Read-only view of an item inside a package in memory.
+ */
+struct ItemSpan
+{
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+/**
+ * Reads packages written by StreamingModelWriter one chunk at a time.
+ * Packages written by GbdxModelWriter should be read with GbdxModelReader,
+ * use isStreamingPackage() to tell them apart.
+ */
+class StreamingModelReader
+{
+public:
+    /**
+     * @param fileName Package file name.
+     * @param key Decryption key, may be nullptr for plaintext packages.
+     * @param pool Pool for decrypting chunks in parallel, may be nullptr.
+     */
+    StreamingModelReader(const std::string& fileName, const PackageKey* key, ThreadPool* pool = nullptr);
+
+    /**
+     * Reads a package in memory, which must outlive the reader.
+     */
+    StreamingModelReader(const void* data, size_t size, const PackageKey* key, ThreadPool* pool = nullptr);
+
+    /**
+     * Reads a memory-mapped package, so that stored plaintext items can be
+     * used in place with mapItem().
+     */
+    explicit StreamingModelReader(MappedFile&& file, const PackageKey* key = nullptr, ThreadPool* pool = nullptr);
+
+    /**
+     * Returns true if the package was written by StreamingModelWriter, that
+     * is every entry has an entry layout record.
+     */
+    bool isStreamingPackage() const;
+
+    const ZipReader& zip() const { return zip_; }
+
+    /**
+     * Items of the package split into shard packages, empty if none are.
+     */
+    const ShardIndex& shards() const { return shards_; }
+
+    /**
+     * Collects the time spent reading and decoding items, may be nullptr.
+     */
+    void setStats(ActionStats* stats) { stats_ = stats; }
+
+    /**
+     * Engine extractItem() writes the items with, see
+     * OutputFile::queueWrites().
+     */
+    void setIoEngine(IoEngine engine) { ioEngine_ = engine; }
+
+    /**
+     * Reads the package metadata, without any of the model items. The model
+     * frameworks must be initialized, see initFrameworks().
+     * @param contentMap Filled with the item name to file name map.
+     * @param checksums Filled with the item checksums if not nullptr. Empty
+     *                  for packages written before checksums were recorded.
+     */
+    std::unique_ptr<deepcore::classification::ModelPackage> readPackage(std::map<std::string, std::string>& contentMap,
+                                                                        std::map<std::string, ItemChecksum>* checksums = nullptr) const;
+
+    /**
+     * Same as readPackage(), but only parses the metadata, which doesn't
+     * need the model frameworks.
+     */
+    std::unique_ptr<deepcore::classification::ModelMetadata> readMetadata(std::map<std::string, std::string>& contentMap,
+                                                                          std::map<std::string, ItemChecksum>* checksums = nullptr) const;
+
+    /**
+     * Parses metadata.json read by other means, e.g. from a pipe, the same
+     * way readMetadata() does.
+     */
+    static std::unique_ptr<deepcore::classification::ModelMetadata> parseMetadata(const std::string& metadata,
+                                                                                  std::map<std::string, std::string>& contentMap,
+                                                                                  std::map<std::string, ItemChecksum>* checksums,
+                                                                                  ActionStats* stats = nullptr);
+
+    /**
+     * Decodes an item, passing the data to sink one chunk at a time. The
+     * shards of a sharded item are read one after another.
+     */
+    void readItem(const std::string& name, const EntryDecoder::Sink& sink) const;
+
+    /**
+     * Decodes an item into a file. The shards of a sharded item are decoded
+     * at the same time, on as many threads as the pool has.
+     */
+    void extractItem(const std::string& name, const std::string& fileName) const;
+
+    /**
+     * Decodes an item without keeping the data, checking it against its
+     * entry CRC, or each of its shards against their SHA-256 and CRC in the
+     * shard index. Shards are checked at the same time, like extractItem().
+     * @return Size and CRC-32 of the item.
+     */
+    ItemChecksum checkItem(const std::string& name) const;
+
+    /**
+     * Opens an item for random access with EntryDecoder::readAt(). The
+     * decoder must not outlive this reader. Sharded items can't be opened.
+     */
+    std::unique_ptr<EntryDecoder> openItem(const std::string& name) const;
+
+    /**
+     * Returns true if the item is stored uncompressed and unencrypted in the
+     * package itself rather than in shards, so its bytes in the package are
+     * the item as-is.
+     */
+    bool isStored(const std::string& name) const;
+
+    /**
+     * Returns true if mapItem() can return the item: the package is in memory
+     * or mapped, and the item is stored, see isStored().
+     */
+    bool isMappable(const std::string& name) const;
+
+    /**
+     * Copies a stored item, see isStored(), from the package to the current
+     * position of out or the current entry of zip, without decoding it. The
+     * kernel copies it where possible, see OutputFile::copyFrom(). The CRC
+     * isn't checked, extractItem() reads the copy back to check it.
+     */
+    void copyItem(const std::string& name, OutputFile& out) const;
+    void copyItem(const std::string& name, ZipWriter& zip) const;
+
+    /**
+     * Returns the item where it is in the package, without copying or
+     * decoding it. Processes that map the same package share one copy of it
+     * in the page cache. The CRC isn't checked, and the data is only valid
+     * for as long as the reader.
+     */
+    ItemSpan mapItem(const std::string& name) const;
+
+private:
+    typedef std::function<void(const Shard& shard, EntryDecoder& decoder)> ShardReader;
+
+    const ZipEntry& entry(const std::string& name) const;
+    template<typename Output> void copyStored(const std::string& name, Output& out) const;
+    void checkCopy(const std::string& name, const std::string& fileName) const;
+    void readShards(const std::string& name, bool parallel, const ShardReader& read) const;
+
+    MappedFile file_;
+    ZipReader zip_;
+    const PackageKey* key_;
+    ThreadPool* pool_;
+    ActionStats* stats_ = nullptr;
+    IoEngine ioEngine_ = IoEngine::SYNC;
+
+    // Package file the shards are next to, empty for packages in memory
+    std::string packageFile_;
+    ShardIndex shards_;
+};
+
+} } // namespace dg { namespace gbdxm {
+
+#endif // DEEPCORE_GBDXM_STREAMINGMODELREADER_H
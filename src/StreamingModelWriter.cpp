@@ -0,0 +1,344 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "StreamingModelWriter.h"
+
+#include "StreamingModelReader.h"
+#include "gbdxm.h"
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <cmath>
+#include <classification/ModelMetadataJson.h>
+#include <json/json.h>
+#include <utility/Error.h>
+#include <utility/Logging.h>
+
+namespace dg { namespace gbdxm {
+
+namespace fs = boost::filesystem;
+
+using namespace dg::deepcore;
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace {
+
+/**
+ * Options for metadata.json and the shard index, which have to be readable
+ * without the key, and by readers that only know deflate, e.g.
+ * GbdxModelReader.
+ */
+EntryOptions plainOptions(const EntryOptions& options)
+{
+    auto plain = options;
+    plain.codec = EntryCodec::DEFLATE;
+    plain.level = DEFAULT_LEVEL;
+    plain.adaptive = false;
+    plain.key = nullptr;
+    return plain;
+}
+
+} // namespace
+
+StreamingModelWriter::StreamingModelWriter(const string& fileName,
+                                           const classification::ModelPackage& package,
+                                           const EntryOptions& options,
+                                           const BlobCache* cache) :
+    zip_(fileName, options.ioEngine),
+    package_(package),
+    options_(options),
+    encoder_(zip_, options),
+    cache_(cache)
+{
+    zip_.setAlignment(options.alignment);
+}
+
+StreamingModelWriter::StreamingModelWriter(ZipWriter&& zip,
+                                           const classification::ModelPackage& package,
+                                           const EntryOptions& options,
+                                           const BlobCache* cache) :
+    zip_(std::move(zip)),
+    package_(package),
+    options_(options),
+    encoder_(zip_, options),
+    cache_(cache)
+{
+    zip_.setAlignment(options.alignment);
+}
+
+void StreamingModelWriter::writeMetadata(const map<string, string>& contentMap)
+{
+    contentMap_ = contentMap;
+    haveMetadata_ = true;
+    zip_.reserveEntry("metadata.json");
+}
+
+void StreamingModelWriter::setShardSize(uint64_t shardSize)
+{
+    DG_CHECK(shardSize == 0 || shardSize >= MIN_SHARD_SIZE, "The shard size must be at least %llu bytes",
+             (unsigned long long) MIN_SHARD_SIZE);
+    DG_CHECK(shardSize == 0 || !zip_.isSequential(), "Packages written to a pipe can't be sharded");
+
+    shardSize_ = shardSize;
+    shards_.shardSize = shardSize;
+}
+
+void StreamingModelWriter::keepShards(const ShardIndex& shards)
+{
+    shards_ = shards;
+}
+
+void StreamingModelWriter::writeMetadataEntry()
+{
+    Json::Value root;
+    {
+        auto lock = lockFrameworks();
+        root = classification::ModelMetadataJson::toJson(package_.metadata());
+    }
+
+    auto& content = root["content"];
+    content = Json::Value(Json::objectValue);
+    for(const auto& mapItem : contentMap_) {
+        content[mapItem.first] = mapItem.second;
+    }
+
+    // Entries kept from an existing package have their checksums in the
+    // layout record too, so they don't have to be decoded again
+    auto& checksums = root["checksums"];
+    checksums = Json::Value(Json::objectValue);
+    for(const auto& entry : zip_.entries()) {
+        EntryLayout layout;
+        if(entry.name != "metadata.json" && entry.name != SHARD_INDEX_NAME &&
+           EntryLayout::fromExtraField(entry.extra, layout)) {
+            auto& checksum = checksums[entry.name];
+            checksum["crc32"] = formatCrc(layout.crc);
+            checksum["size"] = Json::UInt64(layout.size);
+        }
+    }
+
+    // Sharded items have no entries, their checksums are combined from those
+    // of their shards
+    if(!shards_.empty()) {
+        for(const auto& shard : shards_.shards) {
+            auto& checksum = checksums[shard.item];
+            checksum["crc32"] = formatCrc(shards_.itemCrc(shard.item));
+            checksum["size"] = Json::UInt64(shards_.itemSize(shard.item));
+        }
+
+        root["shards"] = SHARD_INDEX_NAME;
+    }
+
+    auto metadata = Json::StyledWriter().write(root);
+
+    auto metadataOptions = plainOptions(options_);
+    EntryEncoder encoder(zip_, metadataOptions);
+    encoder.begin("metadata.json", metadataOptions.codec, metadata.size());
+    encoder.write(reinterpret_cast<const uint8_t*>(metadata.data()), metadata.size());
+    encoder.end();
+}
+
+void StreamingModelWriter::addFile(const string& name, const string& fileName)
+{
+    // With io_uring the file is read ahead with several reads in flight
+    // instead of mapped, unless the cache or --adaptive need all of it at once
+    InputFile file(fileName);
+    auto size = file.size();
+    if(options_.ioEngine != IoEngine::URING || cache_ || options_.adaptive || (shardSize_ > 0 && size > shardSize_)) {
+        file.close();
+        addFile(name, MappedFile(fileName));
+        return;
+    }
+
+    file.queueReads(options_.ioEngine);
+    encoder_.begin(name, options_.codec, size);
+
+    vector<uint8_t> chunk(options_.chunkSize);
+    for(uint64_t offset = 0; offset < size; offset += chunk.size()) {
+        auto count = static_cast<size_t>(std::min<uint64_t>(chunk.size(), size - offset));
+        {
+            ActionStats::Timer timer(options_.stats, "read", count);
+            DG_CHECK(file.read(chunk.data(), count) == count, "Unexpected end of file in %s", fileName.c_str());
+        }
+
+        encoder_.write(chunk.data(), count);
+    }
+
+    encoder_.end();
+}
+
+void StreamingModelWriter::writeShardIndexEntry()
+{
+    auto index = shards_.toJson();
+
+    auto indexOptions = plainOptions(options_);
+    EntryEncoder encoder(zip_, indexOptions);
+    encoder.begin(SHARD_INDEX_NAME, indexOptions.codec, index.size());
+    encoder.write(reinterpret_cast<const uint8_t*>(index.data()), index.size());
+    encoder.end();
+}
+
+void StreamingModelWriter::addFile(const string& name, const MappedFile& file)
+{
+    auto codec = selectCodec(name, file.data(), file.size());
+
+    if(shardSize_ > 0 && file.size() > shardSize_) {
+        writeShards(name, codec, file.data(), file.size(), &file);
+        return;
+    }
+
+    string cacheKey;
+    if(cache_) {
+        auto options = options_;
+        options.codec = codec;
+        ActionStats::Timer timer(options_.stats, "cache");
+        cacheKey = cache_->key(name, file, options);
+        if(cache_->copyTo(cacheKey, name, zip_)) {
+            DG_LOG(gbdxm, info) << "Copied " << name << " from " << cache_->directory();
+            return;
+        }
+    }
+
+    file.adviseSequential();
+
+    encoder_.begin(name, codec, file.size());
+
+    for(size_t offset = 0; offset < file.size(); offset += options_.chunkSize) {
+        auto count = std::min(options_.chunkSize, file.size() - offset);
+        encoder_.write(file.data() + offset, count);
+
+        // The encoder has its own copy of the data now
+        file.release(offset, count);
+    }
+
+    encoder_.end();
+
+    if(cache_) {
+        ActionStats::Timer timer(options_.stats, "cache");
+        cache_->store(cacheKey, zip_);
+    }
+}
+
+void StreamingModelWriter::addFile(const string& name, const vector<uint8_t>& data)
+{
+    auto codec = selectCodec(name, data.data(), data.size());
+
+    if(shardSize_ > 0 && data.size() > shardSize_) {
+        writeShards(name, codec, data.data(), data.size(), nullptr);
+        return;
+    }
+
+    encoder_.begin(name, codec, data.size());
+    encoder_.write(data.data(), data.size());
+    encoder_.end();
+}
+
+void StreamingModelWriter::writeShards(const string& name, EntryCodec codec, const uint8_t* data, size_t size,
+                                       const MappedFile* file)
+{
+    if(file) {
+        file->adviseSequential();
+    }
+
+    for(uint64_t offset = 0; offset < size; offset += shardSize_) {
+        auto fileName = shardFileName(zip_.fileName(), shards_.shards.size() + 1);
+
+        Shard shard;
+        shard.fileName = fs::path(fileName).filename().string();
+        shard.item = name;
+        shard.offset = offset;
+        shard.size = std::min<uint64_t>(shardSize_, size - offset);
+
+        DG_LOG(gbdxm, info) << "Writing " << shard.size << " bytes of " << name << " at " << offset << " to "
+                            << fileName;
+
+        // Each shard is a streaming package with the piece of the item as
+        // its only entry
+        ZipWriter zip(fileName, options_.ioEngine);
+        zip.setAlignment(options_.alignment);
+        {
+            EntryEncoder encoder(zip, options_);
+            encoder.begin(name, codec, shard.size);
+
+            for(uint64_t done = 0; done < shard.size; done += options_.chunkSize) {
+                auto count = static_cast<size_t>(std::min<uint64_t>(options_.chunkSize, shard.size - done));
+                encoder.write(data + offset + done, count);
+
+                if(file) {
+                    file->release(static_cast<size_t>(offset + done), count);
+                }
+            }
+
+            encoder.end();
+        }
+
+        EntryLayout layout;
+        EntryLayout::fromExtraField(zip.lastEntry().extra, layout);
+        shard.crc = layout.crc;
+        zip.close();
+
+        shard.packageSize = fs::file_size(fileName);
+        {
+            ActionStats::Timer timer(options_.stats, "hash", shard.packageSize);
+            shard.sha256 = shardDigest(fileName);
+        }
+
+        shards_.shards.push_back(shard);
+    }
+
+    writeShardIndex_ = true;
+}
+
+void StreamingModelWriter::close()
+{
+    if(writeShardIndex_) {
+        writeShardIndexEntry();
+    }
+
+    if(haveMetadata_) {
+        writeMetadataEntry();
+    }
+
+    zip_.close();
+}
+
+EntryCodec StreamingModelWriter::selectCodec(const string& name, const uint8_t* data, size_t size) const
+{
+    if(!options_.adaptive || options_.codec == EntryCodec::STORE) {
+        return options_.codec;
+    }
+
+    double ratio;
+    {
+        ActionStats::Timer timer(options_.stats, "estimate", size);
+        ratio = estimateCompressionRatio(data, size);
+    }
+
+    auto percent = std::lround(ratio * 100);
+    if(ratio > ADAPTIVE_STORE_RATIO) {
+        DG_LOG(gbdxm, info) << "Storing " << name << " uncompressed, estimated to compress to " << percent << "%";
+        return EntryCodec::STORE;
+    }
+
+    DG_LOG(gbdxm, info) << "Compressing " << name << " with " << codecName(options_.codec)
+                        << ", estimated to compress to " << percent << "%";
+    return options_.codec;
+}
+
+} } // namespace dg { namespace gbdxm {
@@ -0,0 +1,119 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef DEEPCORE_GBDXM_STREAMINGMODELWRITER_H
+#define DEEPCORE_GBDXM_STREAMINGMODELWRITER_H
+
+#include "BlobCache.h"
+#include "EntryCodec.h"
+#include "FileIO.h"
+#include "ShardIndex.h"
+
+#include <classification/ModelPackage.h>
+#include <map>
+
+namespace dg { namespace gbdxm {
+
+/**
+ * Writes a GBDXM package the same way GbdxModelWriter does, except that model
+ * files are read, compressed, encrypted, and written one chunk at a time. Memory
+ * use does not depend on the size of the model.
+ *
+ * Model files are memory-mapped rather than read into a buffer, and the pages
+ * of each chunk are dropped once the chunk has been handed to the encoder.
+ * With io_uring as the I/O engine of the options they are read ahead in
+ * chunks instead, unless the cache or adaptive compression need the whole
+ * file at once.
+ *
+ * metadata.json records the size and CRC-32 of every item, as computed while
+ * encoding it, so it is written last. It still comes first in the central
+ * directory.
+ *
+ * Items larger than the shard size, if one is set, are split into shard
+ * packages next to the package, see ShardIndex.
+ */
+class StreamingModelWriter
+{
+public:
+    /**
+     * @param fileName Output package file name.
+     * @param package Package to take the metadata from.
+     * @param options Entry encoding options. Model files are encrypted if
+     *                options.key is set, metadata is always in plaintext.
+     * @param cache Cache of encoded model files, may be nullptr.
+     */
+    StreamingModelWriter(const std::string& fileName,
+                         const deepcore::classification::ModelPackage& package,
+                         const EntryOptions& options,
+                         const BlobCache* cache = nullptr);
+
+    /**
+     * Writes to an archive opened by the caller, e.g. an existing package
+     * being updated in place.
+     */
+    StreamingModelWriter(ZipWriter&& zip,
+                         const deepcore::classification::ModelPackage& package,
+                         const EntryOptions& options,
+                         const BlobCache* cache = nullptr);
+
+    /**
+     * Sets the item name to file name map of metadata.json. The metadata is
+     * written by close(), once the checksums of all items are known.
+     */
+    void writeMetadata(const std::map<std::string, std::string>& contentMap);
+
+    /**
+     * Splits items larger than shardSize into shard packages of shardSize
+     * bytes of the item each, written next to the package, which must be a
+     * file. Each shard is compressed and encrypted on its own. 0 doesn't
+     * shard. Sharded items aren't cached.
+     */
+    void setShardSize(uint64_t shardSize);
+
+    /**
+     * Keeps the shards of an existing package being updated in place, whose
+     * shards.json entry is kept as well.
+     */
+    void keepShards(const ShardIndex& shards);
+
+    void addFile(const std::string& name, const std::string& fileName);
+    void addFile(const std::string& name, const MappedFile& file);
+    void addFile(const std::string& name, const std::vector<uint8_t>& data);
+    void close();
+
+private:
+    EntryCodec selectCodec(const std::string& name, const uint8_t* data, size_t size) const;
+    void writeMetadataEntry();
+    void writeShards(const std::string& name, EntryCodec codec, const uint8_t* data, size_t size,
+                     const MappedFile* file);
+    void writeShardIndexEntry();
+
+    ZipWriter zip_;
+    const deepcore::classification::ModelPackage& package_;
+    EntryOptions options_;
+    EntryEncoder encoder_;
+    const BlobCache* cache_;
+    std::map<std::string, std::string> contentMap_;
+    bool haveMetadata_ = false;
+    uint64_t shardSize_ = 0;
+    ShardIndex shards_;
+    bool writeShardIndex_ = false;
+};
+
+} } // namespace dg { namespace gbdxm {
+
+#endif // DEEPCORE_GBDXM_STREAMINGMODELWRITER_H
@@ -0,0 +1,160 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+namespace dg { namespace gbdxm {
+
+using std::function;
+using std::future;
+using std::mutex;
+using std::packaged_task;
+using std::unique_lock;
+using std::vector;
+
+namespace {
+
+// Threads started by runEach() that are still running, nested calls
+// included
+std::atomic<size_t> eachThreads(0);
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t threads)
+{
+    if(threads == 0) {
+        threads = hardwareThreads();
+    }
+
+    threads_.reserve(threads);
+    for(size_t i = 0; i < threads; ++i) {
+        threads_.emplace_back(&ThreadPool::run, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        unique_lock<mutex> lock(mutex_);
+        stop_ = true;
+    }
+
+    cv_.notify_all();
+    for(auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+future<void> ThreadPool::submit(function<void()> task)
+{
+    packaged_task<void()> packagedTask(std::move(task));
+    auto ret = packagedTask.get_future();
+
+    {
+        unique_lock<mutex> lock(mutex_);
+        tasks_.push_back(std::move(packagedTask));
+    }
+
+    cv_.notify_one();
+    return ret;
+}
+
+size_t ThreadPool::hardwareThreads()
+{
+    auto threads = std::thread::hardware_concurrency();
+    return threads > 0 ? threads : 1;
+}
+
+void ThreadPool::run()
+{
+    for(;;) {
+        packaged_task<void()> task;
+
+        {
+            unique_lock<mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+
+            // Finish the queued tasks before stopping
+            if(tasks_.empty()) {
+                return;
+            }
+
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+
+        task();
+    }
+}
+
+void runEach(size_t count, size_t threads, const function<void(size_t index)>& task)
+{
+    if(threads == 0) {
+        threads = ThreadPool::hardwareThreads();
+    }
+
+    // Take what's left of the budget, up to one thread per task
+    auto wanted = std::min(threads, count);
+    auto used = eachThreads.load();
+    size_t reserved;
+    do {
+        reserved = used < threads ? std::min(wanted, threads - used) : 0;
+    } while(reserved > 1 && !eachThreads.compare_exchange_weak(used, used + reserved));
+
+    vector<std::exception_ptr> errors(count);
+    if(reserved > 1) {
+        {
+            ThreadPool pool(reserved);
+            vector<future<void>> results;
+            for(size_t i = 0; i < count; ++i) {
+                results.push_back(pool.submit([&task, &errors, i] {
+                    try {
+                        task(i);
+                    } catch(...) {
+                        errors[i] = std::current_exception();
+                    }
+                }));
+            }
+
+            for(auto& result : results) {
+                result.wait();
+            }
+        }
+
+        eachThreads -= reserved;
+    } else {
+        for(size_t i = 0; i < count; ++i) {
+            try {
+                task(i);
+            } catch(...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    }
+
+    for(const auto& error : errors) {
+        if(error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+} } // namespace dg { namespace gbdxm {
@@ -0,0 +1,86 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef DEEPCORE_GBDXM_THREADPOOL_H
+#define DEEPCORE_GBDXM_THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dg { namespace gbdxm {
+
+/**
+ * Fixed size pool of worker threads running tasks in FIFO order.
+ */
+class ThreadPool
+{
+public:
+    /**
+     * @param threads Number of worker threads, 0 means one per CPU core.
+     */
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return threads_.size(); }
+
+    /**
+     * Queues a task. Exceptions thrown by the task are rethrown by the
+     * returned future.
+     */
+    std::future<void> submit(std::function<void()> task);
+
+    /**
+     * Returns the number of CPU cores, or 1 if it cannot be determined.
+     */
+    static size_t hardwareThreads();
+
+private:
+    void run();
+
+    std::vector<std::thread> threads_;
+    std::deque<std::packaged_task<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+};
+
+/**
+ * Runs task for each index from 0 to count - 1 on threads of its own,
+ * separate from any pool the tasks wait on, so a task waiting for its chunks
+ * can never keep those chunks from running. Every task runs to the end
+ * before the first error is rethrown.
+ *
+ * Nested calls share one budget of threads: a call only gets the threads
+ * that calls still running around it haven't taken, and runs its tasks on
+ * the calling thread if there are none left. Items that read their shards in
+ * parallel never use more than threads threads between them.
+ *
+ * @param threads Number of threads to use, 0 means one per CPU core.
+ */
+void runEach(size_t count, size_t threads, const std::function<void(size_t index)>& task);
+
+} } // namespace dg { namespace gbdxm {
+
+#endif // DEEPCORE_GBDXM_THREADPOOL_H
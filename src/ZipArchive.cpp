@@ -0,0 +1,780 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "ZipArchive.h"
+
+#include "ByteOrder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <utility/Error.h>
+
+namespace dg { namespace gbdxm {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+const uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;
+const uint32_t CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+const uint32_t END_OF_CENTRAL_DIR_SIGNATURE = 0x06054b50;
+const uint32_t DATA_DESCRIPTOR_SIGNATURE = 0x08074b50;
+const uint32_t ZIP64_END_OF_CENTRAL_DIR_SIGNATURE = 0x06064b50;
+const uint32_t ZIP64_END_OF_CENTRAL_DIR_LOCATOR_SIGNATURE = 0x07064b50;
+
+const size_t LOCAL_HEADER_SIZE = 30;
+const size_t CENTRAL_HEADER_SIZE = 46;
+const size_t END_OF_CENTRAL_DIR_SIZE = 22;
+const size_t ZIP64_END_OF_CENTRAL_DIR_SIZE = 56;
+const size_t ZIP64_END_OF_CENTRAL_DIR_LOCATOR_SIZE = 20;
+const size_t ZIP64_LOCAL_EXTRA_SIZE = 20;
+const size_t MAX_COMMENT_SIZE = 0xffff;
+const size_t STREAM_BUFFER_SIZE = 1 << 20;
+
+const uint16_t VERSION_NEEDED = 20;
+const uint16_t VERSION_ZIP64 = 45;
+const uint16_t VERSION_MADE_BY = (3 << 8) | VERSION_NEEDED; // Unix
+const uint16_t VERSION_MADE_BY_ZIP64 = (3 << 8) | VERSION_ZIP64;
+const uint32_t EXTERNAL_ATTRIBUTES = 0100644u << 16;
+
+uint32_t checkedSize(uint64_t size, const string& name)
+{
+    DG_CHECK(size < ZIP64_LIMIT, "Entry %s reached 4 GB without room for Zip64 sizes in its local header",
+             name.c_str());
+    return static_cast<uint32_t>(size);
+}
+
+/**
+ * Returns the extra field without the record with the given header ID.
+ */
+vector<uint8_t> removeExtraField(const vector<uint8_t>& extra, uint16_t headerId)
+{
+    vector<uint8_t> ret;
+    size_t pos = 0;
+    while(pos + 4 <= extra.size()) {
+        auto size = get16(&extra[pos + 2]);
+        auto end = std::min(pos + 4 + size, extra.size());
+        if(get16(&extra[pos]) != headerId) {
+            ret.insert(ret.end(), extra.begin() + pos, extra.begin() + end);
+        }
+
+        pos = end;
+    }
+
+    return ret;
+}
+
+/**
+ * Fills in the sizes and offset of an entry that are too large for its
+ * header from its Zip64 record, and removes the record from its extra field.
+ * The record only has the values whose header fields are 0xffffffff, in the
+ * order size, compressed size, offset.
+ */
+void readZip64Extra(ZipEntry& entry, bool readOffset, const string& fileName)
+{
+    vector<uint8_t> data;
+    if(!findExtraField(entry.extra, ZIP64_EXTRA_ID, data)) {
+        return;
+    }
+
+    size_t pos = 0;
+    auto next = [&](uint64_t& value) {
+        if(value == ZIP64_LIMIT) {
+            DG_CHECK(pos + 8 <= data.size(), "Invalid Zip64 extra field of %s in %s", entry.name.c_str(),
+                     fileName.c_str());
+            value = get64(&data[pos]);
+            pos += 8;
+        }
+    };
+
+    next(entry.size);
+    next(entry.compressedSize);
+    if(readOffset) {
+        next(entry.offset);
+    }
+
+    entry.extra = removeExtraField(entry.extra, ZIP64_EXTRA_ID);
+}
+
+void dosDateTime(uint16_t& date, uint16_t& time)
+{
+    auto now = ::time(nullptr);
+    struct tm tm;
+    localtime_r(&now, &tm);
+
+    date = static_cast<uint16_t>(((std::max(tm.tm_year, 80) - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+    time = static_cast<uint16_t>((tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2));
+}
+
+} // namespace
+
+bool findExtraField(const vector<uint8_t>& extra, uint16_t headerId, vector<uint8_t>& data)
+{
+    size_t pos = 0;
+    while(pos + 4 <= extra.size()) {
+        auto id = get16(&extra[pos]);
+        auto size = get16(&extra[pos + 2]);
+        pos += 4;
+
+        if(pos + size > extra.size()) {
+            break;
+        }
+
+        if(id == headerId) {
+            data.assign(extra.begin() + pos, extra.begin() + pos + size);
+            return true;
+        }
+
+        pos += size;
+    }
+
+    return false;
+}
+
+vector<uint8_t> makeExtraField(uint16_t headerId, const vector<uint8_t>& data)
+{
+    DG_CHECK(data.size() <= 0xffff, "Zip extra field is too large");
+
+    vector<uint8_t> ret;
+    put16(ret, headerId);
+    put16(ret, static_cast<uint16_t>(data.size()));
+    ret.insert(ret.end(), data.begin(), data.end());
+    return ret;
+}
+
+ZipWriter::ZipWriter(const string& fileName, IoEngine engine) :
+    file_(fileName)
+{
+    // Local headers are patched with writeAt(), which waits for the queue
+    file_.queueWrites(engine);
+    dosDateTime(date_, time_);
+}
+
+ZipWriter::ZipWriter(vector<uint8_t>& buffer) :
+    file_(buffer, "package in memory")
+{
+    dosDateTime(date_, time_);
+}
+
+ZipWriter::ZipWriter(OutputFile&& pipe) :
+    file_(std::move(pipe)),
+    sequential_(true)
+{
+    dosDateTime(date_, time_);
+}
+
+ZipWriter::ZipWriter(const string& fileName, const vector<ZipEntry>& entries, uint64_t offset) :
+    entries_(entries),
+    truncate_(true)
+{
+    file_.openAt(fileName, offset);
+    dosDateTime(date_, time_);
+}
+
+void ZipWriter::beginEntry(const string& name, uint16_t method, const vector<uint8_t>& extra, bool zip64)
+{
+    DG_CHECK(!inEntry_, "Cannot start %s, previous zip entry was not finished", name.c_str());
+    DG_CHECK(name.size() <= 0xffff && extra.size() <= 0xffff, "Zip entry name or extra field is too long");
+
+    ZipEntry entry;
+    entry.name = name;
+    entry.method = method;
+    entry.time = time_;
+    entry.date = date_;
+    entry.offset = file_.position();
+    if(sequential_) {
+        entry.flags |= ZIP_FLAG_DATA_DESCRIPTOR;
+    }
+
+    // CRC and sizes are filled in by endEntry(). With Zip64 the sizes are
+    // 0xffffffff, and the real ones go in the Zip64 record.
+    vector<uint8_t> header;
+    header.reserve(LOCAL_HEADER_SIZE + name.size() + extra.size());
+    put32(header, LOCAL_HEADER_SIGNATURE);
+    put16(header, zip64 ? VERSION_ZIP64 : VERSION_NEEDED);
+    put16(header, entry.flags);
+    put16(header, entry.method);
+    put16(header, entry.time);
+    put16(header, entry.date);
+    put32(header, 0);
+    put32(header, zip64 ? 0xffffffffu : 0);
+    put32(header, zip64 ? 0xffffffffu : 0);
+
+    // The Zip64 and padding records go after the caller's extra field, so
+    // that endEntry() can still update it in place
+    auto localExtra = extra;
+    if(zip64) {
+        localZip64_ = LOCAL_HEADER_SIZE + name.size() + localExtra.size();
+        auto record = makeExtraField(ZIP64_EXTRA_ID, vector<uint8_t>(ZIP64_LOCAL_EXTRA_SIZE - 4));
+        localExtra.insert(localExtra.end(), record.begin(), record.end());
+    }
+
+    if(alignment_ > 1 && method == ZIP_METHOD_STORE) {
+        auto end = entry.offset + LOCAL_HEADER_SIZE + name.size() + localExtra.size();
+        auto padding = (alignment_ - end % alignment_) % alignment_;
+        while(padding > 0 && padding < 6) {
+            padding += alignment_;
+        }
+
+        if(padding > 0) {
+            vector<uint8_t> data;
+            put16(data, static_cast<uint16_t>(alignment_));
+            data.resize(padding - 4);
+
+            auto record = makeExtraField(ALIGNMENT_EXTRA_ID, data);
+            localExtra.insert(localExtra.end(), record.begin(), record.end());
+            DG_CHECK(localExtra.size() <= 0xffff, "Zip extra field of %s is too long to align", name.c_str());
+        }
+    }
+
+    put16(header, static_cast<uint16_t>(name.size()));
+    put16(header, static_cast<uint16_t>(localExtra.size()));
+    header.insert(header.end(), name.begin(), name.end());
+    header.insert(header.end(), localExtra.begin(), localExtra.end());
+    file_.write(header.data(), header.size());
+
+    auto it = std::find_if(entries_.begin(), entries_.end(), [&name](const ZipEntry& existing) {
+        return existing.name == name;
+    });
+
+    current_ = static_cast<size_t>(it - entries_.begin());
+    if(it != entries_.end()) {
+        *it = std::move(entry);
+    } else {
+        entries_.push_back(std::move(entry));
+    }
+
+    reserved_.erase(name);
+
+    localExtra_ = extra;
+    zip64_ = zip64;
+    dataOffset_ = file_.position();
+    inEntry_ = true;
+}
+
+void ZipWriter::write(const void* data, size_t size)
+{
+    DG_CHECK(inEntry_, "No zip entry to write to");
+    file_.write(data, size);
+}
+
+void ZipWriter::copyFrom(const InputFile& file, uint64_t offset, uint64_t size)
+{
+    DG_CHECK(inEntry_, "No zip entry to write to");
+    file_.copyFrom(file, offset, size);
+}
+
+void ZipWriter::endEntry(uint32_t crc, uint64_t size, const vector<uint8_t>& extra)
+{
+    DG_CHECK(inEntry_, "No zip entry to finish");
+    DG_CHECK(extra.size() <= 0xffff, "Zip extra field is too long");
+
+    auto& entry = entries_[current_];
+    entry.crc = crc;
+    entry.size = size;
+    entry.compressedSize = file_.position() - dataOffset_;
+    entry.extra = extra;
+
+    // Readers tell the 64-bit data descriptor apart by the Zip64 record in
+    // the local header
+    if(sequential_) {
+        vector<uint8_t> descriptor;
+        put32(descriptor, DATA_DESCRIPTOR_SIGNATURE);
+        put32(descriptor, entry.crc);
+        if(zip64_) {
+            put64(descriptor, entry.compressedSize);
+            put64(descriptor, entry.size);
+        } else {
+            put32(descriptor, checkedSize(entry.compressedSize, entry.name));
+            put32(descriptor, checkedSize(entry.size, entry.name));
+        }
+        file_.write(descriptor.data(), descriptor.size());
+
+        inEntry_ = false;
+        return;
+    }
+
+    // Patch the local header now that the CRC and sizes are known
+    vector<uint8_t> sizes;
+    put32(sizes, entry.crc);
+    if(zip64_) {
+        vector<uint8_t> zip64Sizes;
+        put64(zip64Sizes, entry.size);
+        put64(zip64Sizes, entry.compressedSize);
+        file_.writeAt(entry.offset + localZip64_ + 4, zip64Sizes.data(), zip64Sizes.size());
+    } else {
+        put32(sizes, checkedSize(entry.compressedSize, entry.name));
+        put32(sizes, checkedSize(entry.size, entry.name));
+    }
+    file_.writeAt(entry.offset + 14, sizes.data(), sizes.size());
+
+    if(!extra.empty() && extra.size() == localExtra_.size()) {
+        file_.writeAt(entry.offset + LOCAL_HEADER_SIZE + entry.name.size(), extra.data(), extra.size());
+    }
+
+    inEntry_ = false;
+}
+
+void ZipWriter::setAlignment(size_t alignment)
+{
+    DG_CHECK(alignment <= MAX_ALIGNMENT && (alignment & (alignment - 1)) == 0,
+             "Invalid zip alignment %d: must be a power of two up to %d", (int) alignment, (int) MAX_ALIGNMENT);
+    alignment_ = alignment;
+}
+
+void ZipWriter::reserveEntry(const string& name)
+{
+    auto it = std::find_if(entries_.begin(), entries_.end(), [&name](const ZipEntry& existing) {
+        return existing.name == name;
+    });
+
+    if(it == entries_.end()) {
+        ZipEntry entry;
+        entry.name = name;
+        entries_.push_back(std::move(entry));
+        reserved_.insert(name);
+    }
+}
+
+void ZipWriter::close()
+{
+    DG_CHECK(!inEntry_, "Cannot close the archive, last zip entry was not finished");
+    if(!reserved_.empty()) {
+        DG_ERROR_THROW("Cannot close the archive, %s was never written", reserved_.begin()->c_str());
+    }
+
+    auto centralDirOffset = file_.position();
+
+    vector<uint8_t> header;
+    for(const auto& entry : entries_) {
+        // Values that don't fit are 0xffffffff, and go in the Zip64 record
+        vector<uint8_t> zip64;
+        auto field = [&zip64](uint64_t value) {
+            if(value < ZIP64_LIMIT) {
+                return static_cast<uint32_t>(value);
+            }
+
+            put64(zip64, value);
+            return 0xffffffffu;
+        };
+
+        auto size = field(entry.size);
+        auto compressedSize = field(entry.compressedSize);
+        auto offset = field(entry.offset);
+
+        auto extra = entry.extra;
+        if(!zip64.empty()) {
+            auto record = makeExtraField(ZIP64_EXTRA_ID, zip64);
+            extra.insert(extra.end(), record.begin(), record.end());
+            DG_CHECK(extra.size() <= 0xffff, "Zip extra field of %s is too long for its Zip64 record",
+                     entry.name.c_str());
+        }
+
+        header.clear();
+        put32(header, CENTRAL_HEADER_SIGNATURE);
+        put16(header, zip64.empty() ? VERSION_MADE_BY : VERSION_MADE_BY_ZIP64);
+        put16(header, zip64.empty() ? VERSION_NEEDED : VERSION_ZIP64);
+        put16(header, entry.flags);
+        put16(header, entry.method);
+        put16(header, entry.time);
+        put16(header, entry.date);
+        put32(header, entry.crc);
+        put32(header, compressedSize);
+        put32(header, size);
+        put16(header, static_cast<uint16_t>(entry.name.size()));
+        put16(header, static_cast<uint16_t>(extra.size()));
+        put16(header, 0); // comment length
+        put16(header, 0); // disk number
+        put16(header, 0); // internal attributes
+        put32(header, EXTERNAL_ATTRIBUTES);
+        put32(header, offset);
+        header.insert(header.end(), entry.name.begin(), entry.name.end());
+        header.insert(header.end(), extra.begin(), extra.end());
+        file_.write(header.data(), header.size());
+    }
+
+    auto centralDirSize = file_.position() - centralDirOffset;
+    uint64_t count = entries_.size();
+
+    // The Zip64 end of central directory record and its locator go right
+    // before the end of central directory record, whose fields that don't
+    // fit are left at their maximum
+    bool zip64 = count >= 0xffff || centralDirSize >= ZIP64_LIMIT || centralDirOffset >= ZIP64_LIMIT;
+    if(zip64) {
+        auto zip64EndOffset = file_.position();
+
+        header.clear();
+        put32(header, ZIP64_END_OF_CENTRAL_DIR_SIGNATURE);
+        put64(header, ZIP64_END_OF_CENTRAL_DIR_SIZE - 12);
+        put16(header, VERSION_MADE_BY_ZIP64);
+        put16(header, VERSION_ZIP64);
+        put32(header, 0);
+        put32(header, 0);
+        put64(header, count);
+        put64(header, count);
+        put64(header, centralDirSize);
+        put64(header, centralDirOffset);
+
+        put32(header, ZIP64_END_OF_CENTRAL_DIR_LOCATOR_SIGNATURE);
+        put32(header, 0);
+        put64(header, zip64EndOffset);
+        put32(header, 1);
+        file_.write(header.data(), header.size());
+    }
+
+    header.clear();
+    put32(header, END_OF_CENTRAL_DIR_SIGNATURE);
+    put16(header, 0);
+    put16(header, 0);
+    put16(header, static_cast<uint16_t>(std::min<uint64_t>(count, 0xffff)));
+    put16(header, static_cast<uint16_t>(std::min<uint64_t>(count, 0xffff)));
+    put32(header, static_cast<uint32_t>(std::min(centralDirSize, ZIP64_LIMIT)));
+    put32(header, static_cast<uint32_t>(std::min(centralDirOffset, ZIP64_LIMIT)));
+    put16(header, 0);
+    file_.write(header.data(), header.size());
+
+    if(truncate_) {
+        file_.truncate();
+    }
+
+    file_.close();
+}
+
+ZipReader::ZipReader(const string& fileName) :
+    file_(fileName)
+{
+    readCentralDirectory();
+}
+
+ZipReader::ZipReader(const void* data, size_t size, const string& name) :
+    file_(data, size, name)
+{
+    readCentralDirectory();
+}
+
+const ZipEntry* ZipReader::find(const string& name) const
+{
+    auto it = index_.find(name);
+    if(it == index_.end()) {
+        return nullptr;
+    }
+
+    return &entries_[it->second];
+}
+
+uint64_t ZipReader::dataOffset(const ZipEntry& entry) const
+{
+    uint8_t header[LOCAL_HEADER_SIZE];
+    file_.readAt(entry.offset, header, sizeof(header));
+    DG_CHECK(get32(header) == LOCAL_HEADER_SIGNATURE, "Invalid local header for %s in %s",
+             entry.name.c_str(), file_.fileName().c_str());
+
+    return entry.offset + LOCAL_HEADER_SIZE + get16(header + 26) + get16(header + 28);
+}
+
+vector<uint8_t> ZipReader::localExtra(const ZipEntry& entry) const
+{
+    uint8_t header[LOCAL_HEADER_SIZE];
+    file_.readAt(entry.offset, header, sizeof(header));
+    DG_CHECK(get32(header) == LOCAL_HEADER_SIGNATURE, "Invalid local header for %s in %s",
+             entry.name.c_str(), file_.fileName().c_str());
+
+    vector<uint8_t> extra(get16(header + 28));
+    file_.readAt(entry.offset + LOCAL_HEADER_SIZE + get16(header + 26), extra.data(), extra.size());
+    return extra;
+}
+
+void ZipReader::readAt(uint64_t offset, void* data, size_t size) const
+{
+    file_.readAt(offset, data, size);
+}
+
+void ZipReader::readCentralDirectory()
+{
+    auto fileSize = file_.size();
+    DG_CHECK(fileSize >= END_OF_CENTRAL_DIR_SIZE, "%s is not a zip file", file_.fileName().c_str());
+
+    // The end of central directory record is followed by a comment of up to 64K
+    auto tailSize = static_cast<size_t>(std::min<uint64_t>(fileSize, END_OF_CENTRAL_DIR_SIZE + MAX_COMMENT_SIZE));
+    vector<uint8_t> tail(tailSize);
+    file_.readAt(fileSize - tailSize, tail.data(), tail.size());
+
+    size_t eocd = tailSize - END_OF_CENTRAL_DIR_SIZE + 1;
+    do {
+        --eocd;
+    } while(eocd > 0 && get32(&tail[eocd]) != END_OF_CENTRAL_DIR_SIGNATURE);
+
+    DG_CHECK(get32(&tail[eocd]) == END_OF_CENTRAL_DIR_SIGNATURE, "%s is not a zip file", file_.fileName().c_str());
+
+    uint64_t count = get16(&tail[eocd + 10]);
+    uint64_t centralDirSize = get32(&tail[eocd + 12]);
+    centralDirOffset_ = get32(&tail[eocd + 16]);
+
+    // Zip64 archives have the real values in the Zip64 end of central
+    // directory record, found through the locator right before the end of
+    // central directory record
+    auto eocdOffset = fileSize - tailSize + eocd;
+    if(eocdOffset >= ZIP64_END_OF_CENTRAL_DIR_LOCATOR_SIZE) {
+        uint8_t locator[ZIP64_END_OF_CENTRAL_DIR_LOCATOR_SIZE];
+        file_.readAt(eocdOffset - sizeof(locator), locator, sizeof(locator));
+        if(get32(locator) == ZIP64_END_OF_CENTRAL_DIR_LOCATOR_SIGNATURE) {
+            auto zip64EndOffset = get64(locator + 8);
+            uint8_t record[ZIP64_END_OF_CENTRAL_DIR_SIZE];
+            DG_CHECK(zip64EndOffset + sizeof(record) <= eocdOffset, "Invalid Zip64 end of central directory in %s",
+                     file_.fileName().c_str());
+            file_.readAt(zip64EndOffset, record, sizeof(record));
+            DG_CHECK(get32(record) == ZIP64_END_OF_CENTRAL_DIR_SIGNATURE,
+                     "Invalid Zip64 end of central directory in %s", file_.fileName().c_str());
+
+            count = get64(record + 32);
+            centralDirSize = get64(record + 40);
+            centralDirOffset_ = get64(record + 48);
+        }
+    }
+
+    DG_CHECK(centralDirOffset_ <= fileSize && centralDirSize <= fileSize - centralDirOffset_,
+             "Invalid central directory in %s", file_.fileName().c_str());
+
+    vector<uint8_t> centralDir(static_cast<size_t>(centralDirSize));
+    file_.readAt(centralDirOffset_, centralDir.data(), centralDir.size());
+
+    // Every entry takes at least a central header
+    DG_CHECK(count <= centralDir.size() / CENTRAL_HEADER_SIZE, "Invalid central directory in %s",
+             file_.fileName().c_str());
+    entries_.reserve(static_cast<size_t>(count));
+    size_t pos = 0;
+    for(uint64_t i = 0; i < count; ++i) {
+        DG_CHECK(pos + CENTRAL_HEADER_SIZE <= centralDir.size() && get32(&centralDir[pos]) == CENTRAL_HEADER_SIGNATURE,
+                 "Invalid central directory in %s", file_.fileName().c_str());
+
+        const auto* header = &centralDir[pos];
+        auto nameSize = get16(header + 28);
+        auto extraSize = get16(header + 30);
+        auto commentSize = get16(header + 32);
+        DG_CHECK(pos + CENTRAL_HEADER_SIZE + nameSize + extraSize + commentSize <= centralDir.size(),
+                 "Invalid central directory in %s", file_.fileName().c_str());
+
+        ZipEntry entry;
+        entry.flags = get16(header + 8);
+        entry.method = get16(header + 10);
+        entry.time = get16(header + 12);
+        entry.date = get16(header + 14);
+        entry.crc = get32(header + 16);
+        entry.compressedSize = get32(header + 20);
+        entry.size = get32(header + 24);
+        entry.offset = get32(header + 42);
+
+        const auto* name = header + CENTRAL_HEADER_SIZE;
+        entry.name.assign(name, name + nameSize);
+        entry.extra.assign(name + nameSize, name + nameSize + extraSize);
+        readZip64Extra(entry, true, file_.fileName());
+
+        index_[entry.name] = entries_.size();
+        entries_.push_back(std::move(entry));
+
+        pos += CENTRAL_HEADER_SIZE + nameSize + extraSize + commentSize;
+    }
+}
+
+ZipStreamReader::ZipStreamReader(InputFile&& pipe) :
+    file_(std::move(pipe)),
+    buffer_(STREAM_BUFFER_SIZE)
+{
+}
+
+bool ZipStreamReader::nextEntry(ZipEntry& entry)
+{
+    DG_CHECK(!inEntry_, "Cannot read the next entry of %s, the current one was not finished", fileName().c_str());
+
+    uint8_t header[LOCAL_HEADER_SIZE];
+    DG_CHECK(fill(4), "%s ended before the central directory", fileName().c_str());
+
+    auto signature = get32(&buffer_[begin_]);
+    if(signature == CENTRAL_HEADER_SIGNATURE || signature == END_OF_CENTRAL_DIR_SIGNATURE) {
+        // Nothing is left to extract, but whoever is writing the pipe
+        // expects it to be read to the end
+        begin_ = end_;
+        while(file_.read(buffer_.data(), buffer_.size()) > 0) {
+        }
+
+        return false;
+    }
+
+    DG_CHECK(signature == LOCAL_HEADER_SIGNATURE && fill(sizeof(header)),
+             "Invalid local header at offset %llu in %s", (unsigned long long) position_, fileName().c_str());
+    memcpy(header, &buffer_[begin_], sizeof(header));
+    begin_ += sizeof(header);
+
+    entry = ZipEntry();
+    entry.offset = position_;
+    entry.flags = get16(header + 6);
+    entry.method = get16(header + 8);
+    entry.time = get16(header + 10);
+    entry.date = get16(header + 12);
+    entry.crc = get32(header + 14);
+    entry.compressedSize = get32(header + 18);
+    entry.size = get32(header + 22);
+
+    auto nameSize = get16(header + 26);
+    auto extraSize = get16(header + 28);
+    DG_CHECK(fill(nameSize + extraSize), "%s ended in the middle of a local header", fileName().c_str());
+    entry.name.assign(&buffer_[begin_], &buffer_[begin_] + nameSize);
+    entry.extra.assign(&buffer_[begin_] + nameSize, &buffer_[begin_] + nameSize + extraSize);
+    begin_ += nameSize + extraSize;
+    position_ += sizeof(header) + nameSize + extraSize;
+
+    // Entries with a Zip64 record have 64-bit sizes in the data descriptor
+    vector<uint8_t> zip64;
+    zip64_ = findExtraField(entry.extra, ZIP64_EXTRA_ID, zip64);
+    readZip64Extra(entry, false, fileName());
+
+    inEntry_ = true;
+    knownSize_ = (entry.flags & ZIP_FLAG_DATA_DESCRIPTOR) == 0;
+    remaining_ = entry.compressedSize;
+    consumed_ = 0;
+    return true;
+}
+
+size_t ZipStreamReader::read(void* data, size_t size)
+{
+    DG_CHECK(inEntry_, "No zip entry to read from");
+
+    if(knownSize_) {
+        size = static_cast<size_t>(std::min<uint64_t>(size, remaining_));
+        if(size == 0) {
+            return 0;
+        }
+    }
+
+    DG_CHECK(fill(1), "%s ended in the middle of an entry", fileName().c_str());
+
+    auto count = std::min(size, end_ - begin_);
+    memcpy(data, &buffer_[begin_], count);
+    begin_ += count;
+    position_ += count;
+    consumed_ += count;
+    if(knownSize_) {
+        remaining_ -= count;
+    }
+
+    return count;
+}
+
+void ZipStreamReader::readFully(void* data, size_t size)
+{
+    auto out = static_cast<uint8_t*>(data);
+    while(size > 0) {
+        auto count = read(out, size);
+        DG_CHECK(count > 0, "Unexpected end of entry data in %s", fileName().c_str());
+        out += count;
+        size -= count;
+    }
+}
+
+void ZipStreamReader::unread(size_t size)
+{
+    DG_CHECK(size <= begin_ && size <= consumed_, "Cannot unread more than was read from %s", fileName().c_str());
+
+    begin_ -= size;
+    position_ -= size;
+    consumed_ -= size;
+    if(knownSize_) {
+        remaining_ += size;
+    }
+}
+
+bool ZipStreamReader::peek(void* data, size_t size)
+{
+    if(!fill(size)) {
+        return false;
+    }
+
+    memcpy(data, &buffer_[begin_], size);
+    return true;
+}
+
+void ZipStreamReader::endEntry(ZipEntry& entry)
+{
+    DG_CHECK(inEntry_, "No zip entry to finish");
+
+    if(knownSize_) {
+        uint8_t skip[4096];
+        while(read(skip, sizeof(skip)) > 0) {
+        }
+
+        inEntry_ = false;
+        return;
+    }
+
+    // The signature of the data descriptor is optional
+    size_t descriptorSize = zip64_ ? 20 : 12;
+    DG_CHECK(fill(descriptorSize), "%s ended before the data descriptor of %s", fileName().c_str(),
+             entry.name.c_str());
+    if(get32(&buffer_[begin_]) == DATA_DESCRIPTOR_SIGNATURE && fill(descriptorSize + 4)) {
+        begin_ += 4;
+        position_ += 4;
+    }
+
+    uint8_t descriptor[20];
+    memcpy(descriptor, &buffer_[begin_], descriptorSize);
+    begin_ += descriptorSize;
+    position_ += descriptorSize;
+
+    entry.crc = get32(descriptor);
+    if(zip64_) {
+        entry.compressedSize = get64(descriptor + 4);
+        entry.size = get64(descriptor + 12);
+    } else {
+        entry.compressedSize = get32(descriptor + 4);
+        entry.size = get32(descriptor + 8);
+    }
+    DG_CHECK(entry.compressedSize == consumed_, "Invalid data descriptor of %s in %s", entry.name.c_str(),
+             fileName().c_str());
+
+    inEntry_ = false;
+}
+
+bool ZipStreamReader::fill(size_t size)
+{
+    if(end_ - begin_ >= size) {
+        return true;
+    }
+
+    DG_CHECK(size <= buffer_.size(), "Zip header is too large in %s", fileName().c_str());
+
+    // Move what's left to the start of the buffer to make room
+    if(begin_ > 0) {
+        std::copy(buffer_.begin() + begin_, buffer_.begin() + end_, buffer_.begin());
+        end_ -= begin_;
+        begin_ = 0;
+    }
+
+    while(end_ < size) {
+        auto count = file_.read(&buffer_[end_], buffer_.size() - end_);
+        if(count == 0) {
+            return false;
+        }
+
+        end_ += count;
+    }
+
+    return true;
+}
+
+} } // namespace dg { namespace gbdxm {
@@ -0,0 +1,331 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+* Author: Aleksey Vitebskiy
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef DEEPCORE_GBDXM_ZIPARCHIVE_H
+#define DEEPCORE_GBDXM_ZIPARCHIVE_H
+
+#include "FileIO.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace dg { namespace gbdxm {
+
+const uint16_t ZIP_METHOD_STORE = 0;
+const uint16_t ZIP_METHOD_DEFLATE = 8;
+
+// General purpose flag of entries followed by a data descriptor
+const uint16_t ZIP_FLAG_DATA_DESCRIPTOR = 0x0008;
+
+/**
+ * Sizes and offsets from this one up don't fit the zip headers, and are
+ * recorded in a Zip64 extended information extra field record instead.
+ */
+const uint64_t ZIP64_LIMIT = 0xffffffffu;
+const uint16_t ZIP64_EXTRA_ID = 0x0001;
+
+/**
+ * Zip extra field header ID of the alignment padding record, the same one
+ * Android's zipalign writes. Holds the alignment followed by zero padding.
+ */
+const uint16_t ALIGNMENT_EXTRA_ID = 0xd935;
+const size_t MAX_ALIGNMENT = 32768;
+
+/**
+ * A single zip archive entry, as recorded in the central directory.
+ */
+struct ZipEntry
+{
+    std::string name;
+    uint16_t method = ZIP_METHOD_STORE;
+    uint16_t flags = 0;
+    uint16_t time = 0;
+    uint16_t date = 0;
+    uint32_t crc = 0;
+    uint64_t compressedSize = 0;
+    uint64_t size = 0;
+    uint64_t offset = 0;
+
+    // Extra field without the Zip64 record, which is added and read by the
+    // archive classes as needed
+    std::vector<uint8_t> extra;
+};
+
+/**
+ * Finds the extra field record with the given header ID.
+ * @param extra Extra field data.
+ * @param headerId Extra field header ID.
+ * @param data Record data, excluding the header ID and size.
+ * @return true if the record was found.
+ */
+bool findExtraField(const std::vector<uint8_t>& extra, uint16_t headerId, std::vector<uint8_t>& data);
+
+/**
+ * Builds an extra field record with the given header ID.
+ */
+std::vector<uint8_t> makeExtraField(uint16_t headerId, const std::vector<uint8_t>& data);
+
+/**
+ * Minimal zip archive writer that writes entry data as it's given, so that
+ * entries never have to be held in memory.
+ *
+ * Entry data is written as-is, compression and encryption are up to the
+ * caller.
+ */
+class ZipWriter
+{
+public:
+    /**
+     * @param engine Engine the archive is written with, see
+     *               OutputFile::queueWrites().
+     */
+    explicit ZipWriter(const std::string& fileName, IoEngine engine = IoEngine::SYNC);
+
+    /**
+     * Writes the archive to a memory buffer, which must outlive the writer.
+     */
+    explicit ZipWriter(std::vector<uint8_t>& buffer);
+
+    /**
+     * Writes the archive to a file that can't seek, e.g. standard output.
+     * The CRC and sizes of each entry follow its data in a data descriptor
+     * instead of being filled into its local header, so the local extra
+     * field keeps what beginEntry() was given.
+     */
+    explicit ZipWriter(OutputFile&& pipe);
+
+    /**
+     * Reopens an existing archive to add entries to it in place.
+     * @param fileName Archive file name.
+     * @param entries Entries to keep, usually from ZipReader::entries().
+     *                Their data is left where it is.
+     * @param offset Where to write new entries, past the data of the kept
+     *               entries. Anything after the new central directory is cut
+     *               off when the archive is closed.
+     */
+    ZipWriter(const std::string& fileName, const std::vector<ZipEntry>& entries, uint64_t offset);
+
+    /**
+     * Starts a new entry. An existing entry with the same name is replaced,
+     * keeping its place in the central directory.
+     * @param name Entry name.
+     * @param method Compression method of the data that will be written.
+     * @param extra Local header extra field.
+     * @param zip64 Reserve room for 64-bit sizes in the local header, or the
+     *              data descriptor when writing to a pipe. Entries that may
+     *              reach 4 GB must have it.
+     */
+    void beginEntry(const std::string& name, uint16_t method, const std::vector<uint8_t>& extra = {},
+                    bool zip64 = false);
+
+    /**
+     * Pads the local headers of stored entries started after this, so that
+     * their data starts at a multiple of alignment in the file. The padding
+     * is an extra field record, which zip readers skip. 0 or 1 doesn't
+     * align.
+     */
+    void setAlignment(size_t alignment);
+
+    /**
+     * Reserves a place in the central directory for an entry that will be
+     * written later, e.g. metadata that depends on the entries after it.
+     * Does nothing if the entry already exists.
+     */
+    void reserveEntry(const std::string& name);
+
+    /**
+     * Appends data to the current entry.
+     */
+    void write(const void* data, size_t size);
+
+    /**
+     * Appends size bytes of another file, starting at offset, to the current
+     * entry, copied in the kernel where possible, see OutputFile::copyFrom().
+     */
+    void copyFrom(const InputFile& file, uint64_t offset, uint64_t size);
+
+    /**
+     * Finishes the current entry.
+     * @param crc CRC-32 of the uncompressed entry data.
+     * @param size Uncompressed size of the entry data.
+     * @param extra Central directory extra field. If it is the same size as
+     *              the local extra field, the local one is updated as well.
+     */
+    void endEntry(uint32_t crc, uint64_t size, const std::vector<uint8_t>& extra);
+
+    /**
+     * Writes the central directory and closes the file. The central
+     * directory has Zip64 records for the entries, and the archive, that
+     * need them.
+     */
+    void close();
+
+    const std::string& fileName() const { return file_.fileName(); }
+    const std::vector<ZipEntry>& entries() const { return entries_; }
+    uint64_t position() const { return file_.position(); }
+    bool isSequential() const { return sequential_; }
+
+    // Current or last entry written
+    const ZipEntry& lastEntry() const { return entries_[current_]; }
+
+    // File offset of the data of the current or last entry
+    uint64_t dataOffset() const { return dataOffset_; }
+
+private:
+    OutputFile file_;
+    std::vector<ZipEntry> entries_;
+    std::vector<uint8_t> localExtra_;
+    size_t localZip64_ = 0;
+    bool zip64_ = false;
+    size_t current_ = 0;
+    uint64_t dataOffset_ = 0;
+    size_t alignment_ = 0;
+    uint16_t time_ = 0;
+    uint16_t date_ = 0;
+    bool inEntry_ = false;
+    bool truncate_ = false;
+    bool sequential_ = false;
+    std::set<std::string> reserved_;
+};
+
+/**
+ * Zip archive reader that loads the central directory and reads entry data
+ * directly from the file, without going through minizip. Reads Zip64
+ * archives and entries.
+ */
+class ZipReader
+{
+public:
+    explicit ZipReader(const std::string& fileName);
+
+    /**
+     * Reads an archive in memory, which must outlive the reader.
+     * @param name Name used in error messages.
+     */
+    ZipReader(const void* data, size_t size, const std::string& name = "package in memory");
+
+    const std::string& fileName() const { return file_.fileName(); }
+    uint64_t size() const { return file_.size(); }
+
+    // Archive in memory, nullptr if the archive is read from a file
+    const uint8_t* data() const { return file_.data(); }
+    const InputFile& file() const { return file_; }
+    const std::vector<ZipEntry>& entries() const { return entries_; }
+    uint64_t centralDirOffset() const { return centralDirOffset_; }
+
+    /**
+     * Finds an entry by name.
+     * @return The entry, or nullptr if it doesn't exist.
+     */
+    const ZipEntry* find(const std::string& name) const;
+
+    /**
+     * Returns the file offset of the entry data, past its local header.
+     */
+    uint64_t dataOffset(const ZipEntry& entry) const;
+
+    /**
+     * Returns the extra field of the local header of the entry, which may
+     * differ from the one in the central directory, e.g. by its padding.
+     */
+    std::vector<uint8_t> localExtra(const ZipEntry& entry) const;
+
+    /**
+     * Reads exactly size bytes of the archive at the given offset.
+     */
+    void readAt(uint64_t offset, void* data, size_t size) const;
+
+private:
+    void readCentralDirectory();
+
+    InputFile file_;
+    std::vector<ZipEntry> entries_;
+    std::map<std::string, size_t> index_;
+    uint64_t centralDirOffset_ = 0;
+};
+
+/**
+ * Reads a zip archive front to back from a pipe, e.g. standard input, going
+ * by the local headers instead of the central directory.
+ *
+ * Entries with a data descriptor don't say how long their data is up front,
+ * the caller has to find the end from the data itself and give back what it
+ * read past the end with unread().
+ */
+class ZipStreamReader
+{
+public:
+    explicit ZipStreamReader(InputFile&& pipe);
+
+    const std::string& fileName() const { return file_.fileName(); }
+
+    /**
+     * Reads the local header of the next entry. The previous entry must have
+     * been finished with endEntry().
+     * @return false once the central directory is reached, after reading
+     *         the rest of the archive.
+     */
+    bool nextEntry(ZipEntry& entry);
+
+    /**
+     * Reads up to size bytes of entry data, returns 0 at the end of an entry
+     * with a known size. Throws at the end of the file.
+     */
+    size_t read(void* data, size_t size);
+
+    /**
+     * Reads exactly size bytes of entry data.
+     */
+    void readFully(void* data, size_t size);
+
+    /**
+     * Gives back the last size bytes returned by the last read().
+     */
+    void unread(size_t size);
+
+    /**
+     * Copies the next size bytes to data without consuming them.
+     * @return false if the file ends first.
+     */
+    bool peek(void* data, size_t size);
+
+    /**
+     * Finishes the current entry. Skips the rest of an entry with a known
+     * size, or reads the data descriptor and fills in the CRC and sizes.
+     */
+    void endEntry(ZipEntry& entry);
+
+private:
+    bool fill(size_t size);
+
+    InputFile file_;
+    std::vector<uint8_t> buffer_;
+    size_t begin_ = 0;
+    size_t end_ = 0;
+    uint64_t position_ = 0;
+    bool inEntry_ = false;
+    bool knownSize_ = false;
+    bool zip64_ = false;
+    uint64_t remaining_ = 0;
+    uint64_t consumed_ = 0;
+};
+
+} } // namespace dg { namespace gbdxm {
+
+#endif // DEEPCORE_GBDXM_ZIPARCHIVE_H
@@ -17,14 +17,28 @@
 
 #include "gbdxm.h"
 
+#include "JsonFieldScanner.h"
+#include "PackageDelta.h"
+#include "Stats.h"
+#include "StreamingModelReader.h"
+#include "StreamingModelWriter.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
 #include <classification/CaffeModelPackage.h>
+#include <classification/Classification.h>
 #include <classification/GbdxModelReader.h>
 #include <classification/GbdxModelWriter.h>
+#include <json/json.h>
+#include <mutex>
+#include <sstream>
+#include <unistd.h>
 #include <utility/Error.h>
 #include <utility/File.h>
 #include <utility/Logging.h>
+#include <zlib.h>
 
 namespace dg {namespace gbdxm {
 
@@ -36,21 +50,68 @@ using std::cout;
 using std::endl;
 using std::ios;
 using std::map;
+using std::ostream;
 using std::ofstream;
 using std::string;
+using std::unique_ptr;
 using std::vector;
 
-void showModel(const GbdxmArgs& args);
+void showModel(const GbdxmShowArgs& args, ostream& out);
+void showEntries(const GbdxmShowArgs& args, const ZipReader& zip, ostream& out);
+void listEntries(const ZipReader& zip, const string& shard, uint64_t pageSize, Json::Value& entries);
 void packModel(GbdxmPackArgs& args);
-void unpackModel(const GbdxmUnpackArgs& args);
+void unpackModel(const GbdxmUnpackArgs& args, ostream& out);
+void packStreaming(GbdxmPackArgs& args, const map<string, string>& contentMap);
+void unpackStreaming(const GbdxmUnpackArgs& args, const StreamingModelReader& reader, ostream& out);
+void unpackStandardInput(const GbdxmUnpackArgs& args, ostream& out);
+map<string, string> selectItems(const GbdxmUnpackArgs& args, const map<string, string>& contentMap);
+void updateModel(GbdxmUpdateArgs& args);
+void runBatch(const GbdxmBatchArgs& args);
+void verifyModel(const GbdxmArgs& args, ostream& out);
+void deltaModel(const GbdxmDeltaArgs& args);
+void patchModel(const GbdxmPatchArgs& args);
+void writePackageFile(const string& fileName, IoEngine engine, const std::function<void(ZipWriter&&)>& write);
 void writeLabels(const string& fileName, const vector<string>& labels);
+void writeStats(const GbdxmArgs& args, ostream& out);
+string packageName(const GbdxmArgs& args);
+void checkPackageFile(const GbdxmArgs& args);
+unique_ptr<StreamingModelReader> openPackage(const GbdxmArgs& args, const PackageKey* key, ThreadPool* pool);
+unique_ptr<PackageKey> readKey(const GbdxmArgs& args);
+unique_ptr<ThreadPool> createThreadPool(const GbdxmArgs& args);
 
 void doAction(GbdxmArgs& args)
 {
+    runAction(args, cout);
+}
+
+void initFrameworks()
+{
+    static std::once_flag initialized;
+    std::call_once(initialized, [] {
+        DG_LOG(gbdxm, info) << "Initializing model frameworks";
+        classification::init();
+    });
+}
+
+std::unique_lock<std::recursive_mutex> lockFrameworks()
+{
+    // Recursive, update reads the package metadata while parsing its arguments
+    static std::recursive_mutex mutex;
+    return std::unique_lock<std::recursive_mutex>(mutex);
+}
+
+void runAction(GbdxmArgs& args, ostream& out)
+{
+    // Blocking I/O, with a warning, where io_uring isn't available
+    args.ioEngine = supportedIoEngine(args.ioEngine);
+
     switch(args.action) {
         case Action::SHOW:
-            showModel(args);
+        {
+            auto& showArgs = static_cast<GbdxmShowArgs&>(args);
+            showModel(showArgs, out);
             break;
+        }
 
         case Action::PACK:
         {
@@ -62,47 +123,239 @@ void doAction(GbdxmArgs& args)
         case Action::UNPACK:
         {
             auto& unpackArgs = static_cast<GbdxmUnpackArgs&>(args);
-            unpackModel(unpackArgs);
+            unpackModel(unpackArgs, out);
+            break;
+        }
+
+        case Action::UPDATE:
+        {
+            auto& updateArgs = static_cast<GbdxmUpdateArgs&>(args);
+            updateModel(updateArgs);
+            break;
+        }
+
+        case Action::BATCH:
+        {
+            auto& batchArgs = static_cast<GbdxmBatchArgs&>(args);
+            runBatch(batchArgs);
             break;
         }
 
+        case Action::VERIFY:
+            verifyModel(args, out);
+            break;
+
+        case Action::DELTA:
+            deltaModel(static_cast<GbdxmDeltaArgs&>(args));
+            break;
+
+        case Action::PATCH:
+            patchModel(static_cast<GbdxmPatchArgs&>(args));
+            break;
+
         default:
             // HELP would've been handled by command line arguments parser
             DG_ERROR_THROW("Invalid action");
     }
+
+    if(args.stats) {
+        writeStats(args, out);
+    }
 }
 
-void showModel(const GbdxmArgs& args)
+void showModel(const GbdxmShowArgs& args, ostream& out)
 {
-    DG_LOG(gbdxm, info) << "Showing metadata of " << args.gbdxFile;
+    DG_LOG(gbdxm, info) << "Showing metadata of " << packageName(args);
+    checkPackageFile(args);
+
+    // Only the central directory and metadata.json are read, wherever it is
+    // in the archive
+    DG_LOG(gbdxm, info) << "Opening " << packageName(args);
+    unique_ptr<ZipReader> zip;
+    {
+        ActionStats::Timer timer(args.stats.get(), "open");
+        zip.reset(args.packageData ? new ZipReader(args.packageData, args.packageSize) : new ZipReader(args.gbdxFile));
+    }
 
-    DG_CHECK(fs::exists(args.gbdxFile), "Input file does not exist at %s", args.gbdxFile.c_str());
-    DG_CHECK(!fs::is_directory(args.gbdxFile), "Input file at %s is a directory", args.gbdxFile.c_str());
+    if(args.entries) {
+        showEntries(args, *zip, out);
+        return;
+    }
 
-    DG_LOG(gbdxm, info) << "Opening " << args.gbdxFile;
-    UnZipFile unzFile(args.gbdxFile);
+    auto entry = zip->find("metadata.json");
+    DG_CHECK(entry != nullptr, "metadata.json is missing from %s", packageName(args).c_str());
 
     DG_LOG(gbdxm, info) << "Reading metadata.json";
-    DG_CHECK(unzFile.fileName() == "metadata.json",
-             "Expecting metadata.json, found %s instead", unzFile.fileName().c_str());
+    EntryDecoder decoder(*zip, *entry, nullptr);
+    decoder.setStats(args.stats.get());
+
+    auto stats = args.stats.get();
+    if(args.fields.empty() && args.format == ShowFormat::JSON) {
+        decoder.decode([&out, stats](const uint8_t* data, size_t size) {
+            ActionStats::Timer timer(stats, "write", size);
+            out.write(reinterpret_cast<const char*>(data), size);
+        });
+        out << endl;
+
+        DG_LOG(gbdxm, info) <<  "Done";
+        return;
+    }
+
+    // Decoding stops as soon as the requested fields are found, so fields
+    // that come before the labels don't inflate the whole label list
+    JsonFieldScanner scanner(args.fields);
+    decoder.decode([&scanner, &decoder, stats](const uint8_t* data, size_t size) {
+        ActionStats::Timer timer(stats, "parse", size);
+        scanner.write(reinterpret_cast<const char*>(data), size);
+        if(scanner.haveAllFields()) {
+            decoder.stop();
+        }
+    });
+    DG_CHECK(scanner.haveAllFields() || scanner.isComplete(), "Invalid metadata: unexpected end of JSON");
 
-    auto metadata = unzFile.readFileToString();
-    cout << metadata.c_str() << endl;
+    auto fields = args.fields;
+    if(fields.empty()) {
+        for(const auto& value : scanner.values()) {
+            fields.push_back(value.first);
+        }
+    }
+
+    ActionStats::Timer parseTimer(stats, "parse");
+    Json::Value root(Json::objectValue);
+    for(const auto& field : fields) {
+        auto it = scanner.values().find(field);
+        if(it == scanner.values().end()) {
+            DG_LOG(gbdxm, warning) << "Metadata field \"" << field << "\" not found";
+            root[field] = Json::Value();
+            continue;
+        }
+
+        Json::Reader reader;
+        DG_CHECK(reader.parse(it->second, root[field]), "Error parsing metadata field \"%s\": %s",
+                 field.c_str(), reader.getFormattedErrorMessages().c_str());
+    }
+
+    if(args.format == ShowFormat::JSON) {
+        out << Json::StyledWriter().write(root) << endl;
+    } else {
+        for(const auto& field : fields) {
+            const auto& value = root[field];
+            auto text = value.isString() ? value.asString() : value.isNull() ? string() : Json::FastWriter().write(value);
+            boost::algorithm::trim_right(text);
+            out << field << "=" << text << endl;
+        }
+    }
+
+    DG_LOG(gbdxm, info) <<  "Done";
+}
+
+void listEntries(const ZipReader& zip, const string& shard, uint64_t pageSize, Json::Value& entries)
+{
+    for(const auto& entry : zip.entries()) {
+        auto offset = zip.dataOffset(entry);
+
+        // Largest power of two the data offset is a multiple of
+        uint64_t alignment = 1;
+        while(alignment < MAX_ALIGNMENT && offset % (alignment * 2) == 0) {
+            alignment *= 2;
+        }
+
+        string method = entry.method == ZIP_METHOD_STORE ? "store" :
+                        entry.method == ZIP_METHOD_DEFLATE ? "deflate" :
+                        entry.method == ZIP_METHOD_ZSTD ? "zstd" : std::to_string(entry.method);
+
+        Json::Value item;
+        item["name"] = entry.name;
+        item["method"] = method;
+        item["offset"] = Json::UInt64(offset);
+        item["compressedSize"] = Json::UInt64(entry.compressedSize);
+        item["size"] = Json::UInt64(entry.size);
+        item["alignment"] = Json::UInt64(alignment);
+        item["aligned"] = offset % pageSize == 0;
+        if(!shard.empty()) {
+            item["shard"] = shard;
+        }
+
+        entries.append(item);
+    }
+}
+
+void showEntries(const GbdxmShowArgs& args, const ZipReader& zip, ostream& out)
+{
+    auto pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+
+    // The shard packages of a sharded package are opened at the same time,
+    // and their entries are listed after those of the package
+    vector<std::pair<const ZipReader*, string>> packages;
+    packages.emplace_back(&zip, string());
+    vector<unique_ptr<ZipReader>> shardZips;
+    ShardIndex shards;
+    if(ShardIndex::read(zip, shards)) {
+        DG_CHECK(!args.packageData, "%s is a sharded package, its shards can only be read next to its file",
+                 packageName(args).c_str());
+
+        shardZips.resize(shards.shards.size());
+        ThreadPool pool(std::min(args.threads > 0 ? args.threads : ThreadPool::hardwareThreads(), shardZips.size()));
+        vector<std::future<void>> opened;
+        for(size_t i = 0; i < shardZips.size(); ++i) {
+            auto fileName = shardPath(args.gbdxFile, shards.shards[i]);
+            auto& shardZip = shardZips[i];
+            opened.push_back(pool.submit([&shardZip, fileName] {
+                shardZip.reset(new ZipReader(fileName));
+            }));
+        }
+
+        for(auto& result : opened) {
+            result.wait();
+        }
+
+        for(size_t i = 0; i < shardZips.size(); ++i) {
+            opened[i].get();
+            packages.emplace_back(shardZips[i].get(), shards.shards[i].fileName);
+        }
+    }
+
+    Json::Value entries(Json::arrayValue);
+    for(const auto& package : packages) {
+        listEntries(*package.first, package.second, pageSize, entries);
+    }
+
+    if(args.format == ShowFormat::JSON) {
+        Json::Value root;
+        root["pageSize"] = Json::UInt64(pageSize);
+        root["entries"] = entries;
+        out << Json::StyledWriter().write(root) << endl;
+    } else {
+        for(const auto& item : entries) {
+            out << item["name"].asString() << " method=" << item["method"].asString()
+                << " offset=" << item["offset"].asUInt64() << " compressedSize=" << item["compressedSize"].asUInt64()
+                << " size=" << item["size"].asUInt64() << " alignment=" << item["alignment"].asUInt64()
+                << " aligned=" << (item["aligned"].asBool() ? "yes" : "no");
+            if(item.isMember("shard")) {
+                out << " shard=" << item["shard"].asString();
+            }
+            out << endl;
+        }
+    }
 
     DG_LOG(gbdxm, info) <<  "Done";
 }
 
 void packModel(GbdxmPackArgs& args)
 {
-    DG_LOG(gbdxm, info) << "Packing " << args.package->type() << " model to " << args.gbdxFile;
+    bool toStdout = !args.packageOutput && args.gbdxFile == "-";
+    DG_LOG(gbdxm, info) << "Packing " << args.package->type() << " model to "
+                        << (args.packageOutput ? "memory" : toStdout ? "standard output" : args.gbdxFile);
 
     // Make sure the output file can be created
-    DG_CHECK(!fs::is_directory(args.gbdxFile), "Cannot write to output, %s is a directory.", args.gbdxFile.c_str());
+    if(!args.packageOutput && !toStdout) {
+        DG_CHECK(!fs::is_directory(args.gbdxFile), "Cannot write to output, %s is a directory.", args.gbdxFile.c_str());
 
-    auto parentPath = fs::path(args.gbdxFile).parent_path();
-    if(!parentPath.empty() && !fs::exists(parentPath)) {
-        DG_LOG(gbdxm, info) << "Creating directory " << parentPath.string();
-        fs::create_directories(parentPath);
+        auto parentPath = fs::path(args.gbdxFile).parent_path();
+        if(!parentPath.empty() && !fs::exists(parentPath)) {
+            DG_LOG(gbdxm, info) << "Creating directory " << parentPath.string();
+            fs::create_directories(parentPath);
+        }
     }
 
     auto& package = *args.package;
@@ -117,14 +370,24 @@ void packModel(GbdxmPackArgs& args)
         errors.push_back(DG_ERROR_INIT("Label file does not exist at '%s'", args.labelsFile.c_str()));
     }
 
-    // Find out the total file size while we're checking the files
+    // Find out the total and largest file sizes while we're checking the files
     int64_t totalFileSize = 0;
+    uint64_t largestFileSize = 0;
     for(const auto& mapItem : args.modelFiles) {
+        auto data = args.modelData.find(mapItem.first);
+        if(data != args.modelData.end()) {
+            totalFileSize += data->second.size();
+            continue;
+        }
+
         if(!fs::exists(mapItem.second) || fs::is_directory(mapItem.second)) {
             errors.push_back(DG_ERROR_INIT("File does not exist for %s at '%s'", mapItem.first.c_str(), mapItem.second.c_str()));
             continue;
         }
-        totalFileSize += fs::file_size(mapItem.second);
+
+        auto fileSize = fs::file_size(mapItem.second);
+        totalFileSize += fileSize;
+        largestFileSize = std::max<uint64_t>(largestFileSize, fileSize);
     }
 
     if(!errors.empty()) {
@@ -139,47 +402,152 @@ void packModel(GbdxmPackArgs& args)
 
     if(!args.labelsFile.empty()) {
         DG_LOG(gbdxm, info) << "Reading labels from " << args.labelsFile;
+        ActionStats::Timer timer(args.stats.get(), "labels", fs::file_size(args.labelsFile));
         metadata.setLabels(readLinesFromFile(args.labelsFile));
     }
 
-    DG_LOG(gbdxm, info) << "Creating " << args.gbdxFile;
-    classification::GbdxModelWriter writer(args.gbdxFile, package, args.encrypt);
-
     // Prepare the metadata map by stripping path, leaving just the file names.
     auto contentMap = args.modelFiles;
     for(auto& mapItem : contentMap) {
         mapItem.second = fs::path(mapItem.second).filename().string();
     }
 
-    DG_LOG(gbdxm, info) << "Writing metadata";
-    writer.writeMetadata(contentMap);
+    // GbdxModelWriter can't write Zip64 entries or offsets, so model files
+    // of 4 GB and up, or that add up to nearly that with the headers and
+    // metadata, only fit in a streaming package. That changes the format,
+    // so it has to be asked for.
+    DG_CHECK(args.stream || args.packageOutput || toStdout ||
+             (largestFileSize < ZIP64_LIMIT && static_cast<uint64_t>(totalFileSize) < ZIP64_LIMIT - ZIP64_LIMIT / 16),
+             "The model files add up to %s, which needs Zip64. Pack models of 4 GB and up with --stream, and "
+             "--plaintext or --key-file. DeepCore loaders may not read the resulting package.",
+             formatBytes(static_cast<uint64_t>(totalFileSize)).c_str());
+
+    // Packages in memory and on standard output are always streaming
+    // packages, GbdxModelWriter only writes to files it can seek in
+    if(args.stream || args.packageOutput || toStdout) {
+        packStreaming(args, contentMap);
+    } else {
+        // GbdxModelWriter reads, compresses, encrypts, and writes in one go,
+        // so it's timed as a single phase
+        ActionStats::Timer timer(args.stats.get(), "pack", totalFileSize);
+
+        // Only creating the writer and converting the metadata use the
+        // frameworks, the model files are compressed and encrypted by the
+        // writer alongside other jobs
+        auto lock = lockFrameworks();
+        DG_LOG(gbdxm, info) << "Creating " << args.gbdxFile;
+        classification::GbdxModelWriter writer(args.gbdxFile, package, args.encrypt);
+
+        DG_LOG(gbdxm, info) << "Writing metadata";
+        writer.writeMetadata(contentMap);
+        lock.unlock();
 
-    // Add model files
+        // Add model files
+        for(const auto& mapItem : args.modelFiles) {
+            DG_LOG(gbdxm, info) << "Adding " << mapItem.first << " from " << mapItem.second;
+            if(package.haveItem(mapItem.first)) {
+                writer.addFile(mapItem.first, package.item(mapItem.first));
+            } else if(args.modelData.count(mapItem.first)) {
+                writer.addFile(mapItem.first, args.modelData.at(mapItem.first));
+            } else {
+                writer.addFile(mapItem.first, mapItem.second);
+            }
+        }
+
+        DG_LOG(gbdxm, info) << "Closing " << args.gbdxFile;
+        writer.close();
+    }
+
+    DG_LOG(gbdxm, info) << "Peak memory usage: " << formatBytes(peakResidentBytes());
+    DG_LOG(gbdxm, info) << "Done";
+}
+
+void packStreaming(GbdxmPackArgs& args, const map<string, string>& contentMap)
+{
+    auto& package = *args.package;
+
+    EntryOptions options;
+    options.codec = args.compression;
+    options.level = args.level;
+    options.adaptive = args.adaptive;
+    options.alignment = args.align;
+    options.stats = args.stats.get();
+    options.ioEngine = args.ioEngine;
+
+    unique_ptr<PackageKey> key;
+    if(args.encrypt) {
+        DG_CHECK(!args.keyFile.empty(), "Streaming encrypted packages requires --key-file, or use --plaintext");
+        key = readKey(args);
+        options.key = key.get();
+    }
+
+    auto pool = createThreadPool(args);
+    options.pool = pool.get();
+
+    // Model files are mapped from disk, so drop the copies loaded for
+    // metadata detection before we start.
     for(const auto& mapItem : args.modelFiles) {
-        DG_LOG(gbdxm, info) << "Adding " << mapItem.first << " from " << mapItem.second;
         if(package.haveItem(mapItem.first)) {
-            writer.addFile(mapItem.first, package.item(mapItem.first));
-        } else {
-            writer.addFile(mapItem.first, mapItem.second);
+            package.setItem(mapItem.first, vector<uint8_t>());
         }
     }
 
-    DG_LOG(gbdxm, info) << "Closing " << args.gbdxFile;
-    writer.close();
+    // Shards are written next to the package file
+    DG_CHECK(args.shardSize == 0 || (!args.packageOutput && args.gbdxFile != "-"),
+             "Packages in memory or on standard output cannot be sharded");
 
-    DG_LOG(gbdxm, info) << "Done";
+    unique_ptr<BlobCache> cache;
+    if(!args.cacheDir.empty()) {
+        // The cache copies entries back out of the package file
+        DG_CHECK(!args.packageOutput && args.gbdxFile != "-",
+                 "A cache directory cannot be used when packing to memory or standard output");
+        DG_LOG(gbdxm, info) << "Using cache in " << args.cacheDir;
+        cache.reset(new BlobCache(args.cacheDir));
+    }
+
+    auto outputName = args.packageOutput ? string("package in memory")
+                    : args.gbdxFile == "-" ? string("standard output") : args.gbdxFile;
+    DG_LOG(gbdxm, info) << "Creating " << outputName << " with " << codecName(options.codec) << " compression in "
+                        << formatBytes(options.chunkSize) << " chunks";
+    unique_ptr<StreamingModelWriter> writer;
+    if(args.packageOutput) {
+        writer.reset(new StreamingModelWriter(ZipWriter(*args.packageOutput), package, options));
+    } else if(args.gbdxFile == "-") {
+        // Entries are followed by data descriptors, nothing is patched
+        writer.reset(new StreamingModelWriter(ZipWriter(OutputFile::standardOutput()), package, options));
+    } else {
+        writer.reset(new StreamingModelWriter(args.gbdxFile, package, options, cache.get()));
+    }
+
+    writer->writeMetadata(contentMap);
+
+    if(args.shardSize > 0) {
+        DG_LOG(gbdxm, info) << "Splitting model files larger than " << formatBytes(args.shardSize) << " into shards";
+        writer->setShardSize(args.shardSize);
+    }
+
+    for(const auto& mapItem : args.modelFiles) {
+        auto data = args.modelData.find(mapItem.first);
+        if(data != args.modelData.end()) {
+            DG_LOG(gbdxm, info) << "Adding " << mapItem.first << " from memory";
+            writer->addFile(mapItem.first, data->second);
+        } else {
+            DG_LOG(gbdxm, info) << "Adding " << mapItem.first << " from " << mapItem.second;
+            writer->addFile(mapItem.first, mapItem.second);
+        }
+    }
+
+    DG_LOG(gbdxm, info) << "Writing metadata and closing " << outputName;
+    writer->close();
 }
 
-void unpackModel(const GbdxmUnpackArgs& args)
+void unpackModel(const GbdxmUnpackArgs& args, ostream& out)
 {
-    DG_LOG(gbdxm, info) << "Unpacking " << args.gbdxFile << " to " << args.outputDir;
-
-    // Make sure the input file exists
-    DG_CHECK(fs::exists(args.gbdxFile), "Input file does not exist at %s",  args.gbdxFile.c_str());
-    DG_CHECK(!fs::is_directory(args.gbdxFile), "Input file at %s is a directory", args.gbdxFile.c_str());
+    DG_LOG(gbdxm, info) << "Unpacking " << packageName(args) << " to "
+                        << (args.itemSink ? "memory" : args.toStdout ? "standard output" : args.outputDir);
 
     // Make sure the output directory exists and create one if it doesn't
-    if(!fs::is_directory(args.outputDir)) {
+    if(!args.toStdout && !args.itemSink && !fs::is_directory(args.outputDir)) {
         DG_CHECK(!fs::exists(args.outputDir),
                  "Could not create output directory at %s, already a file.", args.outputDir.c_str());
 
@@ -187,32 +555,626 @@ void unpackModel(const GbdxmUnpackArgs& args)
         fs::create_directories(args.outputDir);
     }
 
+    if(!args.packageData && args.gbdxFile == "-") {
+        unpackStandardInput(args, out);
+        return;
+    }
+
+    // Make sure the input file exists
+    checkPackageFile(args);
+
+    auto key = readKey(args);
+    auto pool = createThreadPool(args);
+    auto streamingReader = openPackage(args, key.get(), pool.get());
+    if(streamingReader->isStreamingPackage()) {
+        unpackStreaming(args, *streamingReader, out);
+        return;
+    }
+
     // Read the model
+    DG_CHECK(!args.packageData, "Only streaming packages can be unpacked from memory");
+    initFrameworks();
     DG_LOG(gbdxm, info) << "Reading model from " << args.gbdxFile;
-    classification::GbdxModelReader reader(args.gbdxFile);
     map<string, string> contentMap;
-    auto package = reader.readModel(contentMap);
+    unique_ptr<classification::ModelPackage> package;
+    {
+        // GbdxModelReader decrypts and inflates the whole package as it
+        // reads it, so it's timed as a single phase. It also parses the
+        // metadata and creates the package in the same call, so it holds the
+        // lock throughout, and batch jobs read such packages one at a time.
+        ActionStats::Timer timer(args.stats.get(), "read", fs::file_size(args.gbdxFile));
+        auto lock = lockFrameworks();
+        classification::GbdxModelReader reader(args.gbdxFile);
+        package = reader.readModel(contentMap);
+    }
+
+    auto items = selectItems(args, contentMap);
+
+    if(args.itemSink) {
+        for(const auto& mapItem : items) {
+            const auto& modelData = package->item(mapItem.first);
+            args.itemSink(mapItem.first, modelData.data(), modelData.size());
+        }
+
+        return;
+    }
+
+    if(args.toStdout) {
+        for(const auto& name : args.items) {
+            const auto& modelData = package->item(name);
+            ActionStats::Timer timer(args.stats.get(), "write", modelData.size());
+            out.write(reinterpret_cast<const char*>(modelData.data()), modelData.size());
+        }
+
+        out.flush();
+        DG_CHECK(out.good(), "Error writing model data to standard output");
+        return;
+    }
 
-    auto fileName = fs::path(args.outputDir).append("labels.txt").string();
-    writeLabels(fileName, package->metadata().labels());
+    string fileName;
+    if(args.items.empty()) {
+        fileName = fs::path(args.outputDir).append("labels.txt").string();
+        writeLabels(fileName, package->metadata().labels());
+    }
 
     // Write out the model files
-    for(const auto& mapItem : contentMap) {
+    for(const auto& mapItem : items) {
         fileName = fs::path(args.outputDir).append(mapItem.second).string();
 
         DG_LOG(gbdxm, info) << "Writing " << mapItem.first << " to " << fileName;
 
-        ofstream ofs(fileName, ios::binary);
-        DG_CHECK(ofs.good(), "Error creating %s for writing model data: %s", fileName.c_str(), strerror(errno));
-
         const auto& modelData = package->item(mapItem.first);
-        ofs.write(reinterpret_cast<const char*>(modelData.data()), modelData.size());
-        DG_CHECK(ofs.good(), "Error writing model data to %s: %s", fileName.c_str(), strerror(errno));
+        OutputFile file(fileName);
+        file.queueWrites(args.ioEngine, modelData.size());
+
+        ActionStats::Timer timer(args.stats.get(), "write", modelData.size());
+        file.write(modelData.data(), modelData.size());
+        file.close();
+    }
+
+    DG_LOG(gbdxm, info) << "Peak memory usage: " << formatBytes(peakResidentBytes());
+    DG_LOG(gbdxm, info) << "Done";
+}
+
+void unpackStreaming(const GbdxmUnpackArgs& args, const StreamingModelReader& reader, ostream& out)
+{
+    DG_LOG(gbdxm, info) << "Reading metadata from " << packageName(args);
+    map<string, string> contentMap;
+    auto metadata = reader.readMetadata(contentMap);
+
+    // Only the requested entries are located and decoded
+    auto items = selectItems(args, contentMap);
+
+    if(args.itemSink) {
+        for(const auto& mapItem : items) {
+            const auto& name = mapItem.first;
+            const auto& sink = args.itemSink;
+            reader.readItem(name, [&sink, &name](const uint8_t* data, size_t size) {
+                sink(name, data, size);
+            });
+        }
+
+        return;
+    }
+
+    if(args.toStdout) {
+        for(const auto& name : args.items) {
+            reader.readItem(name, [&out](const uint8_t* data, size_t size) {
+                out.write(reinterpret_cast<const char*>(data), size);
+            });
+        }
+
+        out.flush();
+        DG_CHECK(out.good(), "Error writing model data to standard output");
+        return;
     }
 
+    string fileName;
+    if(args.items.empty()) {
+        fileName = fs::path(args.outputDir).append("labels.txt").string();
+        writeLabels(fileName, metadata->labels());
+    }
+
+    // Items are extracted on their own threads, separate from the pool the
+    // decoders use for chunks
+    vector<std::pair<string, string>> files(items.begin(), items.end());
+    runEach(files.size(), args.threads, [&reader, &files, &args](size_t index) {
+        const auto& name = files[index].first;
+        auto fileName = fs::path(args.outputDir).append(files[index].second).string();
+        DG_LOG(gbdxm, info) << "Writing " << name << " to " << fileName;
+        reader.extractItem(name, fileName);
+    });
+
+    DG_LOG(gbdxm, info) << "Peak memory usage: " << formatBytes(peakResidentBytes());
     DG_LOG(gbdxm, info) << "Done";
 }
 
+void unpackStandardInput(const GbdxmUnpackArgs& args, ostream& out)
+{
+    auto key = readKey(args);
+    ZipStreamReader zip(InputFile::standardInput());
+
+    // metadata.json comes last, so items are written to temporary files in
+    // the output directory and renamed once the content map is known. Items
+    // going to standard output must be asked for in package order.
+    map<string, string> tempFiles;
+    map<string, ItemChecksum> decoded;
+    vector<string> written;
+    string metadataJson;
+    bool haveMetadata = false;
+
+    auto isSelected = [&args](const string& name) {
+        return args.items.empty() || std::find(args.items.begin(), args.items.end(), name) != args.items.end();
+    };
+
+    try {
+        ZipEntry entry;
+        while(zip.nextEntry(entry)) {
+            EntryStreamDecoder decoder(zip, entry, key.get());
+            decoder.setStats(args.stats.get());
+            DG_CHECK(decoder.haveLayout(), "%s has no entry layout record, only streaming packages can be unpacked "
+                     "from standard input", entry.name.c_str());
+
+            auto name = entry.name;
+            DG_CHECK(!haveMetadata && !decoded.count(name), "Unexpected entry %s after %s", name.c_str(),
+                     haveMetadata ? "metadata.json" : "an entry of the same name");
+
+            DG_CHECK(name != SHARD_INDEX_NAME, "%s is a sharded package, its shards can only be read next to its "
+                     "file", packageName(args).c_str());
+
+            if(name == "metadata.json") {
+                decoder.decode([&metadataJson](const uint8_t* data, size_t size) {
+                    metadataJson.append(reinterpret_cast<const char*>(data), size);
+                });
+                haveMetadata = true;
+                continue;
+            }
+
+            auto& checksum = decoded[name];
+            checksum.crc = crc32(0, Z_NULL, 0);
+            auto track = [&checksum](const uint8_t* data, size_t size) {
+                checksum.crc = crc32(checksum.crc, data, static_cast<uInt>(size));
+                checksum.size += size;
+            };
+
+            if(!isSelected(name)) {
+                DG_LOG(gbdxm, info) << "Skipping " << name;
+                decoder.decode(track);
+                continue;
+            }
+
+            if(args.itemSink) {
+                const auto& sink = args.itemSink;
+                decoder.decode([&track, &sink, &name](const uint8_t* data, size_t size) {
+                    track(data, size);
+                    sink(name, data, size);
+                });
+            } else if(args.toStdout) {
+                DG_CHECK(written.size() < args.items.size() && args.items[written.size()] == name,
+                         "Items must be given in package order to unpack them from standard input to standard "
+                         "output, %s comes next", name.c_str());
+                decoder.decode([&track, &out](const uint8_t* data, size_t size) {
+                    track(data, size);
+                    out.write(reinterpret_cast<const char*>(data), size);
+                });
+                DG_CHECK(out.good(), "Error writing model data to standard output");
+            } else {
+                auto fileName = fs::path(args.outputDir).append(".gbdxm-" + name + ".part").string();
+                tempFiles[name] = fileName;
+
+                DG_LOG(gbdxm, info) << "Writing " << name << " to " << fileName;
+                OutputFile file(fileName);
+                file.queueWrites(args.ioEngine);
+                decoder.decode([&track, &file, &args](const uint8_t* data, size_t size) {
+                    track(data, size);
+                    ActionStats::Timer timer(args.stats.get(), "write", size);
+                    file.write(data, size);
+                });
+                file.close();
+            }
+
+            written.push_back(name);
+        }
+
+        DG_CHECK(haveMetadata, "metadata.json is missing from %s", packageName(args).c_str());
+
+        map<string, string> contentMap;
+        map<string, ItemChecksum> checksums;
+        auto metadata = StreamingModelReader::parseMetadata(metadataJson, contentMap, &checksums, args.stats.get());
+        auto items = selectItems(args, contentMap);
+
+        for(const auto& mapItem : items) {
+            auto it = decoded.find(mapItem.first);
+            DG_CHECK(it != decoded.end(), "%s is missing from %s", mapItem.first.c_str(), packageName(args).c_str());
+
+            auto expected = checksums.find(mapItem.first);
+            if(expected != checksums.end()) {
+                DG_CHECK(expected->second.crc == it->second.crc && expected->second.size == it->second.size,
+                         "Checksum mismatch in %s: metadata.json has CRC %08x and %llu bytes, the item has CRC %08x "
+                         "and %llu bytes", mapItem.first.c_str(), expected->second.crc,
+                         (unsigned long long) expected->second.size, it->second.crc,
+                         (unsigned long long) it->second.size);
+            }
+        }
+
+        if(args.itemSink) {
+            return;
+        }
+
+        if(args.toStdout) {
+            out.flush();
+            DG_CHECK(out.good(), "Error writing model data to standard output");
+            return;
+        }
+
+        if(args.items.empty()) {
+            writeLabels(fs::path(args.outputDir).append("labels.txt").string(), metadata->labels());
+        }
+
+        for(const auto& mapItem : items) {
+            auto fileName = fs::path(args.outputDir).append(mapItem.second).string();
+            DG_LOG(gbdxm, info) << "Renaming " << tempFiles.at(mapItem.first) << " to " << fileName;
+            fs::rename(tempFiles.at(mapItem.first), fileName);
+            tempFiles.erase(mapItem.first);
+        }
+    } catch(...) {
+        for(const auto& mapItem : tempFiles) {
+            boost::system::error_code ec;
+            fs::remove(mapItem.second, ec);
+        }
+
+        throw;
+    }
+
+    DG_LOG(gbdxm, info) << "Peak memory usage: " << formatBytes(peakResidentBytes());
+    DG_LOG(gbdxm, info) << "Done";
+}
+
+map<string, string> selectItems(const GbdxmUnpackArgs& args, const map<string, string>& contentMap)
+{
+    if(args.items.empty()) {
+        return contentMap;
+    }
+
+    map<string, string> ret;
+    for(const auto& name : args.items) {
+        auto it = contentMap.find(name);
+        if(it == contentMap.end()) {
+            vector<string> names;
+            for(const auto& mapItem : contentMap) {
+                names.push_back(mapItem.first);
+            }
+
+            DG_ERROR_THROW("%s doesn't have a '%s' item, the items are: %s", packageName(args).c_str(), name.c_str(),
+                           boost::algorithm::join(names, ", ").c_str());
+        }
+
+        ret.insert(*it);
+    }
+
+    return ret;
+}
+
+void updateModel(GbdxmUpdateArgs& args)
+{
+    DG_LOG(gbdxm, info) << "Updating metadata of " << args.gbdxFile;
+
+    auto& metadata = args.package->metadata();
+    if(!args.labelsFile.empty()) {
+        DG_LOG(gbdxm, info) << "Reading labels from " << args.labelsFile;
+        metadata.setLabels(readLinesFromFile(args.labelsFile));
+    }
+
+    ZipReader reader(args.gbdxFile);
+    auto metadataEntry = reader.find("metadata.json");
+    DG_CHECK(metadataEntry != nullptr, "metadata.json is missing from %s", args.gbdxFile.c_str());
+
+    // The package is copied up to the new metadata.json, which goes in place
+    // of the old one if that is the last entry in the file, as it is in
+    // streaming packages, otherwise after the last entry. Model file entries
+    // keep their offsets, so their alignment holds.
+    auto offset = reader.centralDirOffset();
+    auto isLast = std::all_of(reader.entries().begin(), reader.entries().end(), [metadataEntry](const ZipEntry& entry) {
+        return entry.offset <= metadataEntry->offset;
+    });
+    if(isLast) {
+        offset = metadataEntry->offset;
+    }
+
+    // Shards and their index stay as they are too
+    ShardIndex shards;
+    bool sharded = ShardIndex::read(reader, shards);
+
+    auto writeMetadata = [&](const string& fileName) {
+        StreamingModelWriter writer(ZipWriter(fileName, reader.entries(), offset), *args.package, EntryOptions());
+        if(sharded) {
+            writer.keepShards(shards);
+        }
+
+        DG_LOG(gbdxm, info) << "Writing metadata";
+        writer.writeMetadata(args.contentMap);
+        writer.close();
+    };
+
+    if(args.inPlace) {
+        DG_LOG(gbdxm, info) << "Rewriting metadata.json and the central directory of " << args.gbdxFile
+                            << " in place";
+        writeMetadata(args.gbdxFile);
+        DG_LOG(gbdxm, info) << "Done";
+        return;
+    }
+
+    // Written next to the package and renamed when complete, like a patch,
+    // so the package is never left half written and readers never see a
+    // partial central directory
+    auto tempName = args.gbdxFile + ".part";
+    try {
+        {
+            OutputFile temp(tempName);
+            if(temp.cloneFrom(reader.file())) {
+                DG_LOG(gbdxm, info) << "Updating a copy of " << args.gbdxFile << " that shares its blocks";
+            } else {
+                DG_LOG(gbdxm, info) << "Updating a full copy of " << formatBytes(offset) << " of " << args.gbdxFile
+                                    << ", the file system can't share blocks, --in-place avoids the copy";
+                temp.copyFrom(reader.file(), 0, offset);
+            }
+            temp.close();
+        }
+
+        writeMetadata(tempName);
+
+        fs::permissions(tempName, fs::status(args.gbdxFile).permissions());
+        fs::rename(tempName, args.gbdxFile);
+    } catch(...) {
+        boost::system::error_code ec;
+        fs::remove(tempName, ec);
+        throw;
+    }
+
+    DG_LOG(gbdxm, info) << "Done";
+}
+
+void runBatch(const GbdxmBatchArgs& args)
+{
+    DG_CHECK(!args.jobs.empty(), "No jobs in %s", args.gbdxFile.c_str());
+
+    ThreadPool pool(std::min(args.threads > 0 ? args.threads : ThreadPool::hardwareThreads(), args.jobs.size()));
+    DG_LOG(gbdxm, info) << "Running " << args.jobs.size() << " jobs from " << args.gbdxFile
+                        << " on " << pool.size() << " threads";
+
+    bool reads = std::any_of(args.jobs.begin(), args.jobs.end(), [](const GbdxmBatchJob& job) {
+        auto action = boost::algorithm::to_lower_copy(job.command.front());
+        return action == "unpack" || action == "verify";
+    });
+    if(reads && pool.size() > 1) {
+        DG_LOG(gbdxm, warning) << "unpack and verify jobs of packages not written by a streaming pack run one at a "
+                                  "time, DeepCore's GbdxModelReader is not known to be thread safe";
+    }
+
+    // Each job writes to its own buffer, which is printed once the job is
+    // done so that the output of concurrent jobs isn't interleaved
+    vector<std::ostringstream> outputs(args.jobs.size());
+    vector<std::future<void>> results;
+    results.reserve(args.jobs.size());
+    for(size_t i = 0; i < args.jobs.size(); ++i) {
+        const auto& job = args.jobs[i];
+        auto& output = outputs[i];
+        results.push_back(pool.submit([&args, &job, &output] {
+            DG_LOG(gbdxm, info) << "Starting job on line " << job.line << ": " << boost::algorithm::join(job.command, " ");
+            auto jobArgs = parseArgs(job.command);
+
+            // Jobs without an --io-engine of their own use the batch's
+            bool ownEngine = std::any_of(job.command.begin(), job.command.end(), [](const string& arg) {
+                return boost::algorithm::starts_with(arg, "--io-engine");
+            });
+            if(!ownEngine) {
+                jobArgs->ioEngine = args.ioEngine;
+            }
+
+            runAction(*jobArgs, output);
+        }));
+    }
+
+    size_t failed = 0;
+    for(size_t i = 0; i < args.jobs.size(); ++i) {
+        try {
+            results[i].get();
+            cout << outputs[i].str();
+            cout.flush();
+        } catch(...) {
+            DG_ERROR_LOG(gbdxm, DG_ERROR_FROM_CURRENT("Job on line %d of %s failed",
+                                                      (int) args.jobs[i].line, args.gbdxFile.c_str()));
+            ++failed;
+        }
+    }
+
+    DG_CHECK(failed == 0, "%d of %d jobs failed", (int) failed, (int) args.jobs.size());
+    DG_LOG(gbdxm, info) << "All " << args.jobs.size() << " jobs succeeded";
+}
+
+void verifyModel(const GbdxmArgs& args, ostream& out)
+{
+    DG_LOG(gbdxm, info) << "Verifying " << packageName(args);
+    checkPackageFile(args);
+
+    auto key = readKey(args);
+    auto pool = createThreadPool(args);
+    auto package = openPackage(args, key.get(), pool.get());
+    const auto& reader = *package;
+
+    map<string, string> contentMap;
+    if(!reader.isStreamingPackage()) {
+        // All we can do is load it, which checks the zip CRCs
+        DG_CHECK(!args.packageData, "Only streaming packages can be verified in memory");
+        DG_LOG(gbdxm, warning) << args.gbdxFile << " was not written by a streaming pack and has no item checksums, "
+                               << "checking that it can be read";
+        initFrameworks();
+        {
+            auto lock = lockFrameworks();
+            classification::GbdxModelReader legacyReader(args.gbdxFile);
+            legacyReader.readModel(contentMap);
+        }
+
+        for(const auto& mapItem : contentMap) {
+            out << mapItem.first << ": OK" << endl;
+        }
+
+        return;
+    }
+
+    map<string, ItemChecksum> checksums;
+    reader.readMetadata(contentMap, &checksums);
+    if(checksums.empty()) {
+        DG_LOG(gbdxm, warning) << "metadata.json of " << packageName(args) << " has no item checksums, "
+                               << "items are only checked against their entry CRCs";
+    }
+
+    // Items in either list are checked, so that an item missing from the
+    // archive or from the content map doesn't go unnoticed
+    vector<string> names;
+    for(const auto& mapItem : contentMap) {
+        names.push_back(mapItem.first);
+    }
+
+    for(const auto& mapItem : checksums) {
+        if(!contentMap.count(mapItem.first)) {
+            names.push_back(mapItem.first);
+        }
+    }
+
+    // Items are verified on their own threads, separate from the pool the
+    // decoders use for chunks, same as unpack. Each item's error is kept
+    // for the report.
+    vector<std::exception_ptr> errors(names.size());
+    runEach(names.size(), args.threads, [&reader, &checksums, &names, &errors](size_t index) {
+        const auto& name = names[index];
+        DG_LOG(gbdxm, info) << "Verifying " << name;
+
+        try {
+            // Decoding checks the data against the size and CRC in the entry
+            // layout record, or the shards against the shard index, and
+            // those are then checked against metadata.json
+            auto checksum = reader.checkItem(name);
+
+            if(!checksums.empty()) {
+                auto it = checksums.find(name);
+                DG_CHECK(it != checksums.end(), "No checksum in metadata.json");
+
+                DG_CHECK(it->second.crc == checksum.crc && it->second.size == checksum.size,
+                         "Checksum mismatch: metadata.json has CRC %08x and %llu bytes, the item has CRC %08x and %llu bytes",
+                         it->second.crc, (unsigned long long) it->second.size, checksum.crc,
+                         (unsigned long long) checksum.size);
+            }
+        } catch(...) {
+            errors[index] = std::current_exception();
+        }
+    });
+
+    size_t failed = 0;
+    for(size_t i = 0; i < names.size(); ++i) {
+        try {
+            if(errors[i]) {
+                std::rethrow_exception(errors[i]);
+            }
+            out << names[i] << ": OK" << endl;
+        } catch(const std::exception& e) {
+            out << names[i] << ": FAILED, " << e.what() << endl;
+            ++failed;
+        }
+    }
+
+    DG_CHECK(failed == 0, "%d of %d items of %s failed verification", (int) failed, (int) names.size(),
+             packageName(args).c_str());
+    DG_LOG(gbdxm, info) << "All " << names.size() << " items verified";
+}
+
+void deltaModel(const GbdxmDeltaArgs& args)
+{
+    DG_LOG(gbdxm, info) << "Writing the delta from " << args.gbdxFile << " to " << args.newFile << " to "
+                        << args.outputFile;
+    checkPackageFile(args);
+    DG_CHECK(fs::exists(args.newFile) && !fs::is_directory(args.newFile), "Input file does not exist at %s",
+             args.newFile.c_str());
+
+    auto key = readKey(args);
+    auto pool = createThreadPool(args);
+
+    // Stored plaintext items are compared where they are in the mapped files
+    StreamingModelReader base(MappedFile(args.gbdxFile), key.get(), pool.get());
+    StreamingModelReader target(MappedFile(args.newFile), key.get(), pool.get());
+    base.setStats(args.stats.get());
+    target.setStats(args.stats.get());
+
+    DeltaOptions options;
+    options.codec = isCodecSupported(EntryCodec::ZSTD) ? EntryCodec::ZSTD : EntryCodec::DEFLATE;
+    options.key = key.get();
+    options.pool = pool.get();
+    options.stats = args.stats.get();
+    // Items are decoded next to the output rather than in /tmp, which may be
+    // in memory
+    options.tempDir = fs::absolute(args.outputFile).parent_path().string();
+
+    DeltaSummary summary;
+    writePackageFile(args.outputFile, args.ioEngine, [&](ZipWriter&& patch) {
+        summary = writeDelta(base, target, std::move(patch), options);
+    });
+
+    DG_LOG(gbdxm, info) << formatBytes(summary.copied) << " copied from " << args.gbdxFile << ", "
+                        << formatBytes(summary.literal) << " changed, the patch is "
+                        << formatBytes(fs::file_size(args.outputFile));
+    DG_LOG(gbdxm, info) << "Done";
+}
+
+void patchModel(const GbdxmPatchArgs& args)
+{
+    DG_LOG(gbdxm, info) << "Patching " << args.gbdxFile << " with " << args.patchFile << " to " << args.outputFile;
+    checkPackageFile(args);
+    DG_CHECK(fs::exists(args.patchFile) && !fs::is_directory(args.patchFile), "Input file does not exist at %s",
+             args.patchFile.c_str());
+
+    auto key = readKey(args);
+    auto pool = createThreadPool(args);
+
+    StreamingModelReader base(MappedFile(args.gbdxFile), key.get(), pool.get());
+    StreamingModelReader patch(args.patchFile, key.get(), pool.get());
+    base.setStats(args.stats.get());
+    patch.setStats(args.stats.get());
+
+    DeltaOptions options;
+    options.key = key.get();
+    options.pool = pool.get();
+    options.stats = args.stats.get();
+    options.tempDir = fs::absolute(args.outputFile).parent_path().string();
+
+    writePackageFile(args.outputFile, args.ioEngine, [&](ZipWriter&& output) {
+        applyDelta(base, patch, std::move(output), options);
+    });
+
+    DG_LOG(gbdxm, info) << "Done";
+}
+
+void writePackageFile(const string& fileName, IoEngine engine, const std::function<void(ZipWriter&&)>& write)
+{
+    // Written next to the output and renamed when complete, so a failed
+    // patch never leaves a broken package behind, and the output may replace
+    // the old package
+    auto parentPath = fs::path(fileName).parent_path();
+    if(!parentPath.empty() && !fs::exists(parentPath)) {
+        DG_LOG(gbdxm, info) << "Creating directory " << parentPath.string();
+        fs::create_directories(parentPath);
+    }
+
+    auto tempName = fileName + ".part";
+    try {
+        write(ZipWriter(tempName, engine));
+        fs::rename(tempName, fileName);
+    } catch(...) {
+        boost::system::error_code ec;
+        fs::remove(tempName, ec);
+        throw;
+    }
+}
+
 void writeLabels(const string& fileName, const vector<string>& labels)
 {
     ofstream ofs(fileName);
@@ -227,4 +1189,74 @@ void writeLabels(const string& fileName, const vector<string>& labels)
     DG_CHECK(ofs.good(), "Error writing labels to  %s: %s", fileName.c_str(), strerror(errno));
 }
 
+void writeStats(const GbdxmArgs& args, ostream& out)
+{
+    auto root = args.stats->toJson();
+    root["file"] = args.gbdxFile;
+    auto report = Json::StyledWriter().write(root);
+
+    if(args.statsFile.empty()) {
+        out << report;
+        out.flush();
+        return;
+    }
+
+    DG_LOG(gbdxm, info) << "Writing statistics to " << args.statsFile;
+    ofstream ofs(args.statsFile);
+    DG_CHECK(ofs.good(), "Error creating statistics file at %s: %s", args.statsFile.c_str(), strerror(errno));
+
+    ofs << report;
+    ofs.close();
+    DG_CHECK(ofs.good(), "Error writing statistics to %s: %s", args.statsFile.c_str(), strerror(errno));
+}
+
+string packageName(const GbdxmArgs& args)
+{
+    return args.packageData ? "package in memory" : args.gbdxFile == "-" ? "standard input" : args.gbdxFile;
+}
+
+void checkPackageFile(const GbdxmArgs& args)
+{
+    if(!args.packageData) {
+        DG_CHECK(args.gbdxFile != "-", "Only unpack can read a package from standard input");
+        DG_CHECK(fs::exists(args.gbdxFile), "Input file does not exist at %s", args.gbdxFile.c_str());
+        DG_CHECK(!fs::is_directory(args.gbdxFile), "Input file at %s is a directory", args.gbdxFile.c_str());
+    }
+}
+
+unique_ptr<StreamingModelReader> openPackage(const GbdxmArgs& args, const PackageKey* key, ThreadPool* pool)
+{
+    unique_ptr<StreamingModelReader> reader;
+    if(args.packageData) {
+        reader.reset(new StreamingModelReader(args.packageData, args.packageSize, key, pool));
+    } else {
+        reader.reset(new StreamingModelReader(args.gbdxFile, key, pool));
+    }
+
+    reader->setStats(args.stats.get());
+    reader->setIoEngine(args.ioEngine);
+    return reader;
+}
+
+unique_ptr<PackageKey> readKey(const GbdxmArgs& args)
+{
+    if(args.keyFile.empty()) {
+        return nullptr;
+    }
+
+    DG_LOG(gbdxm, info) << "Reading key from " << args.keyFile;
+    return unique_ptr<PackageKey>(new PackageKey(PackageKey::fromFile(args.keyFile)));
+}
+
+unique_ptr<ThreadPool> createThreadPool(const GbdxmArgs& args)
+{
+    if(args.threads == 1) {
+        return nullptr;
+    }
+
+    unique_ptr<ThreadPool> pool(new ThreadPool(args.threads));
+    DG_LOG(gbdxm, info) << "Using " << pool->size() << " threads";
+    return pool;
+}
+
 } } // namespace dg { namespace gbdxm {
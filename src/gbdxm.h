@@ -18,9 +18,15 @@
 #ifndef DEEPCORE_GBDXM_H
 #define DEEPCORE_GBDXM_H
 
+#include "EntryCodec.h"
+
 #include <classification/ModelPackage.h>
+#include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
 
 namespace dg { namespace gbdxm {
 
@@ -29,13 +35,53 @@ enum class Action
     HELP,
     SHOW,
     PACK,
-    UNPACK
+    UNPACK,
+    UPDATE,
+    BATCH,
+    VERIFY,
+    DELTA,
+    PATCH
 };
 
 struct GbdxmArgs
 {
+    virtual ~GbdxmArgs() = default;
+
     Action action = Action::HELP;
     std::string gbdxFile;
+    std::string keyFile;
+    size_t threads = 1;
+
+    // Engine for reading model files and writing packages and unpacked items
+    // of this action. Batch jobs use the engine of the batch unless their
+    // manifest line gives one.
+    IoEngine ioEngine = IoEngine::SYNC;
+
+    // Phase timings of the action, collected if --stats or --stats-file is
+    // given. The report is printed with the action's output unless statsFile
+    // is set.
+    std::shared_ptr<ActionStats> stats;
+    std::string statsFile;
+
+    // Streaming package in memory to show, unpack, or verify instead of
+    // gbdxFile. Must outlive the action.
+    const uint8_t* packageData = nullptr;
+    size_t packageSize = 0;
+};
+
+enum class ShowFormat
+{
+    JSON,
+    TEXT
+};
+
+struct GbdxmShowArgs : public GbdxmArgs
+{
+    std::vector<std::string> fields;
+    ShowFormat format = ShowFormat::JSON;
+
+    // Lists the zip entries with their data offsets instead of the metadata
+    bool entries = false;
 };
 
 struct GbdxmPackArgs : public GbdxmArgs
@@ -46,15 +92,112 @@ struct GbdxmPackArgs : public GbdxmArgs
     std::string labelsFile;
     std::map<std::string, std::string> modelFiles;
     bool encrypt = true;
+    bool stream = false;
+    std::string cacheDir;
+    EntryCodec compression = EntryCodec::DEFLATE;
+    int level = DEFAULT_LEVEL;
+    bool adaptive = false;
+    size_t align = 0;
+
+    // Splits model files larger than this into shard packages, 0 doesn't
+    uint64_t shardSize = 0;
+
+    // Model files in memory by item name, packed instead of the files named
+    // in modelFiles, which then only give the file names in the package
+    std::map<std::string, std::vector<uint8_t>> modelData;
+
+    // Writes a streaming package to this buffer instead of gbdxFile
+    std::vector<uint8_t>* packageOutput = nullptr;
 };
 
 struct GbdxmUnpackArgs : public GbdxmArgs
 {
+    typedef std::function<void(const std::string& name, const uint8_t* data, size_t size)> ItemSink;
+
     std::string outputDir;
+    std::vector<std::string> items;
+    bool toStdout = false;
+
+    // Passes the items to this instead of writing them to outputDir, one
+    // item at a time and one chunk at a time. labels.txt isn't written.
+    ItemSink itemSink;
+};
+
+struct GbdxmUpdateArgs : public GbdxmArgs
+{
+    std::unique_ptr<deepcore::classification::ModelPackage> package;
+    std::map<std::string, std::string> contentMap;
+    std::string labelsFile;
+
+    // Rewrite the package file itself instead of a copy of it
+    bool inPlace = false;
+};
+
+// gbdxFile is the old package of both
+struct GbdxmDeltaArgs : public GbdxmArgs
+{
+    std::string newFile;
+    std::string outputFile;
+};
+
+struct GbdxmPatchArgs : public GbdxmArgs
+{
+    std::string patchFile;
+    std::string outputFile;
+};
+
+struct GbdxmBatchJob
+{
+    size_t line = 0;
+    std::vector<std::string> command;
+};
+
+struct GbdxmBatchArgs : public GbdxmArgs
+{
+    std::vector<GbdxmBatchJob> jobs;
 };
 
 void doAction(GbdxmArgs& args);
 
+/**
+ * Runs the action like doAction(), but writes the output of show, verify,
+ * unpack --stdout, and --stats to out instead of standard output.
+ */
+void runAction(GbdxmArgs& args, std::ostream& out);
+
+/**
+ * Initializes the model frameworks, such as Caffe, once. Only pack, update,
+ * and reading packages not written by a streaming pack need them, so show,
+ * unpack, and verify of streaming packages start without.
+ */
+void initFrameworks();
+
+/**
+ * Locks the model frameworks for the caller. DeepCore's model readers and
+ * writers, metadata detection, and metadata conversion aren't known to be
+ * thread safe, so batch jobs and actions running at the same time take turns
+ * with them. The rest of an action, such as reading model files, and
+ * compressing, encrypting, and writing either kind of package, runs
+ * concurrently. GbdxModelReader is the exception, it reads the whole package
+ * in the call that parses its metadata.
+ */
+std::unique_lock<std::recursive_mutex> lockFrameworks();
+
+/**
+ * Parses a gbdxm command line, starting with the action, the same way the
+ * program arguments are parsed. Used to run the jobs of a batch manifest.
+ */
+std::unique_ptr<GbdxmArgs> parseArgs(const std::vector<std::string>& command);
+
+/**
+ * Parses pack options, the same as the pack command line without the action,
+ * for model files in memory. The files are given by item name, e.g. "model",
+ * and are named after their items in the package unless the options give
+ * file names. -f may be left out if the package is written to packageOutput.
+ */
+std::unique_ptr<GbdxmPackArgs> parsePackArgs(const std::vector<std::string>& options,
+                                             std::map<std::string, std::vector<uint8_t>> modelData);
+
 } } // namespace dg { namespace gbdxm {
 
 #endif // DEEPCORE_GBDXM_H